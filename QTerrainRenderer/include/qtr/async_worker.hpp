@@ -0,0 +1,42 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace qtr
+{
+
+// single background thread running the latest submitted task only
+// (latest wins): a task still pending is replaced by a newer one, and
+// a running task is expected to poll 'is_cancelled(generation)' to
+// stop early once it has been superseded
+class AsyncWorker
+{
+public:
+  using Task = std::function<void(uint64_t generation)>;
+
+  AsyncWorker() = default;
+  ~AsyncWorker(); // cancels the current task and waits for the thread
+
+  void     cancel(); // current and pending tasks
+  bool     is_cancelled(uint64_t task_generation) const;
+  uint64_t submit(Task task); // returns the task generation
+
+private:
+  void run();
+
+  std::thread             thread; // started on the first submit
+  std::mutex              mutex;
+  std::condition_variable cv;
+  Task                    pending_task;
+  uint64_t                pending_generation = 0;
+  bool                    stop = false;
+  std::atomic<uint64_t>   generation = 0;
+};
+
+} // namespace qtr
@@ -0,0 +1,86 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "qtr/frustum.hpp"
+#include "qtr/mesh.hpp"
+
+namespace qtr
+{
+
+// quadtree node selected for rendering, drawn with the shared patch
+struct CDLODNode
+{
+  int i0;        // origin, in texels
+  int j0;        //
+  int size;      // side, in texels
+  int level;     // 0 for the finest level
+  int quadrants; // bitmask of the patch quadrants to draw (bit = qx + 2 * qz)
+};
+
+// Continuous distance-dependent LOD (F. Strugar, 2009). The heightmap
+// is covered by a min/max quadtree whose leaves are 'patch_size'
+// texels wide, each level doubling the node size. Nodes are selected
+// per frame from their distance to the eye and all drawn with the same
+// (patch_size + 1)^2 grid, the vertex shader morphing each vertex
+// towards the parent level grid before the LOD range boundary
+class CDLODQuadtree
+{
+public:
+  void build(const std::vector<float> &data,
+             int                       width,
+             int                       height,
+             int                       patch_size = 32);
+  void clear();
+  void draw_patch(int quadrants);
+  bool is_active() const;
+
+  int   get_level_count() const;
+  int   get_patch_size() const;
+  float get_morph_start(int level) const;
+  float get_morph_end(int level) const;
+
+  // recomputes the elevation bounds of the nodes overlapping the
+  // texels [i0, i1) x [j0, j1), 'data' being the whole updated heightmap
+  void update_region(const std::vector<float> &data, int i0, int j0, int i1, int j1);
+
+  // LOD ranges (world space): 'lod_distance' for level 0, doubled at
+  // each level, morphing over the last 'morph_ratio' part of each range
+  void set_lod_ranges(float lod_distance, float morph_ratio = 0.3f);
+
+  // 'frustum' is in model space, 'eye' in world space. Heightmap
+  // geometry is as in generate_heightmap: x and z in [-lx/2, lx/2],
+  // elevations y + h * ly
+  void select(std::vector<CDLODNode> &nodes,
+              const glm::mat4        &model,
+              const Frustum          &frustum,
+              const glm::vec3        &eye,
+              float                   y,
+              float                   lx,
+              float                   ly) const;
+
+private:
+  struct SelectionContext;
+
+  glm::vec2 compute_leaf_minmax(const std::vector<float> &data, int a, int b) const;
+  bool      select_node(const SelectionContext &ctx, int level, int a, int b) const;
+  void      update_parent_minmax(int level, int a0, int b0, int a1, int b1);
+
+  int width = 0;
+  int height = 0;
+  int patch_size = 32;
+
+  // per level node counts and elevation bounds, level 0 first
+  std::vector<glm::ivec2>             level_shapes;
+  std::vector<std::vector<glm::vec2>> level_minmax;
+
+  std::vector<float> ranges;
+  std::vector<float> morph_starts;
+
+  Mesh patch; // (patch_size + 1)^2 implicit vertices, indices ordered by quadrant
+};
+
+} // namespace qtr
@@ -28,6 +28,16 @@ public:
     bool flip_x = false;
   } viewer3d;
 
+  struct Compute
+  {
+    int nthreads = 0; // CPU workers for mesh generation, 0 = hardware concurrency
+  } compute;
+
+  struct Geometry
+  {
+    bool optimize_vertex_cache = true; // reorder indices and vertices of generated meshes
+  } geometry;
+
 private:
   Config(const Config &) = delete;
   Config &operator=(const Config &) = delete;
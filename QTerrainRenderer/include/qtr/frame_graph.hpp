@@ -0,0 +1,46 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace qtr
+{
+
+// pass as resolved by FrameGraph::execute
+struct FramePass
+{
+  std::string              name;
+  std::vector<std::string> reads;  // resources (e.g. texture names)
+  std::vector<std::string> writes; // same
+  bool                     culled = false;
+};
+
+// Declarative render passes of a frame: each pass declares the
+// resources it reads and writes, in execution order (a resource is
+// written before it is read). Passes whose outputs are not needed,
+// directly or not, by the requested outputs are skipped. Declared
+// again each frame, the reads then depending on the enabled effects
+class FrameGraph
+{
+public:
+  void add_pass(const std::string              &name,
+                const std::vector<std::string> &reads,
+                const std::vector<std::string> &writes,
+                std::function<void()>           fct);
+  void clear();
+
+  // culls, then runs the passes in declaration order
+  void execute(const std::vector<std::string> &outputs);
+
+  const std::vector<FramePass> &get_passes() const;
+
+private:
+  void cull(const std::vector<std::string> &outputs);
+
+  std::vector<FramePass>             passes;
+  std::vector<std::function<void()>> fcts; // one per pass
+};
+
+} // namespace qtr
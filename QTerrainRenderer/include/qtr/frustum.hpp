@@ -0,0 +1,31 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <array>
+
+#include <glm/glm.hpp>
+
+namespace qtr
+{
+
+struct BoundingBox
+{
+  glm::vec3 min = glm::vec3(0.f);
+  glm::vec3 max = glm::vec3(0.f);
+};
+
+// view frustum planes (a, b, c, d), inside when a * x + b * y + c * z +
+// d >= 0. Extracted from a clip matrix (Gribb & Hartmann), planes are
+// defined in the space the matrix takes as input (i.e. object space
+// for projection * view * model)
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes;
+
+  Frustum(); // everything inside
+  explicit Frustum(const glm::mat4 &clip);
+
+  bool intersects(const BoundingBox &bbox) const;
+};
+
+} // namespace qtr
@@ -0,0 +1,30 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace qtr
+{
+
+// XXH64 (Y. Collet, xxHash), non-cryptographic, four independent
+// lanes per 32-byte stripe
+uint64_t xxh64(const void *p_data, size_t size, uint64_t seed = 0);
+
+// content hash for change detection: XXH64 for small inputs, XXH64 of
+// the hashes of fixed-size chunks (hashed in parallel) for large ones.
+// Same value whatever the number of threads
+uint64_t hash_bytes(const void *p_data, size_t size, uint64_t seed = 0);
+
+// 'seed' completed with the bytes of each value (dimensions,
+// parameters...)
+template <typename... Args> uint64_t hash_values(uint64_t seed, const Args &...args)
+{
+  static_assert((std::is_trivially_copyable_v<Args> && ...));
+
+  ((seed = xxh64(&args, sizeof(Args), seed)), ...);
+  return seed;
+}
+
+} // namespace qtr
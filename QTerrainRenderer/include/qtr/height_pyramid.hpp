@@ -0,0 +1,62 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace qtr
+{
+
+// Conservative min/max mip chain of a heightmap. Level 0 cell (a, b)
+// bounds the quad between texels (a, b) and (a + 1, b + 1), so that
+// cells also bound the interpolated surface. Each level halves the
+// previous one with the OpenGL mipmap sizes (rounded down, at least
+// 1), the last cell of a row or column then also covers the odd
+// child left. Quad (qa, qb) is thus covered at level l by the cell
+// (min(qa >> l, nx - 1), min(qb >> l, ny - 1)), as in the shaders
+class HeightPyramid
+{
+public:
+  void build(const std::vector<float> &data, int width, int height);
+  void clear();
+  bool is_empty() const;
+
+  int        get_height() const; // of the heightmap, in texels
+  int        get_level_count() const;
+  glm::ivec2 get_level_shape(int level) const;
+  int        get_width() const;
+
+  // (min, max) per cell, row-major
+  const std::vector<glm::vec2>              &get_level(int level) const;
+  const std::vector<std::vector<glm::vec2>> &get_levels() const; // level 0 first
+  glm::vec2 get_minmax(int level, int a, int b) const;
+
+  // (min, max) bounds of the elevations over the texels [i0, i1] x
+  // [j0, j1] (inclusive), conservative, only a few cells are read
+  glm::vec2 query(int i0, int j0, int i1, int j1) const;
+
+  // recomputes the cells covering the texels [i0, i1) x [j0, j1),
+  // 'data' being the whole updated heightmap. 'p_level_rects' receives
+  // the updated cells of each level, (a0, b0, a1, b1) half-open
+  void update_region(const std::vector<float> &data,
+                     int                       i0,
+                     int                       j0,
+                     int                       i1,
+                     int                       j1,
+                     std::vector<glm::ivec4>  *p_level_rects = nullptr);
+
+private:
+  void       compute_base_cells(const std::vector<float> &data, const glm::ivec4 &rect);
+  void       compute_parent_cells(int level, const glm::ivec4 &rect);
+  glm::ivec4 get_parent_rect(int level, const glm::ivec4 &child_rect) const;
+
+  int width = 0;
+  int height = 0;
+
+  // level 0 first
+  std::vector<glm::ivec2>             level_shapes;
+  std::vector<std::vector<glm::vec2>> levels;
+};
+
+} // namespace qtr
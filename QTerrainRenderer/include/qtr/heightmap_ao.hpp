@@ -0,0 +1,35 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <vector>
+
+namespace qtr
+{
+
+// Horizon-based ambient occlusion of a heightmap, baked once instead of
+// per fragment: 16 directions, 8 logarithmic steps up to 'radius' (in
+// uv units, as the elevations are in input units). 'ao' receives, for
+// the texels [i0, i1) x [j0, j1), the occlusion in [0, 1] (1:
+// unoccluded, as everywhere if radius <= 0), before the strength mix
+// done in the shader. It is (re)allocated to the heightmap size if
+// needed
+void compute_heightmap_ao(std::vector<float>       &ao,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          float                     radius,
+                          int                       i0,
+                          int                       j0,
+                          int                       i1,
+                          int                       j1);
+
+void compute_heightmap_ao(std::vector<float>       &ao,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          float                     radius);
+
+// texels around a changed texel whose occlusion may change
+int get_heightmap_ao_margin(int width, int height, float radius);
+
+} // namespace qtr
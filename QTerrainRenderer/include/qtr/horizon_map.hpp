@@ -0,0 +1,28 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace qtr
+{
+
+// Horizon map of a heightmap: for 'nsectors' azimuths (a multiple of
+// 4, sector s toward the uv direction (cos, sin)(2 pi s / nsectors)),
+// the elevation of the horizon seen from each texel, over the whole
+// heightmap. Computed per sector with a sweep along parallel lines,
+// each keeping the upper convex hull of the profile already swept
+// (A. J. Stewart, 1998), lines in parallel.
+//
+// 'horizons' receives nsectors / 4 layers of width x height RGBA8
+// texels, sector s in the channel s % 4 of layer s / 4: atan(slope) /
+// (pi / 2), with 'slope' the max rise of the input elevation per uv
+// unit (0 for horizons below the horizontal plane), so that it does
+// not depend on the rendering scales
+void compute_horizon_map(std::vector<uint8_t>     &horizons,
+                         const std::vector<float> &data,
+                         int                       width,
+                         int                       height,
+                         int                       nsectors = 16);
+
+} // namespace qtr
@@ -21,6 +21,7 @@ bool imgui_enum_selector(const std::string              &label,
                          int                            &value,
                          const std::vector<std::string> &options);
 bool imgui_viewer_main_menubar(RenderWidget &render_widget);
+void imgui_show_render_stats(const RenderStats &stats);
 bool imgui_show_water_preset_selector(glm::vec3 &shallow, glm::vec3 &deep);
 void imgui_set_blender_style();
 
@@ -54,7 +54,7 @@ public:
     glBindVertexArray(this->sp_mesh->get_vao());
     glDrawElementsInstanced(GL_TRIANGLES,
                             this->sp_mesh->get_index_count(),
-                            GL_UNSIGNED_INT,
+                            this->sp_mesh->get_index_type(),
                             nullptr,
                             this->instance_count);
     glBindVertexArray(0);
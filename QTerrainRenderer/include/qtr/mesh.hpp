@@ -1,6 +1,8 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <bit>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -18,40 +20,143 @@ struct Vertex
   glm::vec2 uv;
 };
 
+// heightmap grid vertex, 8 bytes: position and uv are rebuilt in the
+// vertex shader from the vertex id (as for the implicit grid)
+struct TerrainVertex
+{
+  uint16_t height;    // normalized in the [hmin, hmax] elevation range
+  uint16_t padding;   // 4-byte aligned normal
+  int16_t  normal[2]; // octahedral encoding
+};
+
+// what the elevation updates of a heightmap mesh need, instead of a CPU
+// copy of its buffers: grid vertices are the valid texels in row-major
+// order, followed by 2 skirt vertices per border segment with valid
+// ends (left, right, top and bottom borders)
+struct GridLayout
+{
+  int                   width = 0;
+  int                   height = 0;
+  float                 x = 0.f; // grid center
+  float                 z = 0.f;
+  std::vector<uint64_t> valid_mask;  // texel bits, word-aligned rows (empty: all valid)
+  std::vector<uint>     row_offsets; // first vertex of each row, height + 1 entries
+  size_t                first_skirt_vertex = 0;
+  size_t                skirt_vertex_count = 0;
+  size_t                grid_index_count = 0; // skirt triangles come after
+  float                 skirt_y = 0.f;        // last uploaded skirt elevation
+
+  int get_words_per_row() const { return (this->width + 63) / 64; }
+
+  bool is_valid(int i, int j) const
+  {
+    if (this->valid_mask.empty())
+      return true;
+
+    const uint64_t word = this->valid_mask[j * this->get_words_per_row() + i / 64];
+    return (word >> (i % 64)) & 1;
+  }
+
+  // vertex of texel (i, j) if valid, else of the next valid texel
+  // (i <= width, row offset of the next row for i = width)
+  uint get_vertex(int i, int j) const
+  {
+    if (this->valid_mask.empty())
+      return this->row_offsets[j] + i;
+
+    const uint64_t *p_row = this->valid_mask.data() + j * this->get_words_per_row();
+    uint            v = this->row_offsets[j];
+
+    for (int w = 0; w < i / 64; ++w)
+      v += std::popcount(p_row[w]);
+    if (i % 64)
+      v += std::popcount(p_row[i / 64] & ((uint64_t(1) << (i % 64)) - 1));
+
+    return v;
+  }
+};
+
+// counters of the streaming vertex updates, see Mesh::set_streaming
+struct StreamingStats
+{
+  size_t updates = 0;
+  size_t fence_waits = 0;     // updates that had to wait for the GPU
+  float  fence_wait_ms = 0.f; // cumulated
+};
+
 class Mesh : protected QOpenGLFunctions_3_3_Core
 {
 public:
   Mesh();
   ~Mesh();
 
-  void create(std::vector<Vertex> vertices,
-              std::vector<uint>   indices = {},
-              bool                store_cpu_copy = false,
-              std::vector<int>    vertex_map = {});
-
-  void                 destroy();
-  void                 draw();
-  size_t               get_index_count() const;
-  std::vector<uint>   &get_indices();
-  GLuint               get_vao() const;
-  std::vector<int>    &get_vertex_map();
-  std::vector<Vertex> &get_vertices();
-  bool                 is_active() const;
-  void                 update_vertices(const std::vector<Vertex> &vertices);
-  void                 update_vertices();
+  void create(std::vector<Vertex> vertices, std::vector<uint> indices = {});
+
+  // 16-bit indices, for meshes with less than 65536 vertices
+  void create(std::vector<Vertex> vertices, std::vector<uint16_t> indices);
+
+  // compact terrain vertices (attribute locations 7 and 8)
+  void create(std::vector<TerrainVertex> vertices, std::vector<uint> indices);
+
+  // index buffer only, vertex data is rebuilt in the vertex shader
+  // from gl_VertexID
+  void create_attributeless(std::vector<uint> indices);
+
+  void                  destroy();
+  void                  draw();
+  void                  draw(size_t first_index, size_t count); // sub-range of indices
+  size_t                get_index_count() const;
+  size_t                get_vertex_buffer_size() const; // in bytes
+  GridLayout           &get_grid_layout(); // empty if not a heightmap grid
+  GLenum                get_index_type() const;
+  int                   get_stream_regions() const;
+  const StreamingStats &get_streaming_stats() const;
+  GLuint                get_vao() const;
+  bool                  is_active() const;
+  void                  set_grid_layout(GridLayout new_layout);
+  void                  update_vertices(const std::vector<Vertex> &vertices);
+  void                  update_vertices(size_t        first,
+                                        size_t        count,
+                                        const Vertex *p_vertices); // sub-range
+
+  // write access to the whole vertex buffer, previous content discarded,
+  // to be followed by 'unmap_vertex_buffer' (nullptr if the mapping
+  // failed)
+  void *map_vertex_buffer();
+  void  unmap_vertex_buffer();
+
+  // streaming mode, for vertices rewritten every frame (kept across
+  // create/destroy). With 'nregions' = 1, the buffer is orphaned before
+  // each update. With 'nregions' > 1, the vertex buffer holds a ring of
+  // 'nregions' copies: each update writes the next region (unsynchronized
+  // mapping) while the GPU may still read the previous ones, a fence per
+  // region guarding its reuse, and draws read the last written region.
+  // Sub-range updates then first carry the current region over to the
+  // next one (GPU copy). 0 disables it
+  void set_streaming(int nregions = 3);
 
 private:
+  int    advance_stream_region(); // waits for the next region to be free
+  void   allocate_vertex_buffer(const void *data, GLenum usage); // bound VBO
+  void   delete_fences();
+  size_t get_base_vertex() const; // first vertex of the current region
+
   GLuint vao = 0;
   GLuint vbo = 0;
   GLuint ebo = 0;
   size_t vertex_count = 0;
+  size_t vertex_size = 0;
   size_t index_count = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
   bool   has_indices;
 
-  // storage (optional)
-  std::vector<Vertex> vertices;
-  std::vector<uint>   indices;
-  std::vector<int>    vertex_map;
+  // streaming
+  int                 stream_regions = 0;
+  int                 stream_region = 0; // last written
+  std::vector<GLsync> stream_fences;     // per region, end of its last reads
+  StreamingStats      stream_stats;
+
+  GridLayout grid_layout;
 };
 
 } // namespace qtr
@@ -0,0 +1,82 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include "qtr/mesh.hpp"
+
+namespace qtr
+{
+
+// columns of quads per strip for grid meshes, see grid_strip_order. With
+// a FIFO post-transform cache of 2 * (width + 1) entries or more, each
+// grid vertex is transformed about once
+constexpr int grid_strip_width = 15;
+
+struct VertexCacheStats
+{
+  float acmr = 0.f; // average cache miss ratio, transformed vertices per triangle
+  float atvr = 0.f; // average transformed vertex ratio, per referenced vertex
+};
+
+// post-transform cache simulation (FIFO of 'cache_size' entries) of an
+// indexed triangle list
+VertexCacheStats analyze_vertex_cache(const std::vector<uint> &indices,
+                                      size_t                   vertex_count,
+                                      int                      cache_size = 32);
+
+// triangle reordering for the post-transform cache (T. Forsyth, "Linear-
+// speed vertex cache optimisation", 2006)
+void optimize_vertex_cache(std::vector<uint> &indices, size_t vertex_count);
+
+// vertices sorted by first use in the index buffer, indices remapped
+void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<uint> &indices);
+
+// both of the above, no-op if disabled in the config
+// (Config::geometry.optimize_vertex_cache)
+void optimize_mesh(std::vector<Vertex> &vertices, std::vector<uint> &indices);
+
+// whether grids are visited in strips, see grid_strip_order
+// (Config::geometry.optimize_vertex_cache)
+bool use_grid_strips();
+
+inline int get_grid_strip_count(int nx, int ny)
+{
+  return use_grid_strips() ? (nx + grid_strip_width - 1) / grid_strip_width : ny;
+}
+
+// number of quads visited before strip 's'
+inline size_t get_grid_strip_offset(int nx, int ny, int s)
+{
+  return use_grid_strips() ? (size_t)std::min(s * grid_strip_width, nx) * ny
+                           : (size_t)s * nx;
+}
+
+// quad visit order of a grid of 'nx' x 'ny' quads: vertical strips of
+// grid_strip_width columns, row by row within a strip. If disabled in
+// the config, each "strip" is a row of quads (plain row-major order).
+// Strips are independent and contiguous in the visit order, 'fct(i, j)'
+// is called for each quad of the strips [s0, s1)
+template <typename F> void grid_strip_order(int nx, int ny, int s0, int s1, F &&fct)
+{
+  if (!use_grid_strips())
+  {
+    for (int j = s0; j < s1; ++j)
+      for (int i = 0; i < nx; ++i)
+        fct(i, j);
+    return;
+  }
+
+  for (int s = s0; s < s1; ++s)
+  {
+    const int i0 = s * grid_strip_width;
+    const int i1 = std::min(i0 + grid_strip_width, nx);
+
+    for (int j = 0; j < ny; ++j)
+      for (int i = i0; i < i1; ++i)
+        fct(i, j);
+  }
+}
+
+} // namespace qtr
@@ -0,0 +1,54 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <thread>
+#include <vector>
+
+namespace qtr
+{
+
+// contiguous sub-range [begin, end)
+struct Band
+{
+  int begin;
+  int end;
+};
+
+// number of worker threads, from Config::compute.nthreads (0 means
+// hardware concurrency)
+int get_nthreads();
+
+// split [begin, end) into at most 'nbands' non-empty contiguous bands
+std::vector<Band> split_bands(int begin, int end, int nbands);
+
+// run 'fct(task_index)' for each task in [0, ntasks), one thread per
+// task, task 0 being executed by the calling thread
+template <typename F> void parallel_run(int ntasks, F &&fct)
+{
+  if (ntasks <= 0)
+    return;
+
+  std::vector<std::thread> threads;
+  threads.reserve(ntasks - 1);
+
+  for (int t = 1; t < ntasks; ++t)
+    threads.emplace_back([&fct, t]() { fct(t); });
+
+  fct(0);
+
+  for (auto &th : threads)
+    th.join();
+}
+
+// run 'fct(band_begin, band_end)' over [begin, end) split in bands
+template <typename F> void parallel_for(int begin, int end, F &&fct, int nthreads = 0)
+{
+  const std::vector<Band> bands = split_bands(begin,
+                                              end,
+                                              nthreads > 0 ? nthreads : get_nthreads());
+
+  parallel_run(static_cast<int>(bands.size()),
+               [&](int b) { fct(bands[b].begin, bands[b].end); });
+}
+
+} // namespace qtr
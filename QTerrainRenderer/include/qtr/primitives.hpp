@@ -1,7 +1,12 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <functional>
+
+#include "qtr/frustum.hpp"
 #include "qtr/mesh.hpp"
+#include "qtr/raster.hpp"
+#include "qtr/rtin.hpp"
 
 namespace qtr
 {
@@ -12,6 +17,11 @@ namespace qtr
 
 void generate_cube(Mesh &mesh, float x, float y, float z, float lx, float ly, float lz);
 
+// with 'compact_vertices', TerrainVertex layout (8 bytes instead of
+// 32): heights normalized in [hmin, hmax] (see 'p_hmax'), positions and
+// uv rebuilt by the shaders from the hmap_* uniforms ('x', 'z' and
+// 'add_level' are then ignored) and elevation updates are not possible.
+// Otherwise, only a GridLayout is kept for the elevation updates
 void generate_heightmap(Mesh                     &mesh,
                         const std::vector<float> &data,
                         int                       width,
@@ -25,17 +35,159 @@ void generate_heightmap(Mesh                     &mesh,
                         bool                      add_skirt = false,
                         float                     add_level = 0.f,
                         float                     exclude_below = -FLT_MAX,
-                        float                    *p_hmin = nullptr);
+                        float                    *p_hmin = nullptr,
+                        bool                      compact_vertices = false,
+                        float                    *p_hmax = nullptr);
+
+// same, from a typed raster (first channel), converted row by row while
+// building
+void generate_heightmap(Mesh             &mesh,
+                        const RasterView &data,
+                        float             x,
+                        float             y,
+                        float             z,
+                        float             lx,
+                        float             ly,
+                        float             lz,
+                        bool              add_skirt = false,
+                        float             add_level = 0.f,
+                        float             exclude_below = -FLT_MAX,
+                        float            *p_hmin = nullptr,
+                        bool              compact_vertices = false,
+                        float            *p_hmax = nullptr);
+
+// CPU side of generate_heightmap, without any OpenGL call (can run on
+// a worker thread). 'is_cancelled' is polled between the build steps,
+// false is returned if the build has been abandoned
+struct HeightmapMeshData
+{
+  std::vector<Vertex>        vertices;
+  std::vector<TerrainVertex> compact_vertices; // only with 'compact_vertices'
+  std::vector<uint>          indices;
+  std::vector<int>           vertex_map; // texel -> vertex, only used while building
+  GridLayout                 layout;
+  float                      hmin = 0.f;
+  float                      hmax = 0.f;
+};
+
+bool build_heightmap_mesh_data(HeightmapMeshData           &mesh_data,
+                               const std::vector<float>    &data,
+                               int                          width,
+                               int                          height,
+                               float                        x,
+                               float                        y,
+                               float                        z,
+                               float                        lx,
+                               float                        ly,
+                               float                        lz,
+                               bool                         add_skirt = false,
+                               float                        add_level = 0.f,
+                               float                        exclude_below = -FLT_MAX,
+                               bool                         compact_vertices = false,
+                               const std::function<bool()> &is_cancelled = {});
+
+bool build_heightmap_mesh_data(HeightmapMeshData           &mesh_data,
+                               const RasterView            &data,
+                               float                        x,
+                               float                        y,
+                               float                        z,
+                               float                        lx,
+                               float                        ly,
+                               float                        lz,
+                               bool                         add_skirt = false,
+                               float                        add_level = 0.f,
+                               float                        exclude_below = -FLT_MAX,
+                               bool                         compact_vertices = false,
+                               const std::function<bool()> &is_cancelled = {});
+
+// GPU upload of a build_heightmap_mesh_data output (current GL
+// context required)
+void create_heightmap_mesh(Mesh &mesh, HeightmapMeshData &&mesh_data);
 
+// index-only grid for a width x height heightmap, vertex 'id' is texel
+// (id % width, id / width). Skirt vertices are numbered from width *
+// height, edge by edge (left, right, top, bottom), see the implicit
+// grid shaders
+void generate_heightmap_implicit_grid(Mesh &mesh,
+                                      int   width,
+                                      int   height,
+                                      bool  add_skirt = false);
+
+struct HeightmapTile
+{
+  Mesh        mesh;
+  BoundingBox bbox;
+};
+
+// heightmap split in tiles of 'tile_size' x 'tile_size' quads (at
+// most 250 for 16-bit indices), tiles share their border vertices.
+// Skirts are only added on the outer borders, at the global min
+// elevation, so that tiles join without cracks
+void generate_heightmap_tiles(std::vector<std::unique_ptr<HeightmapTile>> &tiles,
+                              const std::vector<float>                    &data,
+                              int                                          width,
+                              int                                          height,
+                              int                                          tile_size,
+                              float                                        x,
+                              float                                        y,
+                              float                                        z,
+                              float                                        lx,
+                              float                                        ly,
+                              float                                        lz,
+                              bool   add_skirt = false,
+                              float *p_hmin = nullptr);
+
+// heightmap mesh from the RTIN triangulation with a vertical error
+// below 'max_error' (input elevation units). 'rtin' must have been
+// built from 'data', excluded texels are the ones given to
+// HeightmapRTIN::build
+void generate_heightmap_rtin(Mesh                     &mesh,
+                             const HeightmapRTIN      &rtin,
+                             const std::vector<float> &data,
+                             float                     x,
+                             float                     y,
+                             float                     z,
+                             float                     lx,
+                             float                     ly,
+                             float                     lz,
+                             float                     max_error,
+                             bool                      add_skirt = false,
+                             float                     add_level = 0.f,
+                             float                    *p_hmin = nullptr);
+
+// vertices rebuilt from the data row by row and written straight to
+// the mapped vertex buffer (no CPU copy of the mesh needed, see
+// GridLayout)
 void update_heightmap_elevation(Mesh                     &mesh,
                                 const std::vector<float> &data,
                                 int                       width,
                                 int                       height,
                                 float                     y,
+                                float                     lx,
                                 float                     ly,
+                                float                     lz,
                                 float                    &hmin,
                                 float                     add_level = 0.f);
 
+// update of the texels [i0, i1) x [j0, j1) of a mesh built by
+// generate_heightmap: vertices of the region (and around it, for the
+// normals) rebuilt and uploaded row by row, skirts at elevation 'hmin'
+// (input units) re-uploaded if it changed
+void update_heightmap_elevation_region(Mesh                     &mesh,
+                                       const std::vector<float> &data,
+                                       int                       width,
+                                       int                       height,
+                                       int                       i0,
+                                       int                       j0,
+                                       int                       i1,
+                                       int                       j1,
+                                       float                     y,
+                                       float                     lx,
+                                       float                     ly,
+                                       float                     lz,
+                                       float                     hmin,
+                                       float                     add_level = 0.f);
+
 void generate_grass_leaf_2sided(Mesh            &mesh,
                                 const glm::vec3 &base_pos,
                                 float            height,
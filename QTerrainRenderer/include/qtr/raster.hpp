@@ -0,0 +1,115 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace qtr
+{
+
+// IEEE 754 half precision float, storage only (see half_to_float)
+struct half
+{
+  uint16_t bits;
+};
+
+enum class PixelType
+{
+  UINT8,
+  UINT16,
+  HALF,
+  FLOAT,
+};
+
+float    half_to_float(uint16_t bits);
+uint16_t float_to_half(float value); // round to nearest even
+
+// bulk conversions for the texture uploads, branchless so that the
+// loops vectorize. Unorm16 values are 'value' remapped from [vmin,
+// vmax] to [0, 65535]
+void convert_to_half(const float *p_src, size_t count, uint16_t *p_dst);
+void convert_to_unorm16(const float *p_src,
+                        size_t       count,
+                        float        vmin,
+                        float        vmax,
+                        uint16_t    *p_dst);
+
+template <typename T> constexpr PixelType get_pixel_type()
+{
+  if constexpr (std::is_same_v<T, uint8_t>)
+    return PixelType::UINT8;
+  else if constexpr (std::is_same_v<T, uint16_t>)
+    return PixelType::UINT16;
+  else if constexpr (std::is_same_v<T, half>)
+    return PixelType::HALF;
+  else
+  {
+    static_assert(std::is_same_v<T, float>, "uint8_t, uint16_t, half or float only");
+    return PixelType::FLOAT;
+  }
+}
+
+// non-owning, read-only view of a 'width' x 'height' raster of
+// 'channels' interleaved components, rows 'stride' pixels apart (0:
+// packed rows). Integer components read as normalized values in
+// [0, 1] (as the GL_R8 / GL_R16 textures they are uploaded to), so
+// that no float copy of the data is needed. The viewed buffer must
+// outlive the view
+class RasterView
+{
+public:
+  template <typename T>
+  RasterView(std::span<const T> data,
+             int                width,
+             int                height,
+             int                channels = 1,
+             size_t             stride = 0)
+      : p_data(data.data()), size(data.size()), type(get_pixel_type<T>()),
+        width(width), height(height), channels(channels),
+        stride(stride ? stride : (size_t)width)
+  {
+  }
+
+  template <typename T>
+  RasterView(const std::vector<T> &data, int width, int height, int channels = 1)
+      : RasterView(std::span<const T>(data), width, height, channels)
+  {
+  }
+
+  // component 'c' of pixel (i, j)
+  float at(int i, int j, int c = 0) const;
+
+  // first component of the pixels [i0, i1) of row 'j': 'p_row' such
+  // that p_row[i] is pixel i. Single-channel float rows are read in
+  // place, other rows are converted into 'p_buffer' (at least 'width'
+  // floats)
+  const float *read_row(int j, int i0, int i1, float *p_buffer) const;
+
+  // packed float copy of the first component
+  std::vector<float> to_float_vector() const;
+
+  // content (row padding excluded), type and shape, see hash_bytes
+  uint64_t get_hash() const;
+
+  int         get_channels() const { return this->channels; }
+  size_t      get_component_size() const; // in bytes
+  const void *get_data() const { return this->p_data; }
+  int         get_height() const { return this->height; }
+  size_t      get_stride() const { return this->stride; } // in pixels
+  PixelType   get_type() const { return this->type; }
+  int         get_width() const { return this->width; }
+  bool        is_valid() const; // shape consistent with the viewed buffer
+
+private:
+  const void *p_data;
+  size_t      size; // in components
+  PixelType   type;
+  int         width;
+  int         height;
+  int         channels;
+  size_t      stride; // in pixels
+};
+
+} // namespace qtr
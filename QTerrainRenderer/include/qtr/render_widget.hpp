@@ -1,6 +1,9 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <mutex>
+#include <unordered_map>
+
 #include <QElapsedTimer>
 #include <QOpenGLFunctions_3_3_Core>
 #include <QOpenGLWidget>
@@ -14,18 +17,34 @@
 
 #include "nlohmann/json.hpp"
 
+#include "qtr/async_worker.hpp"
 #include "qtr/camera.hpp"
+#include "qtr/cdlod.hpp"
+#include "qtr/frame_graph.hpp"
+#include "qtr/frustum.hpp"
+#include "qtr/height_pyramid.hpp"
 #include "qtr/instanced_mesh.hpp"
 #include "qtr/light.hpp"
 #include "qtr/mesh.hpp"
+#include "qtr/primitives.hpp"
+#include "qtr/raster.hpp"
 #include "qtr/shader_manager.hpp"
+#include "qtr/shadow_cascades.hpp"
 #include "qtr/texture.hpp"
 #include "qtr/texture_manager.hpp"
 
 #define QTR_TEX_ALBEDO "albedo"
+#define QTR_TEX_AO "ao"
+#define QTR_TEX_FLOW "flow"
 #define QTR_TEX_HMAP "hmap"
+#define QTR_TEX_HMAP_MINMAX "hmap_minmax"
+#define QTR_TEX_HORIZON "horizon"
 #define QTR_TEX_NORMAL "normal"
+#define QTR_TEX_SCATTERING "scattering"
 #define QTR_TEX_SHADOW_MAP "shadow_map"
+#define QTR_TEX_SHADOW_MOMENTS "shadow_moments"
+#define QTR_TEX_SHADOW_MOMENTS_BLUR "shadow_moments_blur"
+#define QTR_TEX_WAVES "waves"
 #define QTR_TEX_DEPTH "depth"
 
 namespace qtr
@@ -37,6 +56,39 @@ enum RenderType : int
   RENDER_3D
 };
 
+enum TerrainRenderMode : int
+{
+  TERRAIN_MESH,          // full vertex buffer built on the CPU
+  TERRAIN_IMPLICIT_GRID, // index buffer only, displaced from texture_hmap
+  TERRAIN_TILED_MESH,    // per-tile meshes, frustum culled
+  TERRAIN_CDLOD,         // quadtree nodes drawn with a shared patch, geomorphed
+  TERRAIN_RTIN           // error-bounded mesh, see HeightmapRTIN
+};
+
+enum ShadowFilter : int
+{
+  SHADOW_FILTER_PCF, // hardware depth comparisons, Poisson disc taps
+  SHADOW_FILTER_VSM  // variance shadow map, blurred, one fetch per sample
+};
+
+struct RenderStats
+{
+  int    terrain_tiles = 0;
+  int    terrain_lod_levels = 0;
+  int    terrain_tiles_shadow_pass = 0; // drawn tiles or LOD nodes, after culling
+  int    terrain_tiles_depth_pass = 0;
+  int    terrain_tiles_lit_pass = 0;
+  int    terrain_triangles_lit_pass = 0;
+  size_t terrain_vertex_bytes = 0;  // GPU vertex buffers of the terrain meshes
+  int    skipped_uploads = 0;       // set_* calls with unchanged data, cumulated
+  int    skipped_shadow_passes = 0; // cached shadow map reused, cumulated
+  int    shadow_cascades_drawn = 0; // last shadow pass
+
+  StreamingStats water_streaming; // see Mesh::set_streaming
+
+  std::vector<FramePass> frame_passes; // last 3D frame, culled passes included
+};
+
 struct Viewer2DSettings
 {
   float     zoom = 0.9f;
@@ -70,6 +122,14 @@ public:
   // --- Setters
   void set_render_type(const RenderType &new_render_type);
 
+  TerrainRenderMode get_terrain_render_mode() const;
+  void              set_terrain_render_mode(const TerrainRenderMode &new_mode);
+
+  // storage of the heightmap texture sampled by the shaders (16-bit
+  // formats halve its memory and fetch bandwidth), float by default
+  TexturePrecision get_heightmap_texture_precision() const;
+  void             set_heightmap_texture_precision(TexturePrecision new_precision);
+
   bool get_bypass_texture_albedo() const;
   bool get_render_plane() const;
   bool get_render_points() const;
@@ -96,18 +156,73 @@ public:
   // --- Geometry
   void clear(); // geom and texture
 
+  // e.g. for per-frame elevation updates (update_heightmap_elevation),
+  // streamed by default (Mesh::set_streaming). The next
+  // set_water_geometry call is then never skipped as unchanged
   Mesh &get_water_mesh();
 
+  // min/max pyramid of the current heightmap (input elevations, before
+  // the hmap_h scaling), also uploaded as the QTR_TEX_HMAP_MINMAX
+  // texture and refreshed by the region updates
+  const HeightPyramid &get_heightmap_pyramid() const;
+
   void set_heightmap_geometry(const std::vector<float> &data,
                               int                       width,
                               int                       height,
                               bool                      add_skirt = true);
+
+  // typed data (uint8_t, uint16_t, half or float, integers read as
+  // normalized values, see RasterView), rows 'stride' texels apart (0:
+  // packed). Converted once into the float copy kept by the widget, the
+  // heightmap texture is uploaded from 'data' in its own format (e.g.
+  // GL_R16 for uint16_t)
+  template <typename T>
+  void set_heightmap_geometry(std::span<const T> data,
+                              int                width,
+                              int                height,
+                              bool               add_skirt = true,
+                              size_t             stride = 0)
+  {
+    this->set_heightmap_geometry(RasterView(data, width, height, 1, stride), add_skirt);
+  }
+
+  void set_heightmap_geometry(const RasterView &data, bool add_skirt = true);
+
+  // same as set_heightmap_geometry, but the CPU side of the terrain
+  // build runs on a background thread and the result is uploaded by the
+  // next paintGL. A newer call (async or not) cancels a build still in
+  // progress, the current terrain stays on screen meanwhile
+  void set_heightmap_geometry_async(std::vector<float> data,
+                                    int                width,
+                                    int                height,
+                                    bool               add_skirt = true);
   void reset_heightmap_geometry();
 
+  // replaces the texels [x, x + w) x [y, y + h) of the current heightmap
+  // by 'patch' (w x h, row-major), only the region is re-uploaded
+  void update_heightmap_region(int                       x,
+                               int                       y,
+                               int                       w,
+                               int                       h,
+                               const std::vector<float> &patch);
+
   void set_water_geometry(const std::vector<float> &data,
                           int                       width,
                           int                       height,
                           float                     exclude_below);
+
+  // typed data, read in place while the mesh is built (no float copy)
+  template <typename T>
+  void set_water_geometry(std::span<const T> data,
+                          int                width,
+                          int                height,
+                          float              exclude_below,
+                          size_t             stride = 0)
+  {
+    this->set_water_geometry(RasterView(data, width, height, 1, stride), exclude_below);
+  }
+
+  void set_water_geometry(const RasterView &data, float exclude_below);
   void reset_water_geometry();
 
   void set_points(const std::vector<float> &x,
@@ -142,6 +257,20 @@ public:
   void set_texture(const std::string          &name,
                    const std::vector<uint8_t> &data,
                    int                         width); // RGBA 8bit
+
+  // typed data, uploaded as is (see Texture::from_raster)
+  template <typename T>
+  void set_texture(const std::string &name,
+                   std::span<const T> data,
+                   int                width,
+                   int                height,
+                   int                channels,
+                   size_t             stride = 0)
+  {
+    this->set_texture(name, RasterView(data, width, height, channels, stride));
+  }
+
+  void set_texture(const std::string &name, const RasterView &data);
   void reset_texture(const std::string &name);
   void reset_textures();
 
@@ -160,12 +289,19 @@ protected:
   void render_depth_map(const glm::mat4 &model,
                         const glm::mat4 &view,
                         const glm::mat4 &projection);
-  void render_shadow_map(const glm::mat4 &model, glm::mat4 &light_space_matrix);
+  void render_lit_pass(const glm::mat4 &model, const glm::mat4 &projection);
+  void render_scattering(const glm::mat4 &model, const glm::mat4 &projection);
+  void render_shadow_map(const glm::mat4 &model, float aspect_ratio);
+  void render_shadow_map_blur(const std::vector<int> &layers); // SHADOW_FILTER_VSM
+  int  draw_terrain(QOpenGLShaderProgram &shader,
+                    const glm::mat4      &model,
+                    const glm::mat4      &view_projection,
+                    const glm::vec3      &eye, // LOD selection, world space
+                    int                  *p_ntriangles = nullptr);
   void set_common_uniforms(QOpenGLShaderProgram &shader,
                            const glm::mat4      &model,
                            const glm::mat4      &projection,
-                           const glm::mat4      &view,
-                           const glm::mat4      &light_space);
+                           const glm::mat4      &view);
   void setup_gl_state();
   void unbind_textures();
   void update_camera();
@@ -183,7 +319,42 @@ protected:
 
 private:
   // --- Helpers
+  // needs a current GL context, the heightmap texture is uploaded from
+  // 'p_texture_data' if given, else from 'data'
+  void apply_heightmap_geometry(std::vector<float> data,
+                                int                width,
+                                int                height,
+                                bool               add_skirt,
+                                const RasterView  *p_texture_data = nullptr);
+  void cancel_heightmap_build();
   void reset_camera_position();
+  void update_heightmap_ao(); // needs a current GL context
+  void update_horizon_map();  // needs a current GL context
+  void update_plane_geometry();
+  void update_terrain_geometry(bool rebuild_grid = true); // needs a current GL context
+  void update_terrain_regions(const std::vector<glm::ivec4> &rects,
+                              float old_regions_min); // needs a current GL context
+  void update_terrain_stats();
+  void update_water_textures(); // needs a current GL context
+  void upload_heightmap_build();   // needs a current GL context
+  void upload_heightmap_pyramid(); // needs a current GL context
+  void upload_heightmap_texture(); // needs a current GL context
+
+  // upload deduplication: keys combine a content hash with the shape
+  // and the build parameters (0: no key, never skipped)
+  uint64_t get_heightmap_key(const RasterView &data, bool add_skirt) const;
+  bool     is_heightmap_uploaded(); // data and texture still there
+  bool     is_horizon_map_used();   // enabled and baked
+  bool     is_terrain_in_shadow_map();
+  bool     is_upload_skipped(uint64_t key, uint64_t current_key, bool is_active);
+
+  // 'hmap_tex_decode' shader uniform, see Texture::get_decode
+  glm::vec2 get_heightmap_decode();
+
+  // parameters of the shadow depth pass (light, model, drawn objects),
+  // the geometry changes being tracked by need_shadow_map_update, the
+  // camera ones by shadow_cascade_contains
+  uint64_t get_shadow_map_key(const glm::mat4 &model);
 
   // --- General
   std::string title;
@@ -203,6 +374,7 @@ private:
 
   // --- User parameters
   bool wireframe_mode = false;
+  bool show_stats = false;
   bool auto_rotate_light = false;
   bool auto_rotate_camera = false;
 
@@ -227,6 +399,48 @@ private:
   int   current_height = 0;
   bool  current_add_skirt_state = true;
 
+  TerrainRenderMode  terrain_render_mode = TerrainRenderMode::TERRAIN_MESH;
+  int                terrain_tile_size = 128; // in quads, for TERRAIN_TILED_MESH
+  bool               terrain_compact_vertices = false; // TERRAIN_MESH, TerrainVertex
+  float              cdlod_quad_pixels = 4.f; // projected quad size, see draw_terrain
+  bool               cdlod_show_levels = false; // debug, one color per LOD level
+  float              rtin_max_error = 1e-3f;    // in input elevation units
+  bool               need_terrain_update = false;
+  std::vector<float> hmap_data; // input copy, to rebuild the terrain on mode change
+  TexturePrecision   hmap_texture_precision = PRECISION_FLOAT;
+  bool               need_hmap_texture_update = false;
+
+  // background terrain build, see set_heightmap_geometry_async
+  struct HeightmapBuild
+  {
+    std::vector<float> data;
+    int                width;
+    int                height;
+    bool               add_skirt;
+    TerrainRenderMode  mode; // at submission, CPU work redone if it changed
+    bool               compact_vertices;
+    HeightmapMeshData  mesh_data; // TERRAIN_MESH
+    HeightmapRTIN      rtin;      // TERRAIN_RTIN
+    HeightPyramid      pyramid;
+    uint64_t           key;       // see is_upload_skipped
+  };
+
+  std::mutex                      hmap_build_mutex;
+  std::unique_ptr<HeightmapBuild> hmap_build; // ready for upload, guarded by the mutex
+
+  // keys of what is currently uploaded, see is_upload_skipped
+  uint64_t                                  hmap_key = 0;
+  uint64_t                                  water_key = 0;
+  uint64_t                                  water_topology_key = 0; // water indices
+  uint64_t                                  cdlod_ranges_key = 0; // camera, viewport
+  std::unordered_map<std::string, uint64_t> texture_keys;
+
+  // shadow map cache, each cascade redrawn only if its key or the
+  // geometry changed
+  std::vector<uint64_t> shadow_cascade_keys;
+  std::vector<int>      shadow_cascade_ages; // frames since drawn
+  bool                  need_shadow_map_update = true;
+
   // --- Rendering parameters
 
   // Scene components visibility
@@ -250,12 +464,31 @@ private:
   // Shadows
   bool  bypass_shadow_map = false;
   float shadow_strength = 0.9f;
+  int   shadow_cascade_count = 3;     // at most QTR_MAX_SHADOW_CASCADES
+  int   shadow_map_resolution = 2048; // per cascade
+
+  ShadowFilter shadow_filter = ShadowFilter::SHADOW_FILTER_PCF;
+  int          shadow_blur_radius = 2; // in texels, SHADOW_FILTER_VSM
+
+  // amortized updates, e.g. with a moving light: the nearest cascade is
+  // drawn every frame, the others (oldest first) up to the budget, the
+  // stale ones being sampled with the light they were drawn with
+  bool shadow_time_slicing = false;
+  int  shadow_cascade_budget = 1; // cascades per frame besides the nearest
+
+  // terrain shadows from the horizon map, the shadow map then only has
+  // the instances (and the terrain for the atmospheric scattering)
+  bool terrain_horizon_shadows = true;
+  bool need_horizon_update = false; // baked at the next paintGL if enabled
 
   // Ambient occlusion
   bool  add_ambiant_occlusion = true;
   float ambiant_occlusion_strength = 0.8f;
   float ambiant_occlusion_radius = 0.03f;
 
+  std::vector<float> hmap_ao;                // baked, see compute_heightmap_ao
+  bool               need_ao_update = false; // baked at the next paintGL if enabled
+
   // Textures control
   bool bypass_texture_albedo = false;
 
@@ -280,6 +513,12 @@ private:
   bool  animate_waves = false;
   float waves_speed = 0.2f;
 
+  // baked waves (see compute_wave_texture) and shore flow (see
+  // compute_flow_texture), sampled instead of evaluated per fragment
+  bool     need_flow_update = false; // baked at the next paintGL if enabled
+  uint64_t waves_key = 0;
+  int      waves_tile_cells = 16;
+
   // --- Environmental effects
   bool      add_fog = false;
   glm::vec3 fog_color = glm::vec3(1.f, 1.f, 1.f);
@@ -291,6 +530,7 @@ private:
   glm::vec3 mie_color = glm::vec3(1.0f, 0.8f, 0.7f);      // whitish/yellowish
   float     fog_strength = 0.5f;
   float     fog_scattering_ratio = 0.7f;
+  int       scattering_downsample = 2; // 2: half, 4: quarter (and depth map) resolution
 
   // --- 2D Viewer
   Viewer2DSettings viewer2d_settings;
@@ -299,26 +539,45 @@ private:
   std::unique_ptr<ShaderManager> sp_shader_manager;
   GLuint                         fbo;
   GLuint                         fbo_depth;
+  GLuint                         fbo_shadow_blur;
+  GLuint                         fbo_scattering;
   bool                           initial_gl_done = false;
 
   // --- Scene components
-  Camera camera_shadow_pass;
   Camera camera;
   Light  light;
 
-  Mesh                        plane;
-  Mesh                        hmap;
-  Mesh                        water_mesh;
-  Mesh                        path_mesh;
-  InstancedMesh<BaseInstance> points_instanced_mesh;
-  InstancedMesh<BaseInstance> trees_instanced_mesh;
-  InstancedMesh<BaseInstance> rocks_instanced_mesh;
-  InstancedMesh<BaseInstance> leaves_instanced_mesh;
+  std::vector<ShadowCascade> shadow_cascades; // of the last shadow pass
+
+  Mesh                                        plane;
+  Mesh                                        fullscreen_triangle;
+  Mesh                                        hmap;
+  std::vector<std::unique_ptr<HeightmapTile>> hmap_tiles;
+  CDLODQuadtree                               hmap_cdlod;
+  HeightmapRTIN                               hmap_rtin; // kept for re-extractions
+  HeightPyramid                               hmap_pyramid;
+  std::vector<CDLODNode>                      hmap_cdlod_nodes; // per pass selection
+  Mesh                                        water_mesh;
+  Mesh                                        path_mesh;
+  InstancedMesh<BaseInstance>                 points_instanced_mesh;
+  InstancedMesh<BaseInstance>                 trees_instanced_mesh;
+  InstancedMesh<BaseInstance>                 rocks_instanced_mesh;
+  InstancedMesh<BaseInstance>                 leaves_instanced_mesh;
 
   std::unique_ptr<TextureManager> sp_texture_manager;
 
+  // --- Render passes, declared again each 3D frame
+  FrameGraph frame_graph;
+
+  // --- Statistics (overlay)
+  RenderStats stats;
+
   // --- ImGUI
   ImGuiContext *imgui_context = nullptr;
+
+  // --- Background tasks (last member, stopped before anything else is
+  // destroyed)
+  AsyncWorker hmap_build_worker;
 };
 
 // --- Helpers
@@ -0,0 +1,51 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "qtr/mesh.hpp"
+
+namespace qtr
+{
+
+// Right-triangulated irregular network (see V. Agafonkin's Martini,
+// after Evans et al. 1997). The vertical error of every split point of
+// the 4-8 hierarchy is computed once per heightmap, meshes for a given
+// error tolerance are then extracted by a top-down traversal.
+//
+// Heightmaps of any shape are embedded in a 2^k grid: triangles
+// overlapping both the heightmap and the padding (or both valid and
+// excluded texels) always get refined, so that the extracted mesh
+// stops exactly at the heightmap borders and at the holes
+class HeightmapRTIN
+{
+public:
+  void build(const std::vector<float> &data,
+             int                       width,
+             int                       height,
+             float                     exclude_below = -FLT_MAX);
+  void clear();
+  bool is_empty() const;
+
+  int get_width() const;
+  int get_height() const;
+
+  // triangles (texel indices j * width + i, same winding as
+  // generate_heightmap) of the mesh with a vertical error below
+  // 'max_error' (in input elevation units)
+  void extract(std::vector<uint> &triangles, float max_error) const;
+
+  bool is_valid(int i, int j) const; // inside the heightmap and not excluded
+
+private:
+  int width = 0;
+  int height = 0;
+  int size = 0; // 2^k quads, grid of (size + 1)^2 points
+
+  std::vector<float>   errors;   // per grid point, (size + 1)^2
+  std::vector<uint8_t> excluded; // per texel, empty if no texel excluded
+};
+
+} // namespace qtr
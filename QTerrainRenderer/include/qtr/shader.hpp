@@ -26,6 +26,14 @@ private:
   std::unique_ptr<QOpenGLShaderProgram> sp_program;
 };
 
+// returns 'vertex_code' with the shared terrain vertex code
+// (shaders/terrain_vertex.glsl) inserted after its '#version' line
+std::string add_terrain_vertex_code(const std::string &vertex_code);
+
+static const std::string terrain_vertex_code =
+#include "shaders/terrain_vertex.glsl"
+    ;
+
 static const std::string diffuse_basic_vertex =
 #include "shaders/diffuse_basic.vert"
     ;
@@ -42,6 +50,10 @@ static const std::string diffuse_blinn_phong_frag =
 #include "shaders/diffuse_blinn_phong.frag"
     ;
 
+static const std::string fullscreen_triangle_vertex =
+#include "shaders/fullscreen_triangle.vert"
+    ;
+
 static const std::string depth_map_vertex =
 #include "shaders/depth_map.vert"
     ;
@@ -58,6 +70,19 @@ static const std::string shadow_map_depth_pass_frag =
 #include "shaders/shadow_map_depth_pass.frag"
     ;
 
+static const std::string shadow_map_moments_pass_frag =
+#include "shaders/shadow_map_moments_pass.frag"
+    ;
+
+
+static const std::string shadow_map_blur_frag =
+#include "shaders/shadow_map_blur.frag"
+    ;
+
+static const std::string scattering_frag =
+#include "shaders/scattering.frag"
+    ;
+
 static const std::string shadow_map_lit_pass_vertex =
 #include "shaders/shadow_map_lit_pass.vert"
     ;
@@ -0,0 +1,16 @@
+R""(
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#version 330 core
+
+out vec2 frag_uv;
+
+void main()
+{
+  // fullscreen triangle, vertices 0, 1, 2 without attributes
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+
+  frag_uv = p;
+  gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
+)""
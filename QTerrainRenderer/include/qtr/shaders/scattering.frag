@@ -0,0 +1,174 @@
+R""(
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#version 330 core
+
+// Atmospheric scattering, once per pixel of a reduced resolution
+// buffer, from the depth pass. Output: fog color (rgb) and its blend
+// factor (a), upsampled and applied by shadow_map_lit_pass.frag
+
+// === Inputs / Outputs
+
+in vec2 frag_uv;
+
+out vec4 frag_color;
+
+// === Uniforms
+
+// --- Matrices
+uniform mat4 view;
+uniform mat4 inv_view_projection;
+
+// --- Lighting
+uniform vec3 light_pos;
+uniform vec3 camera_pos;
+
+// --- Shadows (see shadow_map_lit_pass.frag)
+uniform int   shadow_cascade_count;
+uniform mat4  shadow_cascade_matrices[4];
+uniform float shadow_cascade_splits[4];
+uniform bool  use_shadow_moments;
+
+// --- Fog
+uniform vec3 fog_color;
+
+// --- Atmospheric scattering
+uniform float scattering_density;
+uniform vec3  rayleigh_color;
+uniform vec3  mie_color;
+uniform float fog_strength;
+uniform float fog_scattering_ratio;
+
+// --- Textures
+uniform sampler2D            texture_depth; // same resolution as the output
+uniform sampler2DArrayShadow texture_shadow_map;
+uniform sampler2DArray       texture_shadow_moments;
+
+// === Utility Functions
+
+// g controls forward/backward scattering: 0 = isotropic, 0.6 = forward-scattering
+float phase_mie(float cos_theta, float g)
+{
+  float g2 = g * g;
+  return (1.0 - g2) / pow(1.0 + g2 - 2.0 * g * cos_theta, 1.5);
+}
+
+float phase_rayleigh(float cos_theta)
+{
+  return 3.0 / (16.0 * 3.1415926535) * (1.0 + cos_theta * cos_theta);
+}
+
+// shadow of a point of the volume, one fetch, no normal offset (see
+// calculate_shadow in shadow_map_lit_pass.frag)
+float calculate_volume_shadow(vec3 pos)
+{
+  float view_depth = -(view * vec4(pos, 1.0)).z;
+  int   cascade = 0;
+
+  while (cascade < shadow_cascade_count &&
+         view_depth > shadow_cascade_splits[cascade])
+    cascade++;
+
+  for (; cascade < shadow_cascade_count; ++cascade)
+  {
+    vec4 p = shadow_cascade_matrices[cascade] * vec4(pos, 1.0);
+    vec3 proj_coords = p.xyz / p.w * 0.5 + 0.5;
+
+    // outside, e.g. a cascade drawn at an earlier frame
+    if (any(lessThan(proj_coords.xy, vec2(0.0))) ||
+        any(greaterThan(proj_coords.xy, vec2(1.0))))
+      continue;
+
+    if (proj_coords.z > 1.0)
+      return 0.0;
+
+    if (use_shadow_moments)
+    {
+      vec2 m = texture(texture_shadow_moments, vec3(proj_coords.xy, float(cascade))).rg;
+
+      if (proj_coords.z <= m.x)
+        return 0.0;
+
+      float variance = max(m.y - m.x * m.x, 1e-6);
+      float d = proj_coords.z - m.x;
+      float p_max = variance / (variance + d * d);
+
+      return 1.0 - clamp((p_max - 0.2) / 0.8, 0.0, 1.0);
+    }
+
+    return 1.0 - texture(texture_shadow_map,
+                         vec4(proj_coords.xy, float(cascade), proj_coords.z - 5e-4));
+  }
+
+  return 0.0;
+}
+
+// === Main
+
+void main()
+{
+  float depth_sample = texelFetch(texture_depth, ivec2(gl_FragCoord.xy), 0).r;
+
+  // nothing drawn
+  if (depth_sample >= 1.0)
+  {
+    frag_color = vec4(0.0);
+    return;
+  }
+
+  // world position of the pixel
+  vec4 p = inv_view_projection * vec4(vec3(frag_uv, depth_sample) * 2.0 - 1.0, 1.0);
+  vec3 frag_pos = p.xyz / p.w;
+
+  int   num_steps = 32;
+  vec3  light_color = vec3(1.0, 1.0, 1.0);
+  float hg_g = 0.7;
+
+  vec3 light_dir = normalize(light_pos - frag_pos);
+
+  // Ray direction (from camera to fragment)
+  vec3  ray_dir = normalize(frag_pos - camera_pos);
+  float ray_length = length(frag_pos - camera_pos);
+
+  // Ray-march from camera → fragment, steps jittered per pixel
+  // (interleaved gradient noise), trading banding for noise
+  float step_size = ray_length / float(num_steps);
+  vec3  step_vec = ray_dir * step_size;
+  float jitter = fract(52.9829189 *
+                       fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+
+  // the phase does not depend on the step
+  float cos_theta = dot(normalize(-light_dir), -ray_dir);
+  float pr = phase_rayleigh(cos_theta);
+  float pm = phase_mie(cos_theta, hg_g);
+
+  // soft cap for Mie scattering
+  pm = pm / (1.0 + pm);
+
+  // scale by densities (tweak or make altitude-dependent)
+  vec3 phase_color = rayleigh_color * pr + mie_color * pm;
+  vec3 scattering = vec3(0.0);
+
+  for (int i = 0; i < num_steps; i++)
+  {
+    vec3 sample_pos = camera_pos + (float(i) + jitter) * step_vec;
+
+    if (sample_pos.y < 0.0)
+      continue;
+
+    // simple exponential fog
+    float dist = (float(i) + jitter) * step_size;
+    float density = exp(-scattering_density * dist) * step_size;
+
+    // Shadow test
+    float lit = calculate_volume_shadow(sample_pos);
+
+    scattering += density * light_color * phase_color * (1.0 - lit);
+  }
+
+  // fog color with scattering
+  vec3 fogged = mix(fog_color, scattering, fog_scattering_ratio);
+
+  frag_color = vec4(fogged, clamp(scattering_density * ray_length, 0.0, fog_strength));
+}
+)""
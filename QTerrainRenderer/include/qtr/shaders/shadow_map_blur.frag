@@ -0,0 +1,33 @@
+R""(
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#version 330 core
+
+in vec2 frag_uv;
+
+out vec2 moments;
+
+uniform sampler2DArray texture_source;
+uniform float          source_layer;
+uniform vec2           direction; // one texel along the blur axis
+uniform int            radius;    // in texels
+
+void main()
+{
+  // one axis of a separable gaussian blur
+  float sigma = max(0.5 * float(radius), 0.5);
+  vec2  sum = vec2(0.0);
+  float sum_w = 0.0;
+
+  for (int k = -radius; k <= radius; ++k)
+  {
+    float w = exp(-0.5 * float(k * k) / (sigma * sigma));
+    vec3  uv = vec3(frag_uv + float(k) * direction, source_layer);
+
+    sum += w * texture(texture_source, uv).rg;
+    sum_w += w;
+  }
+
+  moments = sum / sum_w;
+}
+)""
@@ -8,12 +8,15 @@ layout(location = 3) in vec3 instance_pos;
 layout(location = 4) in float instance_scale;
 layout(location = 5) in float instance_rot;
 layout(location = 6) in vec3 instance_color;
+layout(location = 7) in float compact_height; // normalized in [hmin, hmax]
 
 uniform mat4 light_space_matrix;
 uniform mat4 model;
 
 uniform bool has_instances;
 
+// terrain uniforms and functions, see terrain_vertex.glsl
+
 mat4 translate(mat4 m, vec3 v)
 {
   mat4 t = mat4(1.0);
@@ -65,6 +68,14 @@ void main()
     model_m = scale(model_m, vec3(instance_scale));
   }
 
-  gl_Position = light_space_matrix * model_m * vec4(pos, 1.0);
+  vec3 p = pos;
+
+  if (implicit_grid || compact_vertex)
+    p = terrain_grid_position(gl_VertexID, compact_height);
+
+  if (cdlod)
+    p = cdlod_position(cdlod_texel(gl_VertexID, model_m));
+
+  gl_Position = light_space_matrix * model_m * vec4(p, 1.0);
 }
 )""
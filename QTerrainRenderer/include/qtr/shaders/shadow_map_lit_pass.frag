@@ -8,7 +8,6 @@ R""(
 in vec3 frag_pos;
 in vec3 frag_normal;
 in vec2 frag_uv;
-in vec4 frag_pos_light_space;
 in vec3 frag_instance_color;
 
 out vec4 frag_color;
@@ -29,15 +28,17 @@ uniform float far_plane;
 uniform float scale_h;
 uniform float hmap_h0;
 uniform float hmap_h;
+uniform float hmap_w;
+uniform vec2  hmap_tex_decode; // see Texture::get_decode
 
 // --- Normal visualization
 uniform bool  normal_visualization;
 uniform float normal_map_scaling;
 
 // --- Matrices
+uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 light_space_matrix;
 
 // --- Lighting
 uniform vec3  light_pos;
@@ -49,11 +50,17 @@ uniform float spec_strength;
 // --- Shadows
 uniform bool  bypass_shadow_map;
 uniform float shadow_strength;
+uniform int   shadow_cascade_count;
+uniform mat4  shadow_cascade_matrices[4];    // see compute_shadow_cascades
+uniform float shadow_cascade_splits[4];      // view depth of the far end
+uniform float shadow_cascade_texel_sizes[4]; // world units
+uniform bool  use_horizon_map; // terrain shadows, see texture_horizon
+uniform bool  use_shadow_moments; // variance shadow map, see texture_shadow_moments
 
 // --- Ambient occlusion
 uniform bool  add_ambiant_occlusion;
 uniform float ambiant_occlusion_strength;
-uniform float ambiant_occlusion_radius;
+uniform float ambiant_occlusion_radius; // baked, see texture_ao
 
 // --- Texturing
 uniform bool use_texture_albedo;
@@ -67,12 +74,12 @@ uniform bool  add_water_foam;
 uniform vec3  foam_color;
 uniform float foam_depth;
 uniform bool  add_water_waves;
-uniform float angle_spread_ratio;
 uniform float waves_alpha;
 uniform float waves_kw;
 uniform float waves_amplitude;
 uniform float waves_normal_amplitude;
 uniform float waves_speed;
+uniform float waves_tile_cells; // wave cells per texture_waves tile
 
 // --- Fog
 uniform bool  add_fog;
@@ -81,12 +88,7 @@ uniform float fog_density;
 uniform float fog_height;
 
 // --- Atmospheric scattering
-uniform bool  add_atmospheric_scattering;
-uniform float scattering_density;
-uniform vec3  rayleigh_color;
-uniform vec3  mie_color;
-uniform float fog_strength;
-uniform float fog_scattering_ratio;
+uniform bool add_atmospheric_scattering; // see scattering.frag
 
 // --- Postprocessing
 uniform float gamma_correction;
@@ -96,8 +98,14 @@ uniform bool  apply_tonemap;
 uniform sampler2D texture_albedo;
 uniform sampler2D texture_hmap;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_shadow_map;
+uniform sampler2D texture_ao; // heightmap AO, see compute_heightmap_ao
+uniform sampler2DArray texture_horizon; // see compute_horizon_map
+uniform sampler2DArrayShadow texture_shadow_map; // one layer per cascade
+uniform sampler2DArray texture_shadow_moments; // blurred (z, z^2), same layers
 uniform sampler2D texture_depth;
+uniform sampler2D texture_scattering; // fog color and factor, depth resolution
+uniform sampler2DArray texture_waves; // see compute_wave_texture
+uniform sampler2D texture_flow; // shore flow, see compute_flow_texture
 
 // === Utility Functions
 
@@ -107,130 +115,168 @@ float orginal_input_elevation(float y)
   return y / scale_h / hmap_h - hmap_h0;
 }
 
-float calculate_shadow(vec4 frag_pos_light_space,
-                       vec3 light_dir,
-                       vec3 frag_normal,
-                       bool use_pcf)
+// unit disc, for the PCF taps
+const vec2 poisson_disc[12] = vec2[](vec2(-0.326, -0.406),
+                                     vec2(-0.840, -0.074),
+                                     vec2(-0.696, 0.457),
+                                     vec2(-0.203, 0.621),
+                                     vec2(0.962, -0.195),
+                                     vec2(0.473, -0.480),
+                                     vec2(0.519, 0.767),
+                                     vec2(0.185, -0.893),
+                                     vec2(0.507, 0.064),
+                                     vec2(0.896, 0.412),
+                                     vec2(-0.322, -0.933),
+                                     vec2(-0.792, -0.598));
+
+// shadow from the cascade 'cascade', -1 outside of its bounds
+float sample_shadow_cascade(int  cascade,
+                            vec3 pos,
+                            vec3 light_dir,
+                            vec3 frag_normal,
+                            bool use_pcf)
 {
+  // surfaces offset along their normal by a texel, against acne
+  if (use_pcf)
+    pos += frag_normal * 1.5 * shadow_cascade_texel_sizes[cascade];
+
+  vec4 frag_pos_light_space = shadow_cascade_matrices[cascade] * vec4(pos, 1.0);
+
   // Perspective divide
   vec3 proj_coords = frag_pos_light_space.xyz / frag_pos_light_space.w;
   proj_coords = proj_coords * 0.5 + 0.5; // [0,1] range
 
-  // Check if outside light frustum
+  // Check if outside light frustum, e.g. with a cascade drawn at an
+  // earlier frame (time slicing)
+  if (any(lessThan(proj_coords.xy, vec2(0.0))) ||
+      any(greaterThan(proj_coords.xy, vec2(1.0))))
+    return -1.0;
+
   if (proj_coords.z > 1.0)
     return 0.0;
 
-  if (!use_pcf)
+  float current_depth = proj_coords.z;
+
+  // variance shadow map, one filtered fetch (Chebyshev upper bound of
+  // the lit fraction)
+  if (use_shadow_moments)
   {
-    float closest_depth = texture(texture_shadow_map, proj_coords.xy).r;
-    float current_depth = proj_coords.z;
+    vec2 m = texture(texture_shadow_moments, vec3(proj_coords.xy, float(cascade))).rg;
+
+    if (current_depth <= m.x)
+      return 0.0;
 
+    float variance = max(m.y - m.x * m.x, 1e-6);
+    float d = current_depth - m.x;
+    float p_max = variance / (variance + d * d);
+
+    // light bleeding reduction, tails below 0.2 cut off
+    return 1.0 - clamp((p_max - 0.2) / 0.8, 0.0, 1.0);
+  }
+
+  // hardware comparisons, each fetch being a bilinear 2x2 PCF
+  if (!use_pcf)
+  {
     // Bias to prevent shadow acne
     float bias = max(0.001 * (1.0 - dot(frag_normal, light_dir)), 0.0001);
 
-    // Simple shadow (0 or 1)
-    return current_depth - bias > closest_depth ? 1.0 : 0.0;
+    return 1.0 - texture(texture_shadow_map,
+                         vec4(proj_coords.xy, float(cascade), current_depth - bias));
   }
   else // PCF
   {
-    float current_depth = proj_coords.z;
-
-    // locally tune bias
-    float bias_min = 1e-4f;
-    float bias_max = 1e-4f;
-    float bias_t = clamp(dot(frag_normal, light_dir), 0.0, 1.0); // in [0, 1]
-    float bias = mix(bias_max, bias_min, bias_t);
-
-    float shadow = 0.0;
-    vec2  texel_size = 1.0 / textureSize(texture_shadow_map, 0);
-
-    float sum = 0;
-    int   ir = 2;
-    for (int x = -ir; x <= ir; ++x)
-      for (int y = -ir; y <= ir; ++y)
-      {
-        float pcf_depth = texture(texture_shadow_map,
-                                  proj_coords.xy + vec2(x, y) * texel_size)
-                              .r;
-        float weight = 1.0 - length(vec2(x, y)) / (ir + 1);
-        shadow += weight * (current_depth - bias > pcf_depth ? 1.0 : 0.0);
-        sum += weight;
-      }
-    shadow /= sum;
+    float bias = 1e-4;
+    vec2  texel_size = 1.0 / vec2(textureSize(texture_shadow_map, 0).xy);
+
+    // disc rotated per pixel (interleaved gradient noise), trading
+    // banding for noise
+    float a = 6.28318530718 *
+              fract(52.9829189 *
+                    fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2  rot = mat2(cos(a), sin(a), -sin(a), cos(a));
+
+    float lit = 0.0;
+    for (int k = 0; k < 12; ++k)
+    {
+      vec2 uv = proj_coords.xy + 2.0 * rot * poisson_disc[k] * texel_size;
+      lit += texture(texture_shadow_map,
+                     vec4(uv, float(cascade), current_depth - bias));
+    }
 
-    return shadow;
+    return 1.0 - lit / 12.0;
   }
 }
 
-// g controls forward/backward scattering: 0 = isotropic, 0.6 = forward-scattering
-float phase_mie(float cos_theta, float g)
+float calculate_shadow(vec3 pos, vec3 light_dir, vec3 frag_normal, bool use_pcf)
 {
-  float g2 = g * g;
-  return (1.0 - g2) / pow(1.0 + g2 - 2.0 * g * cos_theta, 1.5);
-}
+  // first cascade containing the position, none beyond the last one
+  float view_depth = -(view * vec4(pos, 1.0)).z;
+  int   cascade = 0;
 
-float phase_rayleigh(float cos_theta)
-{
-  return 3.0 / (16.0 * 3.1415926535) * (1.0 + cos_theta * cos_theta);
-}
+  while (cascade < shadow_cascade_count &&
+         view_depth > shadow_cascade_splits[cascade])
+    cascade++;
 
-// horizonn-based ambiant occlusion
-float gain(float x, float factor)
-{
-  return x < 0.5 ? 0.5f * pow(2.f * x, factor)
-                 : 1.f - 0.5f * pow(2.f * (1.f - x), factor);
-}
+  float shadow = -1.0;
 
-float compute_hbao(vec2 uv, sampler2D hmap, int dir_count, int step_count, float radius)
-{
-  float h0 = texture(hmap, uv).r;
-  float occlusion = 0.0;
+  while (cascade < shadow_cascade_count && shadow < 0.0)
+    shadow = sample_shadow_cascade(cascade++, pos, light_dir, frag_normal, use_pcf);
 
-  ivec2 res = textureSize(hmap, 0);
-  vec2  texel_size = 1.0 / res;
+  if (shadow < 0.0)
+    return 0.0;
 
-  for (int d = 0; d < dir_count; d++)
+  // blended with the next cascade over the last tenth of the slice,
+  // hiding the seams between cascades (possibly drawn at different
+  // frames)
+  if (cascade < shadow_cascade_count)
   {
-    float dir_angle = 6.28318530718 * float(d) / float(dir_count);
-    vec2  dir = vec2(cos(dir_angle), sin(dir_angle));
-
-    float horizon = -3.14159265 * 0.5; // −π/2
-    float scale = 2.f;
+    float d0 = cascade > 1 ? shadow_cascade_splits[cascade - 2] : near_plane;
+    float d1 = shadow_cascade_splits[cascade - 1];
+    float t = smoothstep(mix(d0, d1, 0.9), d1, view_depth);
 
-    for (int s = 1; s <= step_count; s++)
+    if (t > 0.0)
     {
-      // float t = float(s) / float(step_count);     // 0..1
-
-      // logarithmic search along the ray
-      float lf = float(s) / float(step_count);
-      float t = (exp2(lf) - 1.0) / (2.0 - 1.0); // log stepping in [0..1]
+      float next = sample_shadow_cascade(cascade, pos, light_dir, frag_normal, use_pcf);
 
-      vec2 suv = clamp(uv + dir * t * radius, 0.0, 1.0);
+      if (next >= 0.0)
+        shadow = mix(shadow, next, t);
+    }
+  }
 
-      float hs = texture(hmap, suv).r;
+  return shadow;
+}
 
-      // work in a unit cube
-      float slope = scale * (hs - h0) / (t * radius); // rise/run
-      float angle = atan(slope);                      // angle in radians
+float calculate_horizon_shadow(vec3 frag_pos, vec3 light_dir)
+{
+  // model space, where the heightmap spans hmap_w along both uv axes
+  vec3 scale = vec3(model[0][0], model[1][1], model[2][2]);
+  vec3 l = light_dir / scale;
+  vec2 uv = (frag_pos / scale).xz / hmap_w + 0.5;
 
-      horizon = max(horizon, angle);
-    }
+  if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+    return 0.0;
 
-    // positive angles mean occlusion
-    occlusion += max(0.0, horizon);
-  }
+  // horizon toward the light azimuth, between the two nearest sectors
+  int   nsectors = 4 * textureSize(texture_horizon, 0).z;
+  float f = mod(atan(l.z, l.x) / 6.28318530718 * float(nsectors), float(nsectors));
 
-  // normalize AO to 0..1
-  // horizon is in [0 .. π/2], so divide by π/2
-  float ao = 1.0 - (occlusion / float(dir_count)) / (1.57079632679);
-  ao = clamp(ao, 0.0, 1.0);
+  int   s0 = int(f) % nsectors;
+  int   s1 = (s0 + 1) % nsectors;
+  float h0 = texture(texture_horizon, vec3(uv, float(s0 / 4)))[s0 % 4];
+  float h1 = texture(texture_horizon, vec3(uv, float(s1 / 4)))[s1 % 4];
+  float h = mix(h0, h1, fract(f));
 
-  ao = gain(ao, 3.f);
+  // stored as atan(slope) / (pi / 2), slope in input elevation per uv
+  float horizon = atan(tan(h * 1.57079632679) * hmap_h / hmap_w);
+  float sun = atan(l.y, length(l.xz));
 
-  // ao = smoothstep(0.0, 1.0, ao);
-  ao = 1.f - ambiant_occlusion_strength + ao * ambiant_occlusion_strength;
+  return 1.0 - smoothstep(horizon - 0.02, horizon + 0.02, sun);
+}
 
-  return ao;
+// heightmap texture sample to elevation (16-bit normalized textures)
+float hmap_decode(float v)
+{
+  return v * hmap_tex_decode.x + hmap_tex_decode.y;
 }
 
 // https://www.shadertoy.com/view/WdjSW3
@@ -264,59 +310,21 @@ float sigmoid(float x, float width, float x0)
   return v;
 }
 
-float hash(vec3 p) { return fract(sin(dot(p, vec3(127.1, 311.7, 74.7))) * 43758.5453); }
-
-// 2D -> 2D hash (deterministic, cheap, no trig)
-vec2 hash22f(vec2 p, float seed)
-{
-  // fold the seed in; any small non-zero scaling works
-  p += seed;
-
-  // magic constants picked for good bit diffusion
-  const vec3 k = vec3(0.1031, 0.11369, 0.13787);
-
-  vec3 q = fract(vec3(p.x, p.y, p.x) * k);
-  q += dot(q, q.yzx + 19.19);
-
-  // return two reasonably independent components in [0,1)
-  return fract(vec2(q.x * q.y, q.z * q.x));
-}
-
-// Gabor-like wavelet sum (scalar output)
-float gabor_wave_scalar(vec2 p, vec2 dir, float angle_spread_ratio, float fseed)
+// baked Gabor-like wavelet sum (scalar output), between the two nearest
+// baked directions
+float wave_scalar(vec2 p, vec2 dir)
 {
-  vec2 ip = floor(p);
-  vec2 fp = p - ip; // fractional part of p
-
-  const float fr = 6.28318530718; // 2*pi
-  const float fa = 4.0;           // gaussian falloff factor
-
-  float av = 0.0;
-  float at = 0.0;
-
-  // 5x5 neighborhood
-  for (int j = -2; j <= 2; ++j)
-    for (int i = -2; i <= 2; ++i)
-    {
-      vec2 o = vec2(i, j);
-
-      // jitter the feature point inside the cell
-      vec2 h = hash22f(ip + o, fseed);
-      vec2 r = fp - (o + h);
+  int   ndirs = 4 * textureSize(texture_waves, 0).z;
+  float f = mod(atan(dir.y, dir.x) / 6.28318530718 * float(ndirs), float(ndirs));
+  vec2  uv = p / waves_tile_cells;
 
-      // vary direction per-cell around 'dir'
-      vec2 k = normalize(dir + angle_spread_ratio * (2.0 * hash22f(ip + o, fseed) - 1.0));
+  // both fetched, mipmapped lookups are not allowed in non-uniform branches
+  int   s0 = int(f) % ndirs;
+  int   s1 = (s0 + 1) % ndirs;
+  float v0 = texture(texture_waves, vec3(uv, float(s0 / 4)))[s0 % 4];
+  float v1 = texture(texture_waves, vec3(uv, float(s1 / 4)))[s1 % 4];
 
-      float d = dot(r, r);
-      float l = dot(r, k);
-      float w = exp(-fa * d); // gaussian window
-      float cs = cos(fr * l); // carrier
-
-      av += w * cs;
-      at += w;
-    }
-
-  return av / max(at, 1e-6); // safe normalize
+  return 2.0 * mix(v0, v1, fract(f)) - 1.0;
 }
 
 float linearize_depth(float depth_sample)
@@ -325,10 +333,33 @@ float linearize_depth(float depth_sample)
   return (2.0 * near_plane) / (far_plane + near_plane - z * (far_plane - near_plane));
 }
 
-float phase_hg(float cos_theta, float g)
+// bilateral upsampling of the scattering buffer, the 4 nearest texels
+// weighted by their depth similarity to the fragment (the depth
+// texture having the same resolution)
+vec4 upsample_scattering()
 {
-  float denom = 1.0 + g * g - 2.0 * g * cos_theta;
-  return (1.0 - g * g) / (4.0 * 3.14159265 * pow(denom, 1.5));
+  ivec2 size = textureSize(texture_scattering, 0);
+  vec2  p = gl_FragCoord.xy / screen_size * vec2(size) - 0.5;
+  ivec2 ij = ivec2(floor(p));
+  vec2  f = p - vec2(ij);
+  float z = linearize_depth(gl_FragCoord.z);
+
+  vec4  sum = vec4(0.0);
+  float sum_w = 0.0;
+
+  for (int k = 0; k < 4; ++k)
+  {
+    ivec2 o = ivec2(k & 1, k >> 1);
+    ivec2 q = clamp(ij + o, ivec2(0), size - 1);
+    float zq = linearize_depth(texelFetch(texture_depth, q, 0).r);
+    vec2  b = mix(1.0 - f, f, vec2(o));
+    float w = b.x * b.y / (1e-3 + abs(zq - z) / z);
+
+    sum += w * texelFetch(texture_scattering, q, 0);
+    sum_w += w;
+  }
+
+  return sum / max(sum_w, 1e-6);
 }
 
 // === Main
@@ -387,33 +418,25 @@ void main()
 
   if (use_water_colors)
   {
-    float h = texture(texture_hmap, frag_uv).r;
+    float h = hmap_decode(texture(texture_hmap, frag_uv).r);
     float depth = orginal_input_elevation(frag_pos.y) - h;
 
     if (add_water_waves)
     {
       // mix between the main uniform direction and the direction given by the local
-      // terrain gradient
-      vec2 dir = vec2(cos(waves_alpha), sin(waves_alpha));
-
-      float eps = 0.5 / textureSize(texture_hmap, 0).x;
-      float dhdx = (texture(texture_hmap, frag_uv + vec2(eps, 0.0)).r - h) / eps;
-      float dhdy = (texture(texture_hmap, frag_uv + vec2(0.0, eps)).r - h) / eps;
-
-      vec2 dir_slope = vec2(0.f, 0.f);
-      vec2 diff = vec2(dhdx, dhdy);
-      if (length(diff) > 1e-6f)
-        dir_slope = normalize(diff);
-
+      // terrain gradient (baked, not fetched offshore)
+      vec2  dir = vec2(cos(waves_alpha), sin(waves_alpha));
       float attenuation = exp(-depth / (2.0 * water_color_depth));
-      dir = mix(dir, dir_slope, attenuation);
+
+      if (attenuation > 1e-3)
+      {
+        vec4 flow = texture(texture_flow, frag_uv);
+        vec2 dir_slope = flow.b > 0.5 ? 2.0 * flow.rg - 1.0 : vec2(0.f, 0.f);
+        dir = mix(dir, dir_slope, attenuation);
+      }
 
       // change color only on the shore
-      float fseed = 0.f;
-      float gw = gabor_wave_scalar(waves_kw * frag_uv - waves_speed * time * dir,
-                                   dir,
-                                   angle_spread_ratio,
-                                   fseed);
+      float gw = wave_scalar(waves_kw * frag_uv - waves_speed * time * dir, dir);
       depth += waves_amplitude * (0.5 * gw + 0.5) * attenuation;
 
       normal.xz += waves_normal_amplitude * gw * dir * (1.0 - attenuation);
@@ -462,9 +485,15 @@ void main()
   float spec = spec_strength * pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
 
   // Shadow factor
+  // with the horizon map, the shadow map only has the instances
   float shadow = 0.0;
   if (!bypass_shadow_map)
-    shadow = calculate_shadow(frag_pos_light_space, light_dir, normal, true);
+  {
+    shadow = calculate_shadow(frag_pos, light_dir, norm, true);
+
+    if (use_horizon_map)
+      shadow = max(shadow, calculate_horizon_shadow(frag_pos, light_dir));
+  }
 
   spec *= (1.0 - shadow);
 
@@ -482,7 +511,8 @@ void main()
 
     if (add_ambiant_occlusion)
     {
-      float ao = compute_hbao(frag_uv, texture_hmap, 16, 8, ambiant_occlusion_radius);
+      float ao = texture(texture_ao, frag_uv).r;
+      ao = 1.0 - ambiant_occlusion_strength + ao * ambiant_occlusion_strength;
       result *= pow(ao, 0.5f);
     }
 
@@ -513,71 +543,9 @@ void main()
 
   if (add_atmospheric_scattering)
   {
-    int   num_steps = 32;
-    vec3  light_color = vec3(1.0, 1.0, 1.0);
-    float hg_g = 0.7;
-    float rayleigh_height = 0.4;
-    float mie_height = 0.1;
-
-    // Ray direction (from camera to fragment)
-    vec3  ray_dir = normalize(frag_pos - camera_pos);
-    float ray_length = length(frag_pos - camera_pos);
-
-    // Ray-march from camera → fragment
-    float step_size = ray_length / float(num_steps);
-    vec3  step_vec = ray_dir * step_size;
-
-    vec3 sample_pos = camera_pos;
-    vec3 scattering = vec3(0.0);
-
-    for (int i = 0; i < num_steps; i++)
-    {
-      sample_pos += step_vec;
-
-      if (sample_pos.y < 0.0)
-        continue;
-
-      // simple exponential fog
-      float dist = length(sample_pos - camera_pos);
-      float density = exp(-scattering_density * dist) * step_size;
-      density *= (0.8 + 0.2 * hash(sample_pos * 0.1));
-
-      // Shadow test
-      vec4  light_space_pos = light_space_matrix * vec4(sample_pos, 1.0);
-      float lit = calculate_shadow(light_space_pos, light_dir, normal, false);
-
-      // In-scattering from directional light
-      float cos_theta = dot(normalize(-light_dir), -ray_dir);
-      float phase = phase_hg(cos_theta, hg_g);
-
-      float pr = phase_rayleigh(cos_theta);
-      float pm = phase_mie(cos_theta, hg_g);
-
-      // soft cap for Mie scattering
-      pm = pm / (1.0 + pm);
-
-      if (false)
-      {
-        float rayleigh_factor = exp(-sample_pos.y / rayleigh_height);
-        float mie_factor = exp(-sample_pos.y / mie_height);
-
-        pr *= rayleigh_factor;
-        pm *= mie_factor;
-      }
-
-      // scale by densities (tweak or make altitude-dependent)
-      vec3 phase_color = rayleigh_color * pr + mie_color * pm;
-
-      // float phase = max(dot(normalize(light_dir), -ray_dir), 0.0); // simple isotropic
-      scattering += density * light_color * phase_color * (1.0 - lit);
-    }
-
-    // fog color with scattering
-    vec3 fogged = mix(fog_color, scattering, fog_scattering_ratio);
+    vec4 fogged = upsample_scattering();
 
-    frag_color.xyz = mix(frag_color.xyz,
-                         fogged,
-                         clamp(scattering_density * ray_length, 0.0, fog_strength));
+    frag_color.xyz = mix(frag_color.xyz, fogged.rgb, fogged.a);
   }
 
   if (apply_tonemap)
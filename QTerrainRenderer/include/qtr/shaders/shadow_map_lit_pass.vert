@@ -14,11 +14,12 @@ layout(location = 3) in vec3 instance_pos;
 layout(location = 4) in float instance_scale;
 layout(location = 5) in float instance_rot;
 layout(location = 6) in vec3 instance_color;
+layout(location = 7) in float compact_height; // normalized in [hmin, hmax]
+layout(location = 8) in vec2 compact_normal;  // octahedral
 
 out vec3 frag_pos;
 out vec3 frag_normal;
 out vec2 frag_uv;
-out vec4 frag_pos_light_space;
 out vec3 frag_instance_color;
 
 // ============================================================================
@@ -28,10 +29,11 @@ out vec3 frag_instance_color;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 light_space_matrix;
 
 uniform bool has_instances;
 
+// terrain uniforms and functions, see terrain_vertex.glsl
+
 // ============================================================================
 // Utility Functions
 // ============================================================================
@@ -93,11 +95,21 @@ void main()
     model_m = scale(model_m, vec3(instance_scale));
   }
 
-  frag_pos = vec3(model_m * vec4(pos, 1.0));
-  frag_normal = mat3(transpose(inverse(model_m))) * normal;
-  frag_uv = uv;
+  vec3 p = pos;
+  vec3 n = normal;
+  vec2 t = uv;
+
+  if (implicit_grid)
+    implicit_grid_vertex(gl_VertexID, p, n, t);
+  else if (compact_vertex)
+    compact_terrain_vertex(gl_VertexID, compact_height, compact_normal, p, n, t);
+  else if (cdlod)
+    cdlod_vertex(gl_VertexID, model_m, p, n, t);
+
+  frag_pos = vec3(model_m * vec4(p, 1.0));
+  frag_normal = mat3(transpose(inverse(model_m))) * n;
+  frag_uv = t;
 
-  frag_pos_light_space = light_space_matrix * vec4(frag_pos, 1.0);
   gl_Position = projection * view * vec4(frag_pos, 1.0);
 }
 )""
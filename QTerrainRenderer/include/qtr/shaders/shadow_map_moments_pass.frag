@@ -0,0 +1,21 @@
+R""(
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#version 330 core
+
+// variance shadow map, vertices from shadow_map_depth_pass.vert
+
+out vec2 moments;
+
+void main()
+{
+  float z = gl_FragCoord.z; // linear, orthographic light projection
+
+  // second moment widened by the depth slope over the texel, against
+  // self-shadowing once filtered
+  float dx = dFdx(z);
+  float dy = dFdy(z);
+
+  moments = vec2(z, z * z + 0.25 * (dx * dx + dy * dy));
+}
+)""
@@ -0,0 +1,228 @@
+R""(
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+
+// terrain vertex reconstruction shared by the vertex shaders, inserted
+// after their '#version' line (see add_terrain_vertex_code)
+
+// implicit grid, terrain vertices rebuilt from the heightmap texture
+uniform bool      implicit_grid;
+uniform sampler2D texture_hmap;
+uniform float     hmap_h0;
+uniform float     hmap_h;
+uniform float     hmap_w;
+uniform float     hmap_hmin;
+uniform vec2      hmap_tex_decode; // see Texture::get_decode
+
+// compact terrain vertices (TerrainVertex), same vertex numbering as
+// the implicit grid, grid size from the heightmap texture
+uniform bool  compact_vertex;
+uniform float hmap_hmax;
+
+// CDLOD, shared patch grid placed and morphed per quadtree node
+uniform bool  cdlod;
+uniform int   cdlod_patch_size;  // quads per patch side
+uniform vec2  cdlod_node_offset; // in texels
+uniform float cdlod_node_scale;  // texels per patch quad
+uniform vec2  cdlod_morph;       // morph start / end distances to the eye
+uniform vec3  cdlod_eye;         // world space
+
+// heightmap texture sample to elevation (16-bit normalized textures)
+float hmap_decode(float v)
+{
+  return v * hmap_tex_decode.x + hmap_tex_decode.y;
+}
+
+// heightmap texel, elevation as in the input data
+float hmap_texel(ivec2 ij)
+{
+  return hmap_decode(texelFetch(texture_hmap, ij, 0).r);
+}
+
+// compact vertex height, normalized in [hmin, hmax], to elevation
+float compact_height_decode(float v)
+{
+  return mix(hmap_hmin, hmap_hmax, v);
+}
+
+// octahedral normal decoding (y up)
+vec3 decode_octahedral(vec2 e)
+{
+  vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+
+  if (n.y < 0.0)
+    n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+
+  return normalize(n);
+}
+
+// texel of the grid vertex 'id'. Ids from width * height are skirt
+// vertices, numbered edge by edge (left, right, top, bottom) as in
+// generate_heightmap_implicit_grid
+ivec2 grid_texel(int id, ivec2 size, out bool skirt, out vec3 skirt_normal)
+{
+  int count = size.x * size.y;
+
+  skirt = id >= count;
+
+  if (!skirt)
+    return ivec2(id % size.x, id / size.x);
+
+  int e = id - count;
+
+  if (e < size.y)
+  {
+    skirt_normal = vec3(-1.0, 0.0, 0.0);
+    return ivec2(0, e);
+  }
+  else if (e < 2 * size.y)
+  {
+    skirt_normal = vec3(1.0, 0.0, 0.0);
+    return ivec2(size.x - 1, e - size.y);
+  }
+  else if (e < 2 * size.y + size.x)
+  {
+    skirt_normal = vec3(0.0, 0.0, -1.0);
+    return ivec2(e - 2 * size.y, 0);
+  }
+  else
+  {
+    skirt_normal = vec3(0.0, 0.0, 1.0);
+    return ivec2(e - 2 * size.y - size.x, size.y - 1);
+  }
+}
+
+vec3 grid_position(ivec2 ij, ivec2 size, float h)
+{
+  vec2 d = vec2(hmap_w) / vec2(size - 1);
+
+  return vec3(-0.5 * hmap_w + float(ij.x) * d.x,
+              hmap_h0 + h * hmap_h,
+              -0.5 * hmap_w + float(ij.y) * d.y);
+}
+
+// position of the implicit grid or compact vertex 'id', 'height' is
+// the compact vertex attribute (unused for the implicit grid)
+vec3 terrain_grid_position(int id, float height)
+{
+  ivec2 size = textureSize(texture_hmap, 0);
+  bool  skirt;
+  vec3  skirt_normal;
+  ivec2 ij = grid_texel(id, size, skirt, skirt_normal);
+  float h;
+
+  if (skirt)
+    h = hmap_hmin;
+  else if (implicit_grid)
+    h = hmap_texel(ij);
+  else
+    h = compact_height_decode(height);
+
+  return grid_position(ij, size, h);
+}
+
+// position, normal and uv of the implicit grid vertex 'id'
+void implicit_grid_vertex(int id, out vec3 p, out vec3 n, out vec2 t)
+{
+  ivec2 size = textureSize(texture_hmap, 0);
+  bool  skirt;
+  ivec2 ij = grid_texel(id, size, skirt, n);
+  vec2  d = vec2(hmap_w) / vec2(size - 1);
+
+  p = grid_position(ij, size, skirt ? hmap_hmin : hmap_texel(ij));
+  t = vec2(ij) / vec2(size - 1);
+
+  if (!skirt)
+  {
+    // central differences, one-sided at the borders
+    ivec2 i0 = max(ij - 1, ivec2(0));
+    ivec2 i1 = min(ij + 1, size - 1);
+
+    float dhdx = (hmap_texel(ivec2(i1.x, ij.y)) - hmap_texel(ivec2(i0.x, ij.y))) /
+                 (float(i1.x - i0.x) * d.x);
+    float dhdz = (hmap_texel(ivec2(ij.x, i1.y)) - hmap_texel(ivec2(ij.x, i0.y))) /
+                 (float(i1.y - i0.y) * d.y);
+
+    n = normalize(vec3(-dhdx * hmap_h, 1.0, -dhdz * hmap_h));
+  }
+}
+
+// position, normal and uv of the compact terrain vertex 'id', from its
+// 'height' and octahedral 'normal' attributes
+void compact_terrain_vertex(int      id,
+                            float    height,
+                            vec2     normal,
+                            out vec3 p,
+                            out vec3 n,
+                            out vec2 t)
+{
+  ivec2 size = textureSize(texture_hmap, 0);
+  bool  skirt;
+  ivec2 ij = grid_texel(id, size, skirt, n);
+  float h = skirt ? hmap_hmin : compact_height_decode(height);
+
+  p = grid_position(ij, size, h);
+  t = vec2(ij) / vec2(size - 1);
+
+  if (!skirt)
+    n = decode_octahedral(normal);
+}
+
+// bilinear heightmap lookup, 'ij' in texels
+float hmap_sample(vec2 ij)
+{
+  return hmap_decode(
+      texture(texture_hmap, (ij + 0.5) / vec2(textureSize(texture_hmap, 0))).r);
+}
+
+vec3 cdlod_position(vec2 ij)
+{
+  vec2 d = vec2(hmap_w) / vec2(textureSize(texture_hmap, 0) - 1);
+
+  return vec3(-0.5 * hmap_w + ij.x * d.x,
+              hmap_h0 + hmap_sample(ij) * hmap_h,
+              -0.5 * hmap_w + ij.y * d.y);
+}
+
+// texel coordinates of the CDLOD patch vertex 'id', morphed towards
+// the parent level grid (odd vertices slide onto even ones) as the
+// distance to the eye gets close to the node LOD range
+vec2 cdlod_texel(int id, mat4 model_m)
+{
+  vec2 size = vec2(textureSize(texture_hmap, 0));
+  vec2 grid = vec2(id % (cdlod_patch_size + 1), id / (cdlod_patch_size + 1));
+  vec2 ij = min(cdlod_node_offset + grid * cdlod_node_scale, size - 1.0);
+
+  vec3  p = vec3(model_m * vec4(cdlod_position(ij), 1.0));
+  float k = clamp((distance(p, cdlod_eye) - cdlod_morph.x) /
+                      (cdlod_morph.y - cdlod_morph.x),
+                  0.0,
+                  1.0);
+
+  grid -= fract(grid * 0.5) * 2.0 * k;
+
+  return min(cdlod_node_offset + grid * cdlod_node_scale, size - 1.0);
+}
+
+void cdlod_vertex(int id, mat4 model_m, out vec3 p, out vec3 n, out vec2 t)
+{
+  vec2 size = vec2(textureSize(texture_hmap, 0));
+  vec2 d = vec2(hmap_w) / (size - 1.0);
+  vec2 ij = cdlod_texel(id, model_m);
+
+  p = cdlod_position(ij);
+  t = ij / (size - 1.0);
+
+  // central differences over one texel, as the other terrain modes,
+  // so that shading does not change with the LOD level
+  vec2 i0 = max(ij - 1.0, vec2(0.0));
+  vec2 i1 = min(ij + 1.0, size - 1.0);
+
+  float dhdx = (hmap_sample(vec2(i1.x, ij.y)) - hmap_sample(vec2(i0.x, ij.y))) /
+               ((i1.x - i0.x) * d.x);
+  float dhdz = (hmap_sample(vec2(ij.x, i1.y)) - hmap_sample(vec2(ij.x, i0.y))) /
+               ((i1.y - i0.y) * d.y);
+
+  n = normalize(vec3(-dhdx * hmap_h, 1.0, -dhdz * hmap_h));
+}
+)""
@@ -39,6 +39,7 @@ uniform int  cmap;
 // --- Textures
 uniform sampler2D texture_albedo;
 uniform sampler2D texture_hmap;
+uniform vec2      hmap_tex_decode; // see Texture::get_decode
 uniform sampler2D texture_normal;
 uniform sampler2D texture_shadow_map;
 uniform sampler2D texture_depth;
@@ -47,6 +48,12 @@ uniform sampler2D texture_depth;
 // Utility Functions
 // ============================================================================
 
+// heightmap texture sample to elevation (16-bit normalized textures)
+float hmap_decode(float v)
+{
+  return v * hmap_tex_decode.x + hmap_tex_decode.y;
+}
+
 float hillshade(vec3 normal)
 {
   vec3 n = normalize(normal);
@@ -139,7 +146,7 @@ void main()
 
   // colormap
   {
-    float h = texture(texture_hmap, frag_uv).x;
+    float h = hmap_decode(texture(texture_hmap, frag_uv).x);
 
     if (cmap == 0)
       color = vec3(h);
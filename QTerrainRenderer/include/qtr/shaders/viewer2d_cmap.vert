@@ -14,6 +14,8 @@ layout(location = 3) in vec3 instance_pos;
 layout(location = 4) in float instance_scale;
 layout(location = 5) in float instance_rot;
 layout(location = 6) in vec3 instance_color;
+layout(location = 7) in float compact_height; // normalized in [hmin, hmax]
+layout(location = 8) in vec2 compact_normal;  // octahedral
 
 out vec3 frag_pos;
 out vec3 frag_normal;
@@ -30,6 +32,8 @@ uniform float zoom;
 
 uniform bool has_instances;
 
+// terrain uniforms and functions, see terrain_vertex.glsl
+
 // ============================================================================
 // Utility Functions
 // ============================================================================
@@ -91,15 +95,26 @@ void main()
     model_m = scale(model_m, vec3(instance_scale));
   }
 
-  vec4 world = model_m * vec4(pos, 1.0);
+  vec3 p = pos;
+  vec3 n = normal;
+  vec2 t = uv;
+
+  if (implicit_grid)
+    implicit_grid_vertex(gl_VertexID, p, n, t);
+  else if (compact_vertex)
+    compact_terrain_vertex(gl_VertexID, compact_height, compact_normal, p, n, t);
+  else if (cdlod)
+    cdlod_vertex(gl_VertexID, model_m, p, n, t);
+
+  vec4 world = model_m * vec4(p, 1.0);
 
   // top view: X stays X, Z becomes Y, flatten Y
 
   // TODO profile view option
 
   frag_pos = vec3(zoom * world.x / aspect_ratio, zoom * world.z, 0.0);
-  frag_normal = mat3(transpose(inverse(model_m))) * normal;
-  frag_uv = uv;
+  frag_normal = mat3(transpose(inverse(model_m))) * n;
+  frag_uv = t;
 
   gl_Position = vec4(frag_pos, 1.0);
 }
@@ -0,0 +1,49 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "qtr/camera.hpp"
+
+#define QTR_MAX_SHADOW_CASCADES 4 // see shadow_map_lit_pass.frag
+
+namespace qtr
+{
+
+struct ShadowCascade
+{
+  glm::mat4 light_space_matrix;
+  float     split_far;    // view depth of the slice far end
+  float     texel_size;   // world units
+  glm::vec3 center;       // light view space
+  float     radius;       // half extent of the drawn bounds
+  float     slice_radius; // bounding sphere of the slice, within 'radius'
+};
+
+// Cascades of a directional light fitted to 'count' slices of the
+// camera frustum, from the camera near plane to 'max_distance'. Split
+// depths blend logarithmic and uniform splits ('split_lambda' = 1:
+// logarithmic). Each slice is bounded by a sphere, and its center
+// snapped to the shadow map texels, so that the cascades do not
+// shimmer when the camera moves. The bounds are 'margin' times the
+// sphere, for the cascades to be reused while the camera moves (see
+// shadow_cascade_contains). Depths extend toward the light to the
+// scene bounding sphere (centered at the origin) to keep the casters
+// in front of the slices
+std::vector<ShadowCascade> compute_shadow_cascades(const Camera    &camera,
+                                                   float            aspect_ratio,
+                                                   float            max_distance,
+                                                   const glm::vec3 &light_dir,
+                                                   float            scene_radius,
+                                                   int              count,
+                                                   int              resolution,
+                                                   float            split_lambda = 0.75f,
+                                                   float            margin = 1.25f);
+
+// whether a cascade drawn earlier, for the same light direction, still
+// holds the slice of 'fitted' without wasting too much resolution
+bool shadow_cascade_contains(const ShadowCascade &drawn, const ShadowCascade &fitted);
+
+} // namespace qtr
@@ -5,27 +5,95 @@
 
 #include <QOpenGLFunctions_3_3_Core>
 
+#include <glm/glm.hpp>
+
+#include "qtr/raster.hpp"
 #include "qtr/shader.hpp"
 
 namespace qtr
 {
 
+// storage of the float textures (from_float_vector)
+enum TexturePrecision : int
+{
+  PRECISION_UNORM16, // GL_R16, values remapped from their [min, max] range
+  PRECISION_HALF,    // GL_R16F
+  PRECISION_FLOAT    // GL_R32F
+};
+
 class Texture : protected QOpenGLFunctions_3_3_Core
 {
 public:
   Texture();
   ~Texture();
 
-  bool from_float_vector(const std::vector<float> &data, int new_width);
+  bool from_float_vector(const std::vector<float> &data,
+                         int                       new_width,
+                         TexturePrecision          new_precision = PRECISION_FLOAT);
   bool from_image_8bit_grayscale(const std::vector<uint8_t> &img, int new_width);
   bool from_image_8bit_rgb(const std::vector<uint8_t> &img, int new_width);
   bool from_image_8bit_rgba(const std::vector<uint8_t> &img, int new_width);
   bool from_image_16bit_grayscale(const std::vector<uint16_t> &img, int new_width);
+
+  // GL_TEXTURE_2D_ARRAY of 'new_nlayers' RGBA8 layers, layer after layer
+  // in 'data' (e.g. compute_horizon_map), repeated and mipmapped if
+  // 'tileable' (e.g. compute_wave_texture)
+  bool from_layers_rgba8(const std::vector<uint8_t> &data,
+                         int                         new_width,
+                         int                         new_height,
+                         int                         new_nlayers,
+                         bool                        tileable = false);
+
+  // uploaded as is, without conversion, in the matching format (e.g.
+  // GL_R16 for single-channel uint16, GL_RGBA16F for 4-channel half)
+  bool from_raster(const RasterView &data);
+
+  // GL_RG32F mip chain, nearest filtering, 'levels' having the OpenGL
+  // mipmap sizes from 'new_width' x 'new_height' (e.g. HeightPyramid)
+  bool from_vec2_levels(const std::vector<std::vector<glm::vec2>> &levels,
+                        int                                        new_width,
+                        int                                        new_height);
+  // GL_RGBA16F render target, nearest filtering (e.g. scattering buffer)
+  void generate_color_texture(int new_width, int new_height);
   void generate_depth_texture(int new_width, int new_height, bool force_border_color);
 
-  GLuint get_id() const;
-  int    get_width() const;
-  int    get_height() const;
+  // GL_TEXTURE_2D_ARRAY of 'new_nlayers' depth layers (e.g. shadow
+  // cascades). With 'compare_mode', sampled through a shadow sampler
+  // (sampler2DArrayShadow), the comparison being bilinearly filtered
+  void generate_depth_texture_array(int  new_width,
+                                    int  new_height,
+                                    int  new_nlayers,
+                                    bool force_border_color,
+                                    bool compare_mode = false);
+
+  // GL_TEXTURE_2D_ARRAY of 'new_nlayers' GL_RG32F layers, linear
+  // filtering, border (1, 1) (e.g. shadow map moments)
+  void generate_moments_texture_array(int new_width, int new_height, int new_nlayers);
+
+  // re-upload the region [x, x + w) x [y, y + h) of a float texture,
+  // 'data' being the whole image. False if the region could not be
+  // updated (with PRECISION_UNORM16, values out of the texture range),
+  // the texture must then be uploaded again
+  bool update_region(const std::vector<float> &data, int x, int y, int w, int h);
+
+  // same for the mip 'level' of a from_vec2_levels texture, 'data'
+  // being the whole level
+  void update_level_region(int                           level,
+                           const std::vector<glm::vec2> &data,
+                           int                           x,
+                           int                           y,
+                           int                           w,
+                           int                           h);
+
+  GLuint           get_id() const;
+  int              get_width() const;
+  int              get_height() const;
+  int              get_layer_count() const; // 1 except for arrays
+  TexturePrecision get_precision() const;
+
+  // sampled value to data value: value = sample * scale + offset,
+  // returned as (scale, offset), identity except for PRECISION_UNORM16
+  glm::vec2 get_decode() const;
 
   void bind(int unit = 0);
   void bind_and_set(QOpenGLShaderProgram &shader, const std::string &tex_id, int unit);
@@ -34,9 +102,13 @@ public:
   bool is_active() const;
 
 private:
-  GLuint id;
-  int    width;
-  int    height;
+  GLuint           id;
+  GLenum           target = GL_TEXTURE_2D;
+  int              width;
+  int              height;
+  int              nlayers = 1;
+  TexturePrecision precision = PRECISION_FLOAT;
+  glm::vec2        decode = glm::vec2(1.f, 0.f);
 };
 
 } // namespace qtr
\ No newline at end of file
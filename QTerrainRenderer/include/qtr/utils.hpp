@@ -38,6 +38,15 @@ std::vector<float> load_png_as_grayscale(const std::string &path,
                                          int               &width,
                                          int               &height);
 
+// bounding rectangles (x0, y0, x1, y1), upper bounds excluded, of the
+// differences between two width x height arrays, at a 'block_size'
+// granularity (changed blocks are merged by connected components)
+std::vector<glm::ivec4> find_changed_regions(const std::vector<float> &a,
+                                             const std::vector<float> &b,
+                                             int                       width,
+                                             int                       height,
+                                             int                       block_size = 64);
+
 } // namespace qtr
 
 // --- Specialized serialization
@@ -0,0 +1,35 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace qtr
+{
+
+// Tileable Gabor-like wavelet noise of the water waves, for 'ndirs'
+// wave directions (a multiple of 4, direction s toward the uv direction
+// (cos, sin)(2 pi s / ndirs)), each texel summing the wavelets of its 5x5
+// neighborhood of cells (per cell jittered feature point and wave
+// vector spread by 'angle_spread_ratio'). A tile spans 'tile_cells'
+// cells, the cell indices being wrapped so that it repeats seamlessly.
+//
+// 'waves' receives ndirs / 4 layers of resolution x resolution RGBA8
+// texels, direction s in the channel s % 4 of layer s / 4: the wave
+// value in [-1, 1] remapped to [0, 1]
+void compute_wave_texture(std::vector<uint8_t> &waves,
+                          int                   resolution,
+                          int                   tile_cells,
+                          float                 angle_spread_ratio,
+                          int                   ndirs = 8);
+
+// Slope direction of a heightmap, toward which the waves turn on the
+// shores: width x height RGBA8 texels, rg the normalized gradient (in
+// uv units) remapped to [0, 1], b 255 where the gradient is defined (0
+// on flat areas)
+void compute_flow_texture(std::vector<uint8_t>     &flow,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height);
+
+} // namespace qtr
@@ -0,0 +1,77 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtr/async_worker.hpp"
+
+namespace qtr
+{
+
+AsyncWorker::~AsyncWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+    this->pending_task = nullptr;
+    this->generation++;
+  }
+  this->cv.notify_one();
+
+  if (this->thread.joinable())
+    this->thread.join();
+}
+
+void AsyncWorker::cancel()
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->pending_task = nullptr;
+  this->generation++;
+}
+
+bool AsyncWorker::is_cancelled(uint64_t task_generation) const
+{
+  return task_generation != this->generation.load();
+}
+
+uint64_t AsyncWorker::submit(Task task)
+{
+  uint64_t task_generation;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    task_generation = ++this->generation;
+    this->pending_task = std::move(task);
+    this->pending_generation = task_generation;
+
+    if (!this->thread.joinable())
+      this->thread = std::thread(&AsyncWorker::run, this);
+  }
+  this->cv.notify_one();
+
+  return task_generation;
+}
+
+void AsyncWorker::run()
+{
+  while (true)
+  {
+    Task     task;
+    uint64_t task_generation;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->cv.wait(lock, [this]() { return this->stop || this->pending_task; });
+
+      if (this->stop)
+        return;
+
+      task = std::move(this->pending_task);
+      task_generation = this->pending_generation;
+      this->pending_task = nullptr;
+    }
+
+    if (!this->is_cancelled(task_generation))
+      task(task_generation);
+  }
+}
+
+} // namespace qtr
@@ -0,0 +1,384 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <cfloat>
+
+#include "qtr/cdlod.hpp"
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+struct CDLODQuadtree::SelectionContext
+{
+  glm::mat4               model;
+  Frustum                 frustum;
+  glm::vec3               eye;
+  float                   y;
+  float                   lx;
+  float                   ly;
+  std::vector<CDLODNode> *p_nodes;
+};
+
+// world space bounding box of a model space box
+static BoundingBox transform_bbox(const BoundingBox &bbox, const glm::mat4 &model)
+{
+  BoundingBox out;
+  out.min = glm::vec3(FLT_MAX);
+  out.max = glm::vec3(-FLT_MAX);
+
+  for (int c = 0; c < 8; ++c)
+  {
+    glm::vec3 p(c & 1 ? bbox.max.x : bbox.min.x,
+                c & 2 ? bbox.max.y : bbox.min.y,
+                c & 4 ? bbox.max.z : bbox.min.z);
+    glm::vec3 q = glm::vec3(model * glm::vec4(p, 1.f));
+
+    out.min = glm::min(out.min, q);
+    out.max = glm::max(out.max, q);
+  }
+
+  return out;
+}
+
+static bool sphere_intersects(const BoundingBox &bbox, const glm::vec3 &c, float radius)
+{
+  glm::vec3 d = c - glm::clamp(c, bbox.min, bbox.max);
+  return glm::dot(d, d) <= radius * radius;
+}
+
+void CDLODQuadtree::build(const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          int                       patch_size)
+{
+  this->clear();
+
+  if (width < 2 || height < 2 || (int)data.size() < width * height)
+    return;
+
+  this->width = width;
+  this->height = height;
+  this->patch_size = std::max(2, patch_size & ~1); // even, for the quadrants
+
+  // levels, up to a single root node
+  for (int size = this->patch_size;; size *= 2)
+  {
+    glm::ivec2 shape((width - 2) / size + 1, (height - 2) / size + 1);
+    this->level_shapes.push_back(shape);
+
+    if (shape.x == 1 && shape.y == 1)
+      break;
+  }
+
+  const int nlevels = this->get_level_count();
+  this->level_minmax.resize(nlevels);
+
+  // leaves, from the data
+  {
+    const glm::ivec2 shape = this->level_shapes[0];
+
+    std::vector<glm::vec2> &minmax = this->level_minmax[0];
+    minmax.resize(shape.x * shape.y);
+
+    parallel_for(
+        0,
+        shape.y,
+        [&](int b0, int b1)
+        {
+          for (int b = b0; b < b1; ++b)
+            for (int a = 0; a < shape.x; ++a)
+              minmax[b * shape.x + a] = this->compute_leaf_minmax(data, a, b);
+        });
+  }
+
+  // upper levels, from the children
+  for (int l = 1; l < nlevels; ++l)
+  {
+    const glm::ivec2 shape = this->level_shapes[l];
+
+    this->level_minmax[l].resize(shape.x * shape.y);
+    this->update_parent_minmax(l, 0, 0, shape.x, shape.y);
+  }
+
+  // shared patch, indices grouped by quadrant so that partially
+  // selected nodes draw contiguous sub-ranges
+  const int n = this->patch_size;
+  const int nh = n / 2;
+
+  std::vector<uint> indices;
+  indices.reserve(6 * n * n);
+
+  for (int q = 0; q < 4; ++q)
+  {
+    int qi = (q & 1) * nh;
+    int qj = (q >> 1) * nh;
+
+    for (int j = qj; j < qj + nh; ++j)
+      for (int i = qi; i < qi + nh; ++i)
+      {
+        uint v00 = j * (n + 1) + i;
+        uint v10 = v00 + 1;
+        uint v01 = v00 + n + 1;
+        uint v11 = v01 + 1;
+
+        indices.insert(indices.end(), {v00, v01, v10, v10, v01, v11});
+      }
+  }
+
+  this->patch.create_attributeless(indices);
+
+  qtr::Logger::log()->trace("CDLODQuadtree::build: {} levels, patch size {}",
+                            nlevels,
+                            this->patch_size);
+}
+
+void CDLODQuadtree::clear()
+{
+  this->width = 0;
+  this->height = 0;
+  this->level_shapes.clear();
+  this->level_minmax.clear();
+  this->patch.destroy();
+}
+
+glm::vec2 CDLODQuadtree::compute_leaf_minmax(const std::vector<float> &data,
+                                             int                       a,
+                                             int                       b) const
+{
+  const int size = this->patch_size;
+  const int i1 = std::min((a + 1) * size, this->width - 1);
+  const int j1 = std::min((b + 1) * size, this->height - 1);
+
+  glm::vec2 mm(FLT_MAX, -FLT_MAX);
+
+  for (int j = b * size; j <= j1; ++j)
+    for (int i = a * size; i <= i1; ++i)
+    {
+      float v = data[j * this->width + i];
+      mm.x = std::min(mm.x, v);
+      mm.y = std::max(mm.y, v);
+    }
+
+  return mm;
+}
+
+void CDLODQuadtree::draw_patch(int quadrants)
+{
+  const size_t count = this->patch.get_index_count() / 4;
+
+  if (quadrants == 0xF)
+  {
+    this->patch.draw();
+    return;
+  }
+
+  // merge consecutive quadrants into a single draw
+  for (int q = 0; q < 4;)
+  {
+    if (!(quadrants & (1 << q)))
+    {
+      q++;
+      continue;
+    }
+
+    int q1 = q;
+    while (q1 < 4 && (quadrants & (1 << q1)))
+      q1++;
+
+    this->patch.draw(q * count, (q1 - q) * count);
+    q = q1;
+  }
+}
+
+int CDLODQuadtree::get_level_count() const { return (int)this->level_shapes.size(); }
+
+float CDLODQuadtree::get_morph_end(int level) const { return this->ranges[level]; }
+
+float CDLODQuadtree::get_morph_start(int level) const
+{
+  return this->morph_starts[level];
+}
+
+int CDLODQuadtree::get_patch_size() const { return this->patch_size; }
+
+bool CDLODQuadtree::is_active() const
+{
+  return this->patch.is_active() && !this->level_shapes.empty();
+}
+
+void CDLODQuadtree::update_parent_minmax(int level, int a0, int b0, int a1, int b1)
+{
+  const glm::ivec2 shape = this->level_shapes[level];
+  const glm::ivec2 child_shape = this->level_shapes[level - 1];
+
+  for (int b = b0; b < b1; ++b)
+    for (int a = a0; a < a1; ++a)
+    {
+      glm::vec2 mm(FLT_MAX, -FLT_MAX);
+
+      for (int db = 0; db < 2; ++db)
+        for (int da = 0; da < 2; ++da)
+        {
+          int ca = 2 * a + da;
+          int cb = 2 * b + db;
+
+          if (ca < child_shape.x && cb < child_shape.y)
+          {
+            const glm::vec2 &c = this->level_minmax[level - 1][cb * child_shape.x + ca];
+            mm.x = std::min(mm.x, c.x);
+            mm.y = std::max(mm.y, c.y);
+          }
+        }
+
+      this->level_minmax[level][b * shape.x + a] = mm;
+    }
+}
+
+void CDLODQuadtree::update_region(const std::vector<float> &data,
+                                  int                       i0,
+                                  int                       j0,
+                                  int                       i1,
+                                  int                       j1)
+{
+  if (!this->is_active() || (int)data.size() < this->width * this->height)
+    return;
+
+  // leaves share their border texels with their neighbors
+  const glm::ivec2 shape = this->level_shapes[0];
+  const int        size = this->patch_size;
+
+  int a0 = std::max(i0 - 1, 0) / size;
+  int b0 = std::max(j0 - 1, 0) / size;
+  int a1 = std::min((i1 - 1) / size, shape.x - 1) + 1;
+  int b1 = std::min((j1 - 1) / size, shape.y - 1) + 1;
+
+  for (int b = b0; b < b1; ++b)
+    for (int a = a0; a < a1; ++a)
+      this->level_minmax[0][b * shape.x + a] = this->compute_leaf_minmax(data, a, b);
+
+  for (int l = 1; l < this->get_level_count(); ++l)
+  {
+    a0 /= 2;
+    b0 /= 2;
+    a1 = (a1 - 1) / 2 + 1;
+    b1 = (b1 - 1) / 2 + 1;
+
+    this->update_parent_minmax(l, a0, b0, a1, b1);
+  }
+}
+
+bool CDLODQuadtree::select_node(const SelectionContext &ctx,
+                                int                     level,
+                                int                     a,
+                                int                     b) const
+{
+  const glm::ivec2 shape = this->level_shapes[level];
+  const glm::vec2  mm = this->level_minmax[level][b * shape.x + a];
+  const int        size = this->patch_size << level;
+  const int        i0 = a * size;
+  const int        j0 = b * size;
+  const int        i1 = std::min(i0 + size, this->width - 1);
+  const int        j1 = std::min(j0 + size, this->height - 1);
+
+  const float dx = ctx.lx / (float)(this->width - 1);
+  const float dz = ctx.lx / (float)(this->height - 1);
+
+  BoundingBox bbox;
+  bbox.min = glm::vec3(-0.5f * ctx.lx + i0 * dx,
+                       ctx.y + mm.x * ctx.ly,
+                       -0.5f * ctx.lx + j0 * dz);
+  bbox.max = glm::vec3(-0.5f * ctx.lx + i1 * dx,
+                       ctx.y + mm.y * ctx.ly,
+                       -0.5f * ctx.lx + j1 * dz);
+
+  const BoundingBox world_bbox = transform_bbox(bbox, ctx.model);
+
+  // out of this level range, to be covered by the parent (the root
+  // level covers everything)
+  if (level < this->get_level_count() - 1 &&
+      !sphere_intersects(world_bbox, ctx.eye, this->ranges[level]))
+    return false;
+
+  // culled, but nothing left for the parent to draw
+  if (!ctx.frustum.intersects(bbox))
+    return true;
+
+  int quadrants = 0;
+
+  if (level == 0 || !sphere_intersects(world_bbox, ctx.eye, this->ranges[level - 1]))
+  {
+    quadrants = 0xF;
+  }
+  else
+  {
+    const glm::ivec2 child_shape = this->level_shapes[level - 1];
+
+    for (int q = 0; q < 4; ++q)
+    {
+      int ca = 2 * a + (q & 1);
+      int cb = 2 * b + (q >> 1);
+
+      if (ca < child_shape.x && cb < child_shape.y &&
+          !this->select_node(ctx, level - 1, ca, cb))
+        quadrants |= 1 << q;
+    }
+  }
+
+  if (quadrants)
+    ctx.p_nodes->push_back({i0, j0, size, level, quadrants});
+
+  return true;
+}
+
+void CDLODQuadtree::select(std::vector<CDLODNode> &nodes,
+                           const glm::mat4        &model,
+                           const Frustum          &frustum,
+                           const glm::vec3        &eye,
+                           float                   y,
+                           float                   lx,
+                           float                   ly) const
+{
+  nodes.clear();
+
+  if (!this->is_active() || (int)this->ranges.size() != this->get_level_count())
+    return;
+
+  const SelectionContext ctx = {model, frustum, eye, y, lx, ly, &nodes};
+  const int              top = this->get_level_count() - 1;
+
+  for (int b = 0; b < this->level_shapes[top].y; ++b)
+    for (int a = 0; a < this->level_shapes[top].x; ++a)
+      this->select_node(ctx, top, a, b);
+}
+
+void CDLODQuadtree::set_lod_ranges(float lod_distance, float morph_ratio)
+{
+  const int nlevels = this->get_level_count();
+
+  this->ranges.resize(nlevels);
+  this->morph_starts.resize(nlevels);
+
+  float range = lod_distance;
+  float prev_range = 0.f;
+
+  for (int l = 0; l < nlevels; ++l)
+  {
+    this->ranges[l] = range;
+    this->morph_starts[l] = prev_range + (1.f - morph_ratio) * (range - prev_range);
+
+    prev_range = range;
+    range *= 2.f;
+  }
+
+  // the root level covers everything (see select_node) and never
+  // morphs, with finite distances (the library uses -ffast-math)
+  if (nlevels)
+  {
+    this->ranges[nlevels - 1] = 2e30f;
+    this->morph_starts[nlevels - 1] = 1e30f;
+  }
+}
+
+} // namespace qtr
@@ -0,0 +1,55 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <set>
+
+#include "qtr/frame_graph.hpp"
+
+namespace qtr
+{
+
+void FrameGraph::add_pass(const std::string              &name,
+                          const std::vector<std::string> &reads,
+                          const std::vector<std::string> &writes,
+                          std::function<void()>           fct)
+{
+  this->passes.push_back({name, reads, writes, false});
+  this->fcts.push_back(std::move(fct));
+}
+
+void FrameGraph::clear()
+{
+  this->passes.clear();
+  this->fcts.clear();
+}
+
+void FrameGraph::cull(const std::vector<std::string> &outputs)
+{
+  // backward, the resources needed grow with the reads of each pass
+  // kept
+  std::set<std::string> needed(outputs.begin(), outputs.end());
+
+  for (auto it = this->passes.rbegin(); it != this->passes.rend(); ++it)
+  {
+    it->culled = std::none_of(it->writes.begin(),
+                              it->writes.end(),
+                              [&needed](const std::string &s)
+                              { return needed.contains(s); });
+
+    if (!it->culled)
+      needed.insert(it->reads.begin(), it->reads.end());
+  }
+}
+
+void FrameGraph::execute(const std::vector<std::string> &outputs)
+{
+  this->cull(outputs);
+
+  for (size_t k = 0; k < this->passes.size(); ++k)
+    if (!this->passes[k].culled && this->fcts[k])
+      this->fcts[k]();
+}
+
+const std::vector<FramePass> &FrameGraph::get_passes() const { return this->passes; }
+
+} // namespace qtr
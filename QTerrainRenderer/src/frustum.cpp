@@ -0,0 +1,43 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtr/frustum.hpp"
+
+namespace qtr
+{
+
+Frustum::Frustum() { this->planes.fill(glm::vec4(0.f, 0.f, 0.f, 1.f)); }
+
+Frustum::Frustum(const glm::mat4 &clip)
+{
+  // glm is column-major, clip[c][r]
+  glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+  glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+  glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+  glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+  this->planes[0] = row3 + row0; // left
+  this->planes[1] = row3 - row0; // right
+  this->planes[2] = row3 + row1; // bottom
+  this->planes[3] = row3 - row1; // top
+  this->planes[4] = row3 + row2; // near
+  this->planes[5] = row3 - row2; // far
+}
+
+bool Frustum::intersects(const BoundingBox &bbox) const
+{
+  // conservative test: rejected only if the box corner farthest along
+  // the plane normal is outside one of the planes
+  for (const glm::vec4 &p : this->planes)
+  {
+    glm::vec3 v(p.x >= 0.f ? bbox.max.x : bbox.min.x,
+                p.y >= 0.f ? bbox.max.y : bbox.min.y,
+                p.z >= 0.f ? bbox.max.z : bbox.min.z);
+
+    if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.f)
+      return false;
+  }
+
+  return true;
+}
+
+} // namespace qtr
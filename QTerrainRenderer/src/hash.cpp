@@ -0,0 +1,142 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+#include "qtr/hash.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+constexpr uint64_t xxh_prime_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t xxh_prime_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t xxh_prime_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t xxh_prime_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t xxh_prime_5 = 0x27D4EB2F165667C5ULL;
+
+// chunks of the parallel hash, inputs below 'hash_parallel_size' are
+// hashed in one go
+constexpr size_t hash_chunk_size = 1 << 20;
+constexpr size_t hash_parallel_size = 4 * hash_chunk_size;
+
+// unaligned little-endian reads
+static uint64_t read_u64(const uint8_t *p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+  acc += input * xxh_prime_2;
+  acc = std::rotl(acc, 31);
+  return acc * xxh_prime_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t value)
+{
+  acc ^= xxh64_round(0, value);
+  return acc * xxh_prime_1 + xxh_prime_4;
+}
+
+uint64_t xxh64(const void *p_data, size_t size, uint64_t seed)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(p_data);
+  const uint8_t *p_end = p + size;
+  uint64_t       h;
+
+  if (size >= 32)
+  {
+    uint64_t v1 = seed + xxh_prime_1 + xxh_prime_2;
+    uint64_t v2 = seed + xxh_prime_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - xxh_prime_1;
+
+    for (; p + 32 <= p_end; p += 32)
+    {
+      v1 = xxh64_round(v1, read_u64(p));
+      v2 = xxh64_round(v2, read_u64(p + 8));
+      v3 = xxh64_round(v3, read_u64(p + 16));
+      v4 = xxh64_round(v4, read_u64(p + 24));
+    }
+
+    h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+    h = xxh64_merge_round(h, v1);
+    h = xxh64_merge_round(h, v2);
+    h = xxh64_merge_round(h, v3);
+    h = xxh64_merge_round(h, v4);
+  }
+  else
+    h = seed + xxh_prime_5;
+
+  h += (uint64_t)size;
+
+  // tail
+  for (; p + 8 <= p_end; p += 8)
+  {
+    h ^= xxh64_round(0, read_u64(p));
+    h = std::rotl(h, 27) * xxh_prime_1 + xxh_prime_4;
+  }
+
+  if (p + 4 <= p_end)
+  {
+    h ^= (uint64_t)read_u32(p) * xxh_prime_1;
+    h = std::rotl(h, 23) * xxh_prime_2 + xxh_prime_3;
+    p += 4;
+  }
+
+  for (; p < p_end; ++p)
+  {
+    h ^= (uint64_t)(*p) * xxh_prime_5;
+    h = std::rotl(h, 11) * xxh_prime_1;
+  }
+
+  // avalanche
+  h ^= h >> 33;
+  h *= xxh_prime_2;
+  h ^= h >> 29;
+  h *= xxh_prime_3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+uint64_t hash_bytes(const void *p_data, size_t size, uint64_t seed)
+{
+  if (size < hash_parallel_size)
+    return xxh64(p_data, size, seed);
+
+  const uint8_t *p = static_cast<const uint8_t *>(p_data);
+  const int      nchunks = (int)((size + hash_chunk_size - 1) / hash_chunk_size);
+
+  std::vector<uint64_t> chunk_hashes(nchunks);
+
+  parallel_for(0,
+               nchunks,
+               [&](int c0, int c1)
+               {
+                 for (int c = c0; c < c1; ++c)
+                 {
+                   const size_t offset = (size_t)c * hash_chunk_size;
+
+                   chunk_hashes[c] = xxh64(p + offset,
+                                           std::min(hash_chunk_size, size - offset),
+                                           seed);
+                 }
+               });
+
+  return xxh64(chunk_hashes.data(), nchunks * sizeof(uint64_t), seed ^ size);
+}
+
+} // namespace qtr
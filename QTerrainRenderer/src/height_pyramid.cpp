@@ -0,0 +1,254 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+
+#include "qtr/height_pyramid.hpp"
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+// below, cells are computed by the calling thread only
+constexpr size_t pyramid_parallel_cells = 1 << 16;
+
+static int get_cell_nthreads(const glm::ivec4 &rect)
+{
+  const size_t ncells = (size_t)(rect.z - rect.x) * (rect.w - rect.y);
+  return ncells < pyramid_parallel_cells ? 1 : 0;
+}
+
+void HeightPyramid::build(const std::vector<float> &data, int width, int height)
+{
+  this->clear();
+
+  if (width < 2 || height < 2 || (int)data.size() < width * height)
+    return;
+
+  this->width = width;
+  this->height = height;
+
+  // levels, down to a single cell
+  for (glm::ivec2 shape(width - 1, height - 1);;
+       shape = glm::max(shape / 2, glm::ivec2(1)))
+  {
+    this->level_shapes.push_back(shape);
+    this->levels.emplace_back((size_t)shape.x * shape.y);
+
+    if (shape.x == 1 && shape.y == 1)
+      break;
+  }
+
+  const glm::ivec2 shape0 = this->level_shapes[0];
+  this->compute_base_cells(data, glm::ivec4(0, 0, shape0.x, shape0.y));
+
+  for (int l = 1; l < this->get_level_count(); ++l)
+  {
+    const glm::ivec2 shape = this->level_shapes[l];
+    this->compute_parent_cells(l, glm::ivec4(0, 0, shape.x, shape.y));
+  }
+
+  qtr::Logger::log()->trace("HeightPyramid::build: {} x {}, {} levels",
+                            width,
+                            height,
+                            this->get_level_count());
+}
+
+void HeightPyramid::clear()
+{
+  this->width = 0;
+  this->height = 0;
+  this->level_shapes.clear();
+  this->levels.clear();
+}
+
+void HeightPyramid::compute_base_cells(const std::vector<float> &data,
+                                       const glm::ivec4         &rect)
+{
+  const int nx = this->level_shapes[0].x;
+
+  std::vector<glm::vec2> &cells = this->levels[0];
+
+  parallel_for(
+      rect.y,
+      rect.w,
+      [&](int b0, int b1)
+      {
+        for (int b = b0; b < b1; ++b)
+        {
+          const float *p_row0 = data.data() + (size_t)b * this->width;
+          const float *p_row1 = p_row0 + this->width;
+
+          for (int a = rect.x; a < rect.z; ++a)
+          {
+            const float v00 = p_row0[a];
+            const float v10 = p_row0[a + 1];
+            const float v01 = p_row1[a];
+            const float v11 = p_row1[a + 1];
+
+            cells[(size_t)b * nx + a] = glm::vec2(
+                std::min(std::min(v00, v10), std::min(v01, v11)),
+                std::max(std::max(v00, v10), std::max(v01, v11)));
+          }
+        }
+      },
+      get_cell_nthreads(rect));
+}
+
+void HeightPyramid::compute_parent_cells(int level, const glm::ivec4 &rect)
+{
+  const glm::ivec2 shape = this->level_shapes[level];
+  const glm::ivec2 child_shape = this->level_shapes[level - 1];
+
+  const std::vector<glm::vec2> &children = this->levels[level - 1];
+  std::vector<glm::vec2>       &cells = this->levels[level];
+
+  parallel_for(
+      rect.y,
+      rect.w,
+      [&](int b0, int b1)
+      {
+        for (int b = b0; b < b1; ++b)
+        {
+          // the last row (column) also takes the odd child left
+          const int cb1 = b == shape.y - 1 ? child_shape.y : 2 * b + 2;
+
+          for (int a = rect.x; a < rect.z; ++a)
+          {
+            const int ca1 = a == shape.x - 1 ? child_shape.x : 2 * a + 2;
+
+            glm::vec2 mm(FLT_MAX, -FLT_MAX);
+
+            for (int cb = 2 * b; cb < cb1; ++cb)
+              for (int ca = 2 * a; ca < ca1; ++ca)
+              {
+                const glm::vec2 &c = children[(size_t)cb * child_shape.x + ca];
+                mm.x = std::min(mm.x, c.x);
+                mm.y = std::max(mm.y, c.y);
+              }
+
+            cells[(size_t)b * shape.x + a] = mm;
+          }
+        }
+      },
+      get_cell_nthreads(rect));
+}
+
+int HeightPyramid::get_height() const { return this->height; }
+
+const std::vector<glm::vec2> &HeightPyramid::get_level(int level) const
+{
+  return this->levels[level];
+}
+
+const std::vector<std::vector<glm::vec2>> &HeightPyramid::get_levels() const
+{
+  return this->levels;
+}
+
+int HeightPyramid::get_level_count() const { return (int)this->level_shapes.size(); }
+
+glm::ivec2 HeightPyramid::get_level_shape(int level) const
+{
+  return this->level_shapes[level];
+}
+
+glm::vec2 HeightPyramid::get_minmax(int level, int a, int b) const
+{
+  return this->levels[level][(size_t)b * this->level_shapes[level].x + a];
+}
+
+glm::ivec4 HeightPyramid::get_parent_rect(int level, const glm::ivec4 &child_rect) const
+{
+  const glm::ivec2 shape = this->level_shapes[level];
+
+  return glm::ivec4(std::min(child_rect.x >> 1, shape.x - 1),
+                    std::min(child_rect.y >> 1, shape.y - 1),
+                    std::min((child_rect.z - 1) >> 1, shape.x - 1) + 1,
+                    std::min((child_rect.w - 1) >> 1, shape.y - 1) + 1);
+}
+
+int HeightPyramid::get_width() const { return this->width; }
+
+bool HeightPyramid::is_empty() const { return this->levels.empty(); }
+
+glm::vec2 HeightPyramid::query(int i0, int j0, int i1, int j1) const
+{
+  if (this->is_empty())
+    return glm::vec2(0.f);
+
+  // quads over the texels, a texel alone is bounded by the quad it is
+  // the origin of (or the last one)
+  const glm::ivec2 shape0 = this->level_shapes[0];
+
+  const int a0 = std::clamp(std::min(i0, i1), 0, shape0.x - 1);
+  const int b0 = std::clamp(std::min(j0, j1), 0, shape0.y - 1);
+  const int a1 = std::clamp(std::max(i0, i1) - 1, a0, shape0.x - 1);
+  const int b1 = std::clamp(std::max(j0, j1) - 1, b0, shape0.y - 1);
+
+  // level where the range spans at most 3 x 3 cells
+  const int extent = std::max(a1 - a0, b1 - b0);
+  const int level = std::min(extent > 0 ? (int)std::bit_width((unsigned)extent) - 1 : 0,
+                             this->get_level_count() - 1);
+
+  const glm::ivec2 shape = this->level_shapes[level];
+  const int        ca0 = std::min(a0 >> level, shape.x - 1);
+  const int        cb0 = std::min(b0 >> level, shape.y - 1);
+  const int        ca1 = std::min(a1 >> level, shape.x - 1);
+  const int        cb1 = std::min(b1 >> level, shape.y - 1);
+
+  glm::vec2 mm(FLT_MAX, -FLT_MAX);
+
+  for (int b = cb0; b <= cb1; ++b)
+    for (int a = ca0; a <= ca1; ++a)
+    {
+      const glm::vec2 c = this->get_minmax(level, a, b);
+      mm.x = std::min(mm.x, c.x);
+      mm.y = std::max(mm.y, c.y);
+    }
+
+  return mm;
+}
+
+void HeightPyramid::update_region(const std::vector<float> &data,
+                                  int                       i0,
+                                  int                       j0,
+                                  int                       i1,
+                                  int                       j1,
+                                  std::vector<glm::ivec4>  *p_level_rects)
+{
+  if (p_level_rects)
+    p_level_rects->clear();
+
+  if (this->is_empty() || (int)data.size() != this->width * this->height)
+    return;
+
+  // quads sharing a texel of the region
+  const glm::ivec2 shape0 = this->level_shapes[0];
+
+  glm::ivec4 rect(std::max(i0 - 1, 0),
+                  std::max(j0 - 1, 0),
+                  std::min(i1, shape0.x),
+                  std::min(j1, shape0.y));
+
+  if (rect.x >= rect.z || rect.y >= rect.w)
+    return;
+
+  this->compute_base_cells(data, rect);
+
+  if (p_level_rects)
+    p_level_rects->push_back(rect);
+
+  for (int l = 1; l < this->get_level_count(); ++l)
+  {
+    rect = this->get_parent_rect(l, rect);
+    this->compute_parent_cells(l, rect);
+
+    if (p_level_rects)
+      p_level_rects->push_back(rect);
+  }
+}
+
+} // namespace qtr
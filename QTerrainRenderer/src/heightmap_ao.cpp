@@ -0,0 +1,219 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "qtr/heightmap_ao.hpp"
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+constexpr int   ao_dir_count = 16;
+constexpr int   ao_step_count = 8;
+constexpr float ao_slope_scale = 2.f; // elevations in a unit cube
+
+// horizon sample along a direction, in texels
+struct AOStep
+{
+  float dx;
+  float dy;
+  float slope_factor; // scale / run
+};
+
+static float gain(float x, float factor)
+{
+  return x < 0.5f ? 0.5f * std::pow(2.f * x, factor)
+                  : 1.f - 0.5f * std::pow(2.f * (1.f - x), factor);
+}
+
+// bilinear samples at (i + dx, j + dy) for i in [i0, i1), positions
+// clamped to the heightmap. 'dx' is the same for the whole row, so are
+// the interpolation weights away from the borders: the interior is a
+// fixed weighted sum of neighbours, branchless so that it vectorizes
+static void sample_row(const float *p_data,
+                       int          width,
+                       int          height,
+                       int          j,
+                       float        dx,
+                       float        dy,
+                       int          i0,
+                       int          i1,
+                       float       *p_out)
+{
+  const float  y = std::clamp(j + dy, 0.f, height - 1.f);
+  const int    y0 = std::min((int)y, height - 2);
+  const float  fy = y - y0;
+  const float *p_row0 = p_data + (size_t)y0 * width;
+  const float *p_row1 = p_row0 + width;
+
+  // clamped positions, near the borders
+  auto sample_clamped = [&](int i)
+  {
+    const float x = std::clamp(i + dx, 0.f, width - 1.f);
+    const int   x0 = std::min((int)x, width - 2);
+    const float fx = x - x0;
+
+    const float v0 = p_row0[x0] + fx * (p_row0[x0 + 1] - p_row0[x0]);
+    const float v1 = p_row1[x0] + fx * (p_row1[x0 + 1] - p_row1[x0]);
+    return v0 + fy * (v1 - v0);
+  };
+
+  // interior, x0 = i + shift in [0, width - 2]
+  const int   shift = (int)std::floor(dx);
+  const float fx = dx - shift;
+  const int   ia = std::clamp(-shift, i0, i1);
+  const int   ib = std::clamp(width - 1 - shift, ia, i1);
+
+  const float w00 = (1.f - fx) * (1.f - fy);
+  const float w10 = fx * (1.f - fy);
+  const float w01 = (1.f - fx) * fy;
+  const float w11 = fx * fy;
+
+  for (int i = i0; i < ia; ++i)
+    p_out[i - i0] = sample_clamped(i);
+
+  const float *p_a = p_row0 + shift;
+  const float *p_b = p_row1 + shift;
+
+  for (int i = ia; i < ib; ++i)
+    p_out[i - i0] = w00 * p_a[i] + w10 * p_a[i + 1] + w01 * p_b[i] + w11 * p_b[i + 1];
+
+  for (int i = ib; i < i1; ++i)
+    p_out[i - i0] = sample_clamped(i);
+}
+
+void compute_heightmap_ao(std::vector<float>       &ao,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          float                     radius,
+                          int                       i0,
+                          int                       j0,
+                          int                       i1,
+                          int                       j1)
+{
+  if (width < 2 || height < 2 || (int)data.size() != width * height)
+    return;
+
+  if ((int)ao.size() != width * height)
+    ao.assign((size_t)width * height, 1.f);
+
+  i0 = std::max(i0, 0);
+  j0 = std::max(j0, 0);
+  i1 = std::min(i1, width);
+  j1 = std::min(j1, height);
+
+  if (i0 >= i1 || j0 >= j1)
+    return;
+
+  // no occlusion, rather than keeping a previous bake
+  if (radius <= 0.f)
+  {
+    for (int j = j0; j < j1; ++j)
+      std::fill(ao.begin() + (size_t)j * width + i0,
+                ao.begin() + (size_t)j * width + i1,
+                1.f);
+    return;
+  }
+
+  // sample offsets, radius in uv units as the texel positions of the
+  // mesh vertices
+  std::array<AOStep, ao_dir_count * ao_step_count> steps;
+
+  for (int d = 0; d < ao_dir_count; ++d)
+  {
+    const float alpha = 6.28318530718f * d / ao_dir_count;
+
+    for (int s = 1; s <= ao_step_count; ++s)
+    {
+      // logarithmic search along the ray
+      const float t = std::exp2((float)s / ao_step_count) - 1.f;
+
+      steps[d * ao_step_count + s - 1] = {std::cos(alpha) * t * radius * (width - 1),
+                                          std::sin(alpha) * t * radius * (height - 1),
+                                          ao_slope_scale / (t * radius)};
+    }
+  }
+
+  const int nx = i1 - i0;
+
+  parallel_for(
+      j0,
+      j1,
+      [&](int b0, int b1)
+      {
+        std::vector<float> occlusion(nx);
+        std::vector<float> max_slope(nx);
+        std::vector<float> samples(nx);
+
+        for (int j = b0; j < b1; ++j)
+        {
+          const float *p_h0 = data.data() + (size_t)j * width + i0;
+
+          std::fill(occlusion.begin(), occlusion.end(), 0.f);
+
+          for (int d = 0; d < ao_dir_count; ++d)
+          {
+            // atan is monotonic, only the max slope of the direction is
+            // converted to an angle. Negative horizons do not occlude
+            std::fill(max_slope.begin(), max_slope.end(), 0.f);
+
+            for (int s = 0; s < ao_step_count; ++s)
+            {
+              const AOStep &step = steps[d * ao_step_count + s];
+
+              sample_row(data.data(),
+                         width,
+                         height,
+                         j,
+                         step.dx,
+                         step.dy,
+                         i0,
+                         i1,
+                         samples.data());
+
+              for (int k = 0; k < nx; ++k)
+                max_slope[k] = std::max(max_slope[k],
+                                        (samples[k] - p_h0[k]) * step.slope_factor);
+            }
+
+            for (int k = 0; k < nx; ++k)
+              occlusion[k] += std::atan(max_slope[k]);
+          }
+
+          // horizon angles in [0, pi / 2]
+          float *p_ao = ao.data() + (size_t)j * width + i0;
+
+          for (int k = 0; k < nx; ++k)
+          {
+            float v = 1.f - occlusion[k] / ao_dir_count / 1.57079632679f;
+            p_ao[k] = gain(std::clamp(v, 0.f, 1.f), 3.f);
+          }
+        }
+      });
+}
+
+void compute_heightmap_ao(std::vector<float>       &ao,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          float                     radius)
+{
+  compute_heightmap_ao(ao, data, width, height, radius, 0, 0, width, height);
+
+  qtr::Logger::log()->trace("compute_heightmap_ao: {} x {}, radius {}",
+                            width,
+                            height,
+                            radius);
+}
+
+int get_heightmap_ao_margin(int width, int height, float radius)
+{
+  // farthest step at t = 1, plus the bilinear footprint
+  return (int)std::ceil(std::max(radius, 0.f) * (std::max(width, height) - 1)) + 1;
+}
+
+} // namespace qtr
@@ -0,0 +1,137 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "qtr/horizon_map.hpp"
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+// swept profile point, 'x' along the sector direction
+struct HullPoint
+{
+  float x;
+  float v;
+};
+
+// one sector, lines along the major axis of the direction (one sample
+// per texel along it, linear interpolation across). Lines are one texel
+// apart, so that each texel is the nearest sample of exactly one line
+static void sweep_sector(std::vector<uint8_t>     &horizons,
+                         const std::vector<float> &data,
+                         int                       width,
+                         int                       height,
+                         float                     alpha,
+                         size_t                    offset) // first component
+{
+  // direction in texels, 'transposed' for a vertical major axis
+  const double tx = std::cos(alpha) * (width - 1);
+  const double ty = std::sin(alpha) * (height - 1);
+  const bool   transposed = std::abs(ty) > std::abs(tx);
+
+  const int    n_major = transposed ? height : width;
+  const int    n_minor = transposed ? width : height;
+  const double k = transposed ? tx / ty : ty / tx; // minor step per major +1
+  const int    sign = (transposed ? ty : tx) > 0. ? 1 : -1;
+
+  // step length in uv units
+  const float du = transposed ? (float)k / (width - 1) : 1.f / (width - 1);
+  const float dv = transposed ? 1.f / (height - 1) : (float)k / (height - 1);
+  const float step = std::sqrt(du * du + dv * dv);
+
+  auto index = [&](int m, int q)
+  { return transposed ? (size_t)m * width + q : (size_t)q * width + m; };
+
+  // line 'c' passes through (m, c + k * m)
+  const int c_margin = (int)std::ceil(std::abs(k) * (n_major - 1)) + 1;
+
+  parallel_for(
+      -c_margin,
+      n_minor + c_margin,
+      [&](int c0, int c1)
+      {
+        std::vector<HullPoint> hull;
+        hull.reserve(n_major);
+
+        for (int c = c0; c < c1; ++c)
+        {
+          hull.clear();
+
+          // from the far end of the line, toward the direction
+          for (int n = 0; n < n_major; ++n)
+          {
+            const int m = sign > 0 ? n_major - 1 - n : n;
+
+            // nearest texel, integer arithmetic so that lines never
+            // share a texel
+            const double km = k * m;
+            const double fl = std::floor(km);
+            const double fr = km - fl;
+            const int    q = c + (int)fl + (fr >= 0.5 ? 1 : 0);
+
+            if (q < 0 || q >= n_minor)
+              continue;
+
+            const float y = std::clamp((float)(c + km), 0.f, n_minor - 1.f);
+            const int   q0 = std::min((int)y, n_minor - 2);
+            const float f = y - q0;
+
+            HullPoint p;
+            p.x = sign * m * step;
+            p.v = data[index(m, q0)] + f * (data[index(m, q0 + 1)] - data[index(m, q0)]);
+
+            // hull vertices below the chord from 'p' are hidden for any
+            // point swept later
+            auto slope = [&p](const HullPoint &a) { return (a.v - p.v) / (a.x - p.x); };
+
+            while (hull.size() >= 2 && slope(hull[hull.size() - 2]) >= slope(hull.back()))
+              hull.pop_back();
+
+            const float s = hull.empty() ? 0.f : std::max(0.f, slope(hull.back()));
+            const float a = std::atan(s) / 1.57079632679f;
+
+            horizons[offset + 4 * index(m, q)] = (uint8_t)(a * 255.f + 0.5f);
+            hull.push_back(p);
+          }
+        }
+      });
+}
+
+void compute_horizon_map(std::vector<uint8_t>     &horizons,
+                         const std::vector<float> &data,
+                         int                       width,
+                         int                       height,
+                         int                       nsectors)
+{
+  if (width < 2 || height < 2 || (int)data.size() != width * height || nsectors < 4 ||
+      nsectors % 4)
+    return;
+
+  const auto   t0 = std::chrono::steady_clock::now();
+  const size_t layer_size = (size_t)width * height * 4;
+
+  horizons.assign(layer_size * nsectors / 4, 0);
+
+  for (int s = 0; s < nsectors; ++s)
+    sweep_sector(horizons,
+                 data,
+                 width,
+                 height,
+                 6.28318530718f * s / nsectors,
+                 (s / 4) * layer_size + s % 4);
+
+  const auto t1 = std::chrono::steady_clock::now();
+
+  qtr::Logger::log()->trace(
+      "compute_horizon_map: {} x {}, {} sectors, {} ms",
+      width,
+      height,
+      nsectors,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+} // namespace qtr
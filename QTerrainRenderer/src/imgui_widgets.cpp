@@ -125,6 +125,84 @@ void imgui_set_blender_style()
   style.Colors[ImGuiCol_SeparatorActive] = blender_blue_active;
 }
 
+void imgui_show_render_stats(const RenderStats &stats)
+{
+  const ImVec2 padding(20.0f, 20.0f);
+
+  // bottom-left corner overlay
+  ImGuiViewport *viewport = ImGui::GetMainViewport();
+  ImVec2         pos = ImVec2(viewport->WorkPos.x + padding.x,
+                              viewport->WorkPos.y + viewport->WorkSize.y - padding.y);
+
+  ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration |
+                           ImGuiWindowFlags_AlwaysAutoResize |
+                           ImGuiWindowFlags_NoSavedSettings |
+                           ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav |
+                           ImGuiWindowFlags_NoMove;
+
+  ImGui::SetNextWindowPos(pos, ImGuiCond_Always, ImVec2(0.0f, 1.0f));
+  ImGui::SetNextWindowBgAlpha(0.35f);
+
+  if (ImGui::Begin("RenderStatsOverlay", nullptr, flags))
+  {
+    ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
+
+    if (stats.terrain_tiles > 0 || stats.terrain_lod_levels > 0)
+    {
+      ImGui::Separator();
+      if (stats.terrain_tiles > 0)
+        ImGui::Text("Terrain tiles: %d", stats.terrain_tiles);
+      else
+        ImGui::Text("Terrain LOD levels: %d", stats.terrain_lod_levels);
+      ImGui::Text("  shadow pass: %d", stats.terrain_tiles_shadow_pass);
+      ImGui::Text("  depth pass:  %d", stats.terrain_tiles_depth_pass);
+      ImGui::Text("  lit pass:    %d", stats.terrain_tiles_lit_pass);
+    }
+
+    ImGui::Text("Terrain triangles: %d", stats.terrain_triangles_lit_pass);
+
+    if (stats.terrain_vertex_bytes > 0)
+      ImGui::Text("Terrain vertices: %.1f MB",
+                  (float)stats.terrain_vertex_bytes / (1024.f * 1024.f));
+
+    if (stats.skipped_uploads > 0)
+      ImGui::Text("Skipped uploads: %d (unchanged data)", stats.skipped_uploads);
+
+    if (stats.skipped_shadow_passes > 0)
+      ImGui::Text("Skipped shadow passes: %d (cached)", stats.skipped_shadow_passes);
+
+    ImGui::Text("Shadow cascades drawn: %d", stats.shadow_cascades_drawn);
+
+    if (stats.water_streaming.updates > 0)
+    {
+      ImGui::Separator();
+      ImGui::Text("Water updates: %zu", stats.water_streaming.updates);
+      ImGui::Text("  fence waits: %zu (%.1f ms)",
+                  stats.water_streaming.fence_waits,
+                  stats.water_streaming.fence_wait_ms);
+    }
+
+    if (!stats.frame_passes.empty())
+    {
+      ImGui::Separator();
+      ImGui::Text("Render passes:");
+
+      for (auto &pass : stats.frame_passes)
+      {
+        std::string reads;
+        for (auto &r : pass.reads)
+          reads += (reads.empty() ? " < " : ", ") + r;
+
+        ImGui::Text("  %s%s%s",
+                    pass.name.c_str(),
+                    reads.c_str(),
+                    pass.culled ? " (culled)" : "");
+      }
+    }
+  }
+  ImGui::End();
+}
+
 bool imgui_show_water_preset_selector(glm::vec3 &shallow, glm::vec3 &deep)
 {
   bool ret = false;
@@ -1,5 +1,10 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
 #include "qtr/mesh.hpp"
 #include "qtr/logger.hpp"
 
@@ -10,15 +15,13 @@ Mesh::Mesh() {}
 
 Mesh::~Mesh() { this->destroy(); }
 
-void Mesh::create(std::vector<Vertex> vertices_in,
-                  std::vector<uint>   indices_in,
-                  bool                store_cpu_copy,
-                  std::vector<int>    vertex_map_in)
+void Mesh::create(std::vector<Vertex> vertices_in, std::vector<uint> indices_in)
 {
   this->initializeOpenGLFunctions();
   this->destroy();
 
   this->vertex_count = vertices_in.size();
+  this->vertex_size = sizeof(Vertex);
   this->index_count = indices_in.size();
   this->has_indices = !indices_in.empty();
 
@@ -29,10 +32,7 @@ void Mesh::create(std::vector<Vertex> vertices_in,
   // Create VBO
   glGenBuffers(1, &this->vbo);
   glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-  glBufferData(GL_ARRAY_BUFFER,
-               vertices_in.size() * sizeof(Vertex),
-               vertices_in.data(),
-               GL_DYNAMIC_DRAW);
+  this->allocate_vertex_buffer(vertices_in.data(), GL_DYNAMIC_DRAW);
 
   // Create EBO
   if (this->has_indices)
@@ -61,13 +61,181 @@ void Mesh::create(std::vector<Vertex> vertices_in,
   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
 
   glBindVertexArray(0);
+}
+
+void Mesh::create(std::vector<Vertex> vertices_in, std::vector<uint16_t> indices_in)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->vertex_count = vertices_in.size();
+  this->vertex_size = sizeof(Vertex);
+  this->index_count = indices_in.size();
+  this->index_type = GL_UNSIGNED_SHORT;
+  this->has_indices = true;
+
+  glGenVertexArrays(1, &this->vao);
+  glBindVertexArray(this->vao);
+
+  glGenBuffers(1, &this->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  this->allocate_vertex_buffer(vertices_in.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &this->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               indices_in.size() * sizeof(uint16_t),
+               indices_in.data(),
+               GL_STATIC_DRAW);
+
+  GLsizei stride = sizeof(Vertex);
+  glEnableVertexAttribArray(0); // position
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+
+  glEnableVertexAttribArray(1); // normal
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+
+  glEnableVertexAttribArray(2); // textcoord
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
+
+  glBindVertexArray(0);
+}
+
+void Mesh::create(std::vector<TerrainVertex> vertices_in, std::vector<uint> indices_in)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->vertex_count = vertices_in.size();
+  this->vertex_size = sizeof(TerrainVertex);
+  this->index_count = indices_in.size();
+  this->has_indices = true;
+
+  glGenVertexArrays(1, &this->vao);
+  glBindVertexArray(this->vao);
+
+  glGenBuffers(1, &this->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  this->allocate_vertex_buffer(vertices_in.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &this->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               indices_in.size() * sizeof(uint),
+               indices_in.data(),
+               GL_STATIC_DRAW);
+
+  GLsizei stride = sizeof(TerrainVertex);
+  glEnableVertexAttribArray(7); // height
+  glVertexAttribPointer(7, 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)0);
+
+  glEnableVertexAttribArray(8); // octahedral normal
+  glVertexAttribPointer(8,
+                        2,
+                        GL_SHORT,
+                        GL_TRUE,
+                        stride,
+                        (void *)offsetof(TerrainVertex, normal));
+
+  glBindVertexArray(0);
+}
+
+void Mesh::create_attributeless(std::vector<uint> indices_in)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->vertex_count = 0;
+  this->index_count = indices_in.size();
+  this->has_indices = true;
+
+  // VAO holding the element buffer only, no vertex attributes
+  glGenVertexArrays(1, &this->vao);
+  glBindVertexArray(this->vao);
+
+  glGenBuffers(1, &this->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               indices_in.size() * sizeof(uint),
+               indices_in.data(),
+               GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+}
+
+int Mesh::advance_stream_region()
+{
+  // the draws issued so far read the current region
+  GLsync &current_fence = this->stream_fences[this->stream_region];
+
+  if (current_fence)
+    glDeleteSync(current_fence);
+  current_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  // next region, free unless the GPU is 'stream_regions' - 1 updates
+  // behind
+  const int next = (this->stream_region + 1) % this->stream_regions;
+  GLsync   &next_fence = this->stream_fences[next];
+
+  if (next_fence)
+  {
+    GLenum status = glClientWaitSync(next_fence, 0, 0);
+
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+      const auto     t0 = std::chrono::steady_clock::now();
+      const GLuint64 timeout = 1000000; // ns
+
+      do
+        status = glClientWaitSync(next_fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+      while (status == GL_TIMEOUT_EXPIRED);
+
+      const auto t1 = std::chrono::steady_clock::now();
+
+      this->stream_stats.fence_waits++;
+      this->stream_stats.fence_wait_ms +=
+          std::chrono::duration<float, std::milli>(t1 - t0).count();
+    }
+
+    glDeleteSync(next_fence);
+    next_fence = nullptr;
+  }
+
+  this->stream_region = next;
+  return next;
+}
+
+void Mesh::allocate_vertex_buffer(const void *data, GLenum usage)
+{
+  const size_t size = this->vertex_count * this->vertex_size;
+
+  this->delete_fences();
+  this->stream_region = 0;
 
-  if (store_cpu_copy)
+  if (this->stream_regions <= 1)
   {
-    this->vertices = std::move(vertices_in);
-    this->indices = std::move(indices_in);
-    this->vertex_map = std::move(vertex_map_in);
+    glBufferData(GL_ARRAY_BUFFER,
+                 size,
+                 data,
+                 this->stream_regions ? GL_STREAM_DRAW : usage);
+    return;
   }
+
+  // whole ring, initial data in the first region
+  this->stream_fences.assign(this->stream_regions, nullptr);
+
+  glBufferData(GL_ARRAY_BUFFER, this->stream_regions * size, nullptr, GL_STREAM_DRAW);
+  if (data)
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+void Mesh::delete_fences()
+{
+  for (auto &fence : this->stream_fences)
+    if (fence)
+      glDeleteSync(fence);
+
+  this->stream_fences.clear();
 }
 
 void Mesh::draw()
@@ -75,19 +243,42 @@ void Mesh::draw()
   if (!this->vao)
     return;
 
+  const GLint base_vertex = static_cast<GLint>(this->get_base_vertex());
+
   glBindVertexArray(this->vao);
   if (this->has_indices)
-    glDrawElements(GL_TRIANGLES,
-                   static_cast<GLsizei>(this->index_count),
-                   GL_UNSIGNED_INT,
-                   nullptr);
+    glDrawElementsBaseVertex(GL_TRIANGLES,
+                             static_cast<GLsizei>(this->index_count),
+                             this->index_type,
+                             nullptr,
+                             base_vertex);
   else
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(this->vertex_count));
+    glDrawArrays(GL_TRIANGLES, base_vertex, static_cast<GLsizei>(this->vertex_count));
+  glBindVertexArray(0);
+}
+
+void Mesh::draw(size_t first_index, size_t count)
+{
+  if (!this->vao || !this->has_indices)
+    return;
+
+  size_t index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t)
+                                                            : sizeof(uint);
+
+  glBindVertexArray(this->vao);
+  glDrawElementsBaseVertex(GL_TRIANGLES,
+                           static_cast<GLsizei>(count),
+                           this->index_type,
+                           reinterpret_cast<const void *>(first_index * index_size),
+                           static_cast<GLint>(this->get_base_vertex()));
   glBindVertexArray(0);
 }
 
 void Mesh::destroy()
 {
+  this->delete_fences();
+  this->stream_region = 0;
+
   if (this->vbo)
     glDeleteBuffers(1, &this->vbo);
   if (this->ebo)
@@ -100,40 +291,182 @@ void Mesh::destroy()
   this->vao = 0;
 
   this->vertex_count = 0;
+  this->vertex_size = 0;
   this->index_count = 0;
+  this->index_type = GL_UNSIGNED_INT;
   this->has_indices = false;
+  this->grid_layout = GridLayout();
+}
+
+size_t Mesh::get_base_vertex() const
+{
+  return this->stream_regions > 1 ? this->stream_region * this->vertex_count : 0;
 }
 
+GridLayout &Mesh::get_grid_layout() { return this->grid_layout; }
+
 size_t Mesh::get_index_count() const { return this->index_count; }
 
-std::vector<uint> &Mesh::get_indices() { return this->indices; }
+GLenum Mesh::get_index_type() const { return this->index_type; }
+
+int Mesh::get_stream_regions() const { return this->stream_regions; }
+
+const StreamingStats &Mesh::get_streaming_stats() const { return this->stream_stats; }
 
 GLuint Mesh::get_vao() const { return this->vao; }
 
-std::vector<Vertex> &Mesh::get_vertices() { return this->vertices; }
+size_t Mesh::get_vertex_buffer_size() const
+{
+  return this->vertex_count * this->vertex_size * std::max(1, this->stream_regions);
+}
+
+bool Mesh::is_active() const { return (this->vao && (this->vbo || this->ebo)); }
 
-std::vector<int> &Mesh::get_vertex_map() { return this->vertex_map; }
+void *Mesh::map_vertex_buffer()
+{
+  if (!this->vbo)
+    return nullptr;
 
-bool Mesh::is_active() const { return (this->vbo && this->vao); }
+  const size_t size = this->vertex_count * this->vertex_size;
+  GLintptr     offset = 0;
+  GLbitfield   access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
 
-void Mesh::update_vertices(const std::vector<Vertex> &vertices)
+  if (this->stream_regions)
+    this->stream_stats.updates++;
+
+  // ring: the next region is written while the GPU may still read the
+  // other ones. Otherwise the whole buffer is invalidated (orphaning)
+  if (this->stream_regions > 1)
+  {
+    offset = this->advance_stream_region() * size;
+    access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  void *p_dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, access);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (!p_dst)
+    qtr::Logger::log()->error("Mesh::map_vertex_buffer: mapping failed");
+
+  return p_dst;
+}
+
+void Mesh::set_grid_layout(GridLayout new_layout)
+{
+  this->grid_layout = std::move(new_layout);
+}
+
+void Mesh::set_streaming(int nregions)
+{
+  nregions = std::max(0, nregions);
+
+  if (nregions == this->stream_regions)
+    return;
+
+  const size_t size = this->vertex_count * this->vertex_size;
+  const size_t current_offset = this->get_base_vertex() * this->vertex_size;
+
+  this->stream_regions = nregions;
+
+  if (!this->vbo)
+    return; // applied at creation
+
+  // the buffer object is reallocated in place (same name, the VAO
+  // bindings stay valid), current vertices kept through a copy
+  GLuint tmp_vbo;
+  glGenBuffers(1, &tmp_vbo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, tmp_vbo);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_COPY);
+  glBindBuffer(GL_COPY_READ_BUFFER, this->vbo);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, current_offset, 0, size);
+
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  this->allocate_vertex_buffer(nullptr, GL_DYNAMIC_DRAW);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, tmp_vbo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, this->vbo);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &tmp_vbo);
+}
+
+void Mesh::unmap_vertex_buffer()
 {
   if (!this->vbo)
     return;
+
   glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+  glUnmapBuffer(GL_ARRAY_BUFFER);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void Mesh::update_vertices()
+void Mesh::update_vertices(const std::vector<Vertex> &vertices)
 {
   if (!this->vbo)
     return;
+
+  if (this->stream_regions && vertices.size() == this->vertex_count &&
+      this->vertex_size == sizeof(Vertex))
+  {
+    void *p_dst = this->map_vertex_buffer();
+
+    if (p_dst)
+    {
+      std::memcpy(p_dst, vertices.data(), vertices.size() * sizeof(Vertex));
+      this->unmap_vertex_buffer();
+      return;
+    }
+  }
+
+  // into the region read by the draws (e.g. the one a failed mapping
+  // advanced to), without overflowing into the next one
+  const size_t count = std::min(vertices.size(), this->vertex_count);
+
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  glBufferSubData(GL_ARRAY_BUFFER,
+                  this->get_base_vertex() * this->vertex_size,
+                  count * sizeof(Vertex),
+                  vertices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::update_vertices(size_t first, size_t count, const Vertex *p_vertices)
+{
+  if (!this->vbo || count == 0 || first + count > this->vertex_count)
+    return;
+
+  size_t offset = 0;
+
+  // the other regions are outdated, the current one is carried over
+  // first
+  if (this->stream_regions > 1)
+  {
+    const size_t size = this->vertex_count * this->vertex_size;
+    const size_t current_offset = this->get_base_vertex() * this->vertex_size;
+
+    this->stream_stats.updates++;
+    offset = this->advance_stream_region() * size;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, this->vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                        GL_COPY_WRITE_BUFFER,
+                        current_offset,
+                        offset,
+                        size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
   glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
   glBufferSubData(GL_ARRAY_BUFFER,
-                  0,
-                  this->vertices.size() * sizeof(Vertex),
-                  this->vertices.data());
+                  offset + first * sizeof(Vertex),
+                  count * sizeof(Vertex),
+                  p_vertices);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
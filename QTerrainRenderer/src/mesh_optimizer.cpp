@@ -0,0 +1,238 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <deque>
+
+#include "qtr/config.hpp"
+#include "qtr/mesh_optimizer.hpp"
+
+namespace qtr
+{
+
+// Forsyth's scoring, LRU cache of 32 entries
+constexpr int   forsyth_cache_size = 32;
+constexpr float forsyth_cache_decay = 1.5f;
+constexpr float forsyth_last_triangle_score = 0.75f;
+constexpr float forsyth_valence_scale = 2.f;
+constexpr float forsyth_valence_power = 0.5f;
+
+static float forsyth_vertex_score(int cache_position, int remaining_triangles)
+{
+  if (remaining_triangles == 0)
+    return -1.f; // no triangle left, never picked
+
+  float score = 0.f;
+
+  if (cache_position >= 0)
+  {
+    if (cache_position < 3)
+      // vertices of the last triangle, fixed score to avoid using
+      // them again right away (fan-like orders)
+      score = forsyth_last_triangle_score;
+    else
+      score = std::pow(1.f - (float)(cache_position - 3) / (forsyth_cache_size - 3),
+                       forsyth_cache_decay);
+  }
+
+  // favour vertices with few triangles left, to avoid leaving isolated
+  // triangles behind
+  return score + forsyth_valence_scale *
+                     std::pow((float)remaining_triangles, -forsyth_valence_power);
+}
+
+VertexCacheStats analyze_vertex_cache(const std::vector<uint> &indices,
+                                      size_t                   vertex_count,
+                                      int                      cache_size)
+{
+  VertexCacheStats stats;
+
+  if (indices.size() < 3)
+    return stats;
+
+  std::vector<int> cache_timestamps(vertex_count, -1); // FIFO insertion time
+  std::vector<int> used(vertex_count, 0);
+  int              misses = 0;
+  int              unique = 0;
+
+  for (uint v : indices)
+  {
+    if (!used[v])
+    {
+      used[v] = 1;
+      unique++;
+    }
+
+    if (cache_timestamps[v] < 0 || misses - cache_timestamps[v] >= cache_size)
+    {
+      cache_timestamps[v] = misses;
+      misses++;
+    }
+  }
+
+  stats.acmr = (float)misses / (float)(indices.size() / 3);
+  stats.atvr = (float)misses / (float)unique;
+
+  return stats;
+}
+
+void optimize_vertex_cache(std::vector<uint> &indices, size_t vertex_count)
+{
+  const size_t ntriangles = indices.size() / 3;
+
+  if (ntriangles < 2)
+    return;
+
+  // vertex -> triangles adjacency
+  std::vector<int> offsets(vertex_count + 1, 0);
+
+  for (uint v : indices)
+    offsets[v + 1]++;
+  for (size_t v = 0; v < vertex_count; ++v)
+    offsets[v + 1] += offsets[v];
+
+  std::vector<int> adjacency(indices.size());
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+
+  for (size_t k = 0; k < indices.size(); ++k)
+    adjacency[fill[indices[k]]++] = (int)(k / 3);
+
+  // per vertex state
+  std::vector<int>   remaining(vertex_count);
+  std::vector<int>   cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+
+  for (size_t v = 0; v < vertex_count; ++v)
+  {
+    remaining[v] = offsets[v + 1] - offsets[v];
+    vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+  }
+
+  // per triangle state
+  std::vector<float> triangle_score(ntriangles);
+  std::vector<char>  emitted(ntriangles, 0);
+
+  for (size_t t = 0; t < ntriangles; ++t)
+    triangle_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] +
+                        vertex_score[indices[3 * t + 2]];
+
+  std::vector<uint> output;
+  output.reserve(indices.size());
+
+  std::deque<uint> cache; // LRU, most recent first
+  size_t           scan = 0;
+  int              best = -1;
+
+  for (size_t count = 0; count < ntriangles; ++count)
+  {
+    // no candidate from the cache, best remaining triangle in input
+    // order (cheap restart, as in the original paper)
+    if (best < 0)
+    {
+      while (emitted[scan])
+        scan++;
+      best = (int)scan;
+    }
+
+    emitted[best] = 1;
+
+    for (int c = 0; c < 3; ++c)
+    {
+      uint v = indices[3 * best + c];
+      output.push_back(v);
+
+      // remove the triangle from the vertex adjacency
+      int *p_begin = adjacency.data() + offsets[v];
+      int *p_end = p_begin + remaining[v];
+      *std::find(p_begin, p_end, best) = *(p_end - 1);
+      remaining[v]--;
+
+      // move the vertex to the front of the cache
+      auto it = std::find(cache.begin(), cache.end(), v);
+      if (it != cache.end())
+        cache.erase(it);
+      cache.push_front(v);
+    }
+
+    // update the scores of the cached vertices (and of the vertices
+    // pushed out of the cache) and pick the best adjacent triangle
+    std::vector<uint> touched(cache.begin(), cache.end());
+
+    while ((int)cache.size() > forsyth_cache_size)
+    {
+      cache_position[cache.back()] = -1;
+      cache.pop_back();
+    }
+
+    for (size_t k = 0; k < touched.size(); ++k)
+    {
+      uint v = touched[k];
+
+      if (k < cache.size())
+        cache_position[v] = (int)k;
+      else
+        cache_position[v] = -1;
+
+      float new_score = forsyth_vertex_score(cache_position[v], remaining[v]);
+      float delta = new_score - vertex_score[v];
+      vertex_score[v] = new_score;
+
+      for (int a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+        triangle_score[adjacency[a]] += delta;
+    }
+
+    best = -1;
+    float best_score = -FLT_MAX;
+
+    for (uint v : cache)
+      for (int a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+      {
+        int t = adjacency[a];
+        if (triangle_score[t] > best_score)
+        {
+          best_score = triangle_score[t];
+          best = t;
+        }
+      }
+  }
+
+  indices = std::move(output);
+}
+
+void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<uint> &indices)
+{
+  std::vector<int>    remap(vertices.size(), -1);
+  std::vector<Vertex> sorted;
+  sorted.reserve(vertices.size());
+
+  for (uint &v : indices)
+  {
+    if (remap[v] < 0)
+    {
+      remap[v] = (int)sorted.size();
+      sorted.push_back(vertices[v]);
+    }
+    v = remap[v];
+  }
+
+  // unreferenced vertices are kept, at the end
+  for (size_t v = 0; v < vertices.size(); ++v)
+    if (remap[v] < 0)
+      sorted.push_back(vertices[v]);
+
+  vertices = std::move(sorted);
+}
+
+void optimize_mesh(std::vector<Vertex> &vertices, std::vector<uint> &indices)
+{
+  if (!QTR_CONFIG->geometry.optimize_vertex_cache)
+    return;
+
+  optimize_vertex_cache(indices, vertices.size());
+  optimize_vertex_fetch(vertices, indices);
+}
+
+bool use_grid_strips() { return QTR_CONFIG->geometry.optimize_vertex_cache; }
+
+} // namespace qtr
@@ -0,0 +1,47 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+
+#include "qtr/config.hpp"
+#include "qtr/parallel.hpp"
+
+namespace qtr
+{
+
+int get_nthreads()
+{
+  int nthreads = QTR_CONFIG->compute.nthreads;
+
+  if (nthreads <= 0)
+    nthreads = static_cast<int>(std::thread::hardware_concurrency());
+
+  return std::max(1, nthreads);
+}
+
+std::vector<Band> split_bands(int begin, int end, int nbands)
+{
+  std::vector<Band> bands;
+
+  const int count = end - begin;
+  if (count <= 0)
+    return bands;
+
+  nbands = std::clamp(nbands, 1, count);
+  bands.reserve(nbands);
+
+  // spread the remainder over the first bands
+  const int size = count / nbands;
+  const int remainder = count % nbands;
+  int       b0 = begin;
+
+  for (int k = 0; k < nbands; ++k)
+  {
+    int b1 = b0 + size + (k < remainder ? 1 : 0);
+    bands.push_back({b0, b1});
+    b0 = b1;
+  }
+
+  return bands;
+}
+
+} // namespace qtr
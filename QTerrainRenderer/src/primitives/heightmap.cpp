@@ -1,13 +1,665 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
+#include <chrono>
+#include <functional>
+
 #include <glm/gtc/constants.hpp>
 
 #include "qtr/logger.hpp"
 #include "qtr/mesh.hpp"
+#include "qtr/mesh_optimizer.hpp"
+#include "qtr/parallel.hpp"
+#include "qtr/primitives.hpp"
 
 namespace qtr
 {
 
+// grid vertices of the valid texels [i0, i1) of row j, written in order
+// from 'p_out'. Normals from central differences of the data, or from
+// the actual triangles next to invalid texels. 'scratch' is a work
+// buffer, reused between rows (also holds the rows converted to float)
+static void build_heightmap_row(Vertex             *p_out,
+                                const GridLayout   &layout,
+                                const RasterView   &data,
+                                int                 j,
+                                int                 i0,
+                                int                 i1,
+                                float               y,
+                                float               lx,
+                                float               ly,
+                                float               lz,
+                                float               add_level,
+                                std::vector<float> &scratch)
+{
+  const int   width = layout.width;
+  const int   height = layout.height;
+  const float dx = lx / (width - 1);
+  const float dz = lz / (height - 1);
+  const float x0 = layout.x - lx * 0.5f;
+  const float z0 = layout.z - lz * 0.5f;
+  const bool  has_holes = !layout.valid_mask.empty();
+
+  auto position = [&](int i, int j)
+  {
+    return glm::vec3(x0 + i * dx, y + data.at(i, j) * ly + add_level, z0 + j * dz);
+  };
+
+  // no excluded texel in the 3x3 neighbourhood
+  auto is_regular = [&](int i, int j)
+  {
+    for (int q = std::max(j - 1, 0); q <= std::min(j + 1, height - 1); ++q)
+      for (int p = std::max(i - 1, 0); p <= std::min(i + 1, width - 1); ++p)
+        if (!layout.is_valid(p, q))
+          return false;
+    return true;
+  };
+
+  auto is_quad_valid = [&](int i, int j)
+  {
+    return layout.is_valid(i, j) && layout.is_valid(i + 1, j) &&
+           layout.is_valid(i, j + 1) && layout.is_valid(i + 1, j + 1);
+  };
+
+  auto triangle_normal = [&](glm::ivec2 a, glm::ivec2 b, glm::ivec2 c)
+  {
+    const glm::vec3 p0 = position(a.x, a.y);
+    return glm::normalize(
+        glm::cross(position(b.x, b.y) - p0, position(c.x, c.y) - p0));
+  };
+
+  // --- regular grid, central differences on the input data (SoA
+  // --- buffers so that the loops vectorize)
+
+  scratch.resize(6 * width);
+
+  float *nx = scratch.data();
+  float *ny = nx + width;
+  float *nz = ny + width;
+
+  const float sx_c = 0.5f * ly / dx; // central
+  const float sx_b = ly / dx;        // one-sided (borders)
+  const float sz = (j > 0 && j < height - 1) ? 0.5f * ly / dz : ly / dz;
+
+  // interior columns of the range, borders are one-sided
+  const int ib = std::max(i0, 1);
+  const int ie = std::min(i1, width - 1);
+
+  // rows read in place, or converted on the fly
+  const float *r0 = data.read_row(std::max(j - 1, 0), i0, i1, nz + width);
+  const float *r1 = data.read_row(j,
+                                  std::max(i0 - 1, 0),
+                                  std::min(i1 + 1, width),
+                                  nz + 2 * width);
+  const float *r2 = data.read_row(std::min(j + 1, height - 1), i0, i1, nz + 3 * width);
+
+  if (i0 == 0)
+    nx[0] = -(r1[1] - r1[0]) * sx_b;
+  for (int i = ib; i < ie; ++i)
+    nx[i] = -(r1[i + 1] - r1[i - 1]) * sx_c;
+  if (i1 == width)
+    nx[width - 1] = -(r1[width - 1] - r1[width - 2]) * sx_b;
+
+  for (int i = i0; i < i1; ++i)
+  {
+    float gz = -(r2[i] - r0[i]) * sz;
+    float inv = 1.f / std::sqrt(nx[i] * nx[i] + 1.f + gz * gz);
+
+    nx[i] *= inv;
+    ny[i] = inv;
+    nz[i] = gz * inv;
+  }
+
+  const float v = (float)j / (height - 1);
+
+  for (int i = i0; i < i1; ++i)
+  {
+    if (has_holes && !layout.is_valid(i, j))
+      continue;
+
+    glm::vec3 normal(nx[i], ny[i], nz[i]);
+
+    // next to a hole, the differences would read excluded texels:
+    // accumulate the actual triangle normals instead
+    if (has_holes && !is_regular(i, j))
+    {
+      const glm::ivec2 t(i, j);
+
+      normal = glm::vec3(0.f, 1.f, 0.f);
+
+      if (j > 0)
+      {
+        if (i > 0 && is_quad_valid(i - 1, j - 1))
+          normal += triangle_normal({i, j - 1}, {i - 1, j}, t);
+
+        if (i < width - 1 && is_quad_valid(i, j - 1))
+        {
+          normal += triangle_normal({i, j - 1}, t, {i + 1, j - 1});
+          normal += triangle_normal({i + 1, j - 1}, t, {i + 1, j});
+        }
+      }
+
+      if (j < height - 1)
+      {
+        if (i > 0 && is_quad_valid(i - 1, j))
+        {
+          normal += triangle_normal({i - 1, j}, {i - 1, j + 1}, t);
+          normal += triangle_normal(t, {i - 1, j + 1}, {i, j + 1});
+        }
+
+        if (i < width - 1 && is_quad_valid(i, j))
+          normal += triangle_normal(t, {i, j + 1}, {i + 1, j});
+      }
+
+      normal = glm::normalize(normal);
+    }
+
+    *p_out++ = Vertex(position(i, j), normal, glm::vec2((float)i / (width - 1), v));
+  }
+}
+
+// calls 'fct(top_a, top_b)' (texel coordinates) for each skirt segment,
+// in the vertex order of generate_heightmap
+template <typename F>
+static void for_each_skirt_segment(const GridLayout &layout, F &&fct)
+{
+  const int width = layout.width;
+  const int height = layout.height;
+
+  auto add_skirt_edge = [&](auto texel_of, int count)
+  {
+    for (int k = 0; k < count - 1; ++k)
+    {
+      glm::ivec2 a = texel_of(k);
+      glm::ivec2 b = texel_of(k + 1);
+
+      if (layout.is_valid(a.x, a.y) && layout.is_valid(b.x, b.y))
+        fct(a, b);
+    }
+  };
+
+  add_skirt_edge([&](int j) { return glm::ivec2(0, j); }, height);
+  add_skirt_edge([&](int j) { return glm::ivec2(width - 1, j); }, height);
+  add_skirt_edge([&](int i) { return glm::ivec2(i, 0); }, width);
+  add_skirt_edge([&](int i) { return glm::ivec2(i, height - 1); }, width);
+}
+
+// skirt vertices at elevation 'skirt_y', 2 per segment. Skirt quads
+// are vertical, their normal is the horizontal normal of the segment:
+// skirts only depend on the grid shape, not on the data
+static void build_skirt_vertices(Vertex           *p_out,
+                                 const GridLayout &layout,
+                                 float             lx,
+                                 float             lz,
+                                 float             skirt_y)
+{
+  const float dx = lx / (layout.width - 1);
+  const float dz = lz / (layout.height - 1);
+  const float x0 = layout.x - lx * 0.5f;
+  const float z0 = layout.z - lz * 0.5f;
+
+  auto uv = [&](glm::ivec2 t)
+  {
+    return glm::vec2((float)t.x / (layout.width - 1), (float)t.y / (layout.height - 1));
+  };
+
+  for_each_skirt_segment(layout,
+                         [&](glm::ivec2 a, glm::ivec2 b)
+                         {
+                           glm::vec3 pa(x0 + a.x * dx, skirt_y, z0 + a.y * dz);
+                           glm::vec3 pb(x0 + b.x * dx, skirt_y, z0 + b.y * dz);
+                           glm::vec3 n = glm::normalize(
+                               glm::vec3(pa.z - pb.z, 0.f, pb.x - pa.x));
+
+                           *p_out++ = Vertex(pa, n, uv(a));
+                           *p_out++ = Vertex(pb, n, uv(b));
+                         });
+}
+
+// octahedral normal encoding (y up), snorm16
+static void encode_octahedral(const glm::vec3 &n, int16_t out[2])
+{
+  glm::vec2 p = glm::vec2(n.x, n.z) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+
+  if (n.y < 0.f)
+    p = glm::vec2((1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                  (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+
+  out[0] = (int16_t)std::round(glm::clamp(p.x, -1.f, 1.f) * 32767.f);
+  out[1] = (int16_t)std::round(glm::clamp(p.y, -1.f, 1.f) * 32767.f);
+}
+
+// one compact vertex per texel, then the skirt vertices numbered as in
+// generate_heightmap_implicit_grid. Triangles are the ones of the
+// regular mesh, remapped to the texel ids (the regular vertices are
+// released)
+static void build_compact_heightmap(HeightmapMeshData &mesh_data,
+                                    size_t             grid_index_count,
+                                    const RasterView  &data,
+                                    bool               add_skirt)
+{
+  const int                  width = data.get_width();
+  const int                  height = data.get_height();
+  const std::vector<Vertex> &vertices = mesh_data.vertices;
+  const std::vector<uint>   &indices = mesh_data.indices;
+  const std::vector<int>    &vertex_map = mesh_data.vertex_map;
+  const float                hmin = mesh_data.hmin;
+  const float                hmax = mesh_data.hmax;
+
+  const int   count = width * height;
+  const float norm = hmax > hmin ? 65535.f / (hmax - hmin) : 0.f;
+
+  std::vector<TerrainVertex> cvertices(count + (add_skirt ? 2 * (width + height) : 0),
+                                       TerrainVertex{0, 0, {0, 0}});
+  std::vector<uint>          texel_ids(vertices.size());
+
+  parallel_for(0,
+               height,
+               [&](int j0, int j1)
+               {
+                 std::vector<float> buffer(width);
+
+                 for (int j = j0; j < j1; ++j)
+                 {
+                   const float *p_row = data.read_row(j, 0, width, buffer.data());
+
+                   for (int i = 0; i < width; ++i)
+                   {
+                     const int k = j * width + i;
+                     const int v = vertex_map[k];
+                     if (v < 0)
+                       continue;
+
+                     texel_ids[v] = k;
+                     cvertices[k].height = (uint16_t)std::round((p_row[i] - hmin) *
+                                                                norm);
+                     encode_octahedral(vertices[v].normal, cvertices[k].normal);
+                   }
+                 }
+               });
+
+  std::vector<uint> cindices(grid_index_count);
+
+  for (size_t k = 0; k < grid_index_count; ++k)
+    cindices[k] = texel_ids[indices[k]];
+
+  if (add_skirt)
+  {
+    uint skirt_id = count;
+
+    auto add_skirt_edge = [&](auto index_of, int n)
+    {
+      for (int k = 0; k < n - 1; ++k)
+      {
+        uint top_a = index_of(k);
+        uint top_b = index_of(k + 1);
+
+        uint bot_a = skirt_id + k;
+        uint bot_b = skirt_id + k + 1;
+
+        if (vertex_map[top_a] >= 0 && vertex_map[top_b] >= 0)
+          cindices.insert(cindices.end(), {top_a, bot_a, top_b, top_b, bot_a, bot_b});
+      }
+      skirt_id += n;
+    };
+
+    add_skirt_edge([&](int j) { return j * width; }, height);
+    add_skirt_edge([&](int j) { return j * width + (width - 1); }, height);
+    add_skirt_edge([&](int i) { return i; }, width);
+    add_skirt_edge([&](int i) { return (height - 1) * width + i; }, width);
+  }
+
+  mesh_data.compact_vertices = std::move(cvertices);
+  mesh_data.indices = std::move(cindices);
+  mesh_data.vertices.clear();
+  mesh_data.vertex_map.clear();
+  mesh_data.layout = GridLayout(); // no elevation updates
+}
+
+bool build_heightmap_mesh_data(HeightmapMeshData           &mesh_data,
+                               const RasterView            &data,
+                               float                        x,
+                               float                        y,
+                               float                        z,
+                               float                        lx,
+                               float                        ly,
+                               float                        lz,
+                               bool                         add_skirt,
+                               float                        add_level,
+                               float                        exclude_below,
+                               bool                         compact_vertices,
+                               const std::function<bool()> &is_cancelled)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+
+  auto cancelled = [&]() { return is_cancelled && is_cancelled(); };
+
+  const int            width = data.get_width();
+  const int            height = data.get_height();
+  const int            count = width * height;
+  std::vector<Vertex> &vertices = mesh_data.vertices;
+  std::vector<uint>   &indices = mesh_data.indices;
+  std::vector<int>    &vertex_map = mesh_data.vertex_map;
+  GridLayout          &layout = mesh_data.layout;
+
+  mesh_data = HeightmapMeshData();
+
+  layout.width = width;
+  layout.height = height;
+  layout.x = x;
+  layout.z = z;
+  layout.row_offsets.assign(height + 1, 0);
+
+  const int             words_per_row = layout.get_words_per_row();
+  std::vector<uint64_t> valid_mask((size_t)words_per_row * height, 0);
+
+  // the grid is split in row bands, each band is processed by its own
+  // thread. Bands are processed in two steps (count, then fill) so
+  // that the outputs are written at the same place, and in the same
+  // order, as a serial row-major pass would
+  const int               nthreads = get_nthreads();
+  const std::vector<Band> bands = split_bands(0, height, nthreads);
+  const int               nbands = static_cast<int>(bands.size());
+
+  // ---- valid texels, per row counts + find hmin ----
+  std::vector<float> band_hmin(nbands, std::numeric_limits<float>::max());
+  std::vector<float> band_hmax(nbands, std::numeric_limits<float>::lowest());
+
+  parallel_run(nbands,
+               [&](int b)
+               {
+                 float              bmin = std::numeric_limits<float>::max();
+                 float              bmax = std::numeric_limits<float>::lowest();
+                 std::vector<float> buffer(width);
+
+                 for (int j = bands[b].begin; j < bands[b].end; ++j)
+                 {
+                   uint64_t    *p_row = valid_mask.data() + (size_t)j * words_per_row;
+                   const float *p_data = data.read_row(j, 0, width, buffer.data());
+                   uint         rcount = 0;
+
+                   for (int i = 0; i < width; ++i)
+                   {
+                     float hraw = p_data[i];
+
+                     if (hraw <= exclude_below)
+                       continue;
+
+                     p_row[i / 64] |= uint64_t(1) << (i % 64);
+                     bmin = std::min(bmin, hraw);
+                     bmax = std::max(bmax, hraw);
+                     ++rcount;
+                   }
+
+                   layout.row_offsets[j + 1] = rcount;
+                 }
+
+                 band_hmin[b] = bmin;
+                 band_hmax[b] = bmax;
+               });
+
+  float hmin = std::numeric_limits<float>::max();
+  float hmax = std::numeric_limits<float>::lowest();
+
+  for (int b = 0; b < nbands; ++b)
+  {
+    hmin = std::min(hmin, band_hmin[b]);
+    hmax = std::max(hmax, band_hmax[b]);
+  }
+
+  for (int j = 0; j < height; ++j)
+    layout.row_offsets[j + 1] += layout.row_offsets[j];
+
+  // the mask is only kept if there are holes
+  if ((int)layout.row_offsets[height] < count)
+    layout.valid_mask = std::move(valid_mask);
+
+  mesh_data.hmin = hmin;
+  mesh_data.hmax = hmax;
+
+  if (cancelled())
+    return false;
+
+  // ---- build vertices (and the texel -> vertex map, only used while
+  // ---- building) ----
+  vertices.resize(layout.row_offsets[height]);
+  vertex_map.assign(count, -1);
+
+  parallel_run(nbands,
+               [&](int b)
+               {
+                 std::vector<float> scratch;
+
+                 for (int j = bands[b].begin; j < bands[b].end; ++j)
+                 {
+                   int v = layout.row_offsets[j];
+
+                   for (int i = 0; i < width; ++i)
+                     if (layout.is_valid(i, j))
+                       vertex_map[j * width + i] = v++;
+
+                   build_heightmap_row(vertices.data() + layout.row_offsets[j],
+                                       layout,
+                                       data,
+                                       j,
+                                       0,
+                                       width,
+                                       y,
+                                       lx,
+                                       ly,
+                                       lz,
+                                       add_level,
+                                       scratch);
+                 }
+               });
+
+  if (cancelled())
+    return false;
+
+  // ---- indices generation ----
+
+  // one quad per (i, j) with i < width - 1 and j < height - 1, visited
+  // in strips for the post-transform cache (see grid_strip_order)
+  const int               nstrips = get_grid_strip_count(width - 1, height - 1);
+  const std::vector<Band> qbands = split_bands(0, nstrips, nthreads);
+  const int               nqbands = static_cast<int>(qbands.size());
+
+  auto is_quad_valid = [&](int i, int j)
+  {
+    const int i0 = j * width + i;
+    const int i2 = i0 + width;
+    return vertex_map[i0] >= 0 && vertex_map[i0 + 1] >= 0 && vertex_map[i2] >= 0 &&
+           vertex_map[i2 + 1] >= 0;
+  };
+
+  std::vector<size_t> band_qcount(nqbands, 0);
+
+  parallel_run(nqbands,
+               [&](int b)
+               {
+                 size_t qcount = 0;
+                 grid_strip_order(width - 1,
+                                  height - 1,
+                                  qbands[b].begin,
+                                  qbands[b].end,
+                                  [&](int i, int j) { qcount += is_quad_valid(i, j); });
+                 band_qcount[b] = qcount;
+               });
+
+  std::vector<size_t> band_ioffset(nqbands + 1, 0);
+  for (int b = 0; b < nqbands; ++b)
+    band_ioffset[b + 1] = band_ioffset[b] + 6 * band_qcount[b];
+
+  const size_t grid_index_count = band_ioffset[nqbands];
+  indices.resize(grid_index_count);
+
+  parallel_run(nqbands,
+               [&](int b)
+               {
+                 size_t k = band_ioffset[b];
+
+                 grid_strip_order(width - 1,
+                                  height - 1,
+                                  qbands[b].begin,
+                                  qbands[b].end,
+                                  [&](int i, int j)
+                                  {
+                                    const int row0 = j * width;
+                                    const int row1 = row0 + width;
+
+                                    int v0 = vertex_map[row0 + i];
+                                    int v1 = vertex_map[row0 + i + 1];
+                                    int v2 = vertex_map[row1 + i];
+                                    int v3 = vertex_map[row1 + i + 1];
+
+                                    if (v0 < 0 || v1 < 0 || v2 < 0 || v3 < 0)
+                                      return;
+
+                                    // tri 1
+                                    indices[k++] = v0;
+                                    indices[k++] = v2;
+                                    indices[k++] = v1;
+
+                                    // tri 2
+                                    indices[k++] = v1;
+                                    indices[k++] = v2;
+                                    indices[k++] = v3;
+                                  });
+               });
+
+  layout.grid_index_count = grid_index_count;
+
+  // ---- skirts ----
+  if (add_skirt)
+  {
+    size_t nsegments = 0;
+    for_each_skirt_segment(layout, [&](glm::ivec2, glm::ivec2) { nsegments++; });
+
+    layout.first_skirt_vertex = vertices.size();
+    layout.skirt_vertex_count = 2 * nsegments;
+    layout.skirt_y = y + hmin * ly + add_level;
+
+    vertices.resize(layout.first_skirt_vertex + layout.skirt_vertex_count);
+    build_skirt_vertices(vertices.data() + layout.first_skirt_vertex,
+                         layout,
+                         lx,
+                         lz,
+                         layout.skirt_y);
+
+    uint bot_a = (uint)layout.first_skirt_vertex;
+
+    for_each_skirt_segment(layout,
+                           [&](glm::ivec2 a, glm::ivec2 b)
+                           {
+                             uint top_a = vertex_map[a.y * width + a.x];
+                             uint top_b = vertex_map[b.y * width + b.x];
+                             uint bot_b = bot_a + 1;
+
+                             indices.insert(indices.end(),
+                                            {top_a, bot_a, top_b, top_b, bot_a, bot_b});
+                             bot_a += 2;
+                           });
+  }
+
+  const auto t1 = std::chrono::steady_clock::now();
+
+  qtr::Logger::log()->trace(
+      "build_heightmap_mesh_data: {} x {}, {} thread(s), {} ms",
+      width,
+      height,
+      nthreads,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+
+  if (compact_vertices)
+  {
+    if (cancelled())
+      return false;
+
+    build_compact_heightmap(mesh_data, grid_index_count, data, add_skirt);
+  }
+
+  return true;
+}
+
+bool build_heightmap_mesh_data(HeightmapMeshData           &mesh_data,
+                               const std::vector<float>    &data,
+                               int                          width,
+                               int                          height,
+                               float                        x,
+                               float                        y,
+                               float                        z,
+                               float                        lx,
+                               float                        ly,
+                               float                        lz,
+                               bool                         add_skirt,
+                               float                        add_level,
+                               float                        exclude_below,
+                               bool                         compact_vertices,
+                               const std::function<bool()> &is_cancelled)
+{
+  return build_heightmap_mesh_data(mesh_data,
+                                   RasterView(data, width, height),
+                                   x,
+                                   y,
+                                   z,
+                                   lx,
+                                   ly,
+                                   lz,
+                                   add_skirt,
+                                   add_level,
+                                   exclude_below,
+                                   compact_vertices,
+                                   is_cancelled);
+}
+
+void create_heightmap_mesh(Mesh &mesh, HeightmapMeshData &&mesh_data)
+{
+  if (!mesh_data.compact_vertices.empty())
+    mesh.create(std::move(mesh_data.compact_vertices), std::move(mesh_data.indices));
+  else
+  {
+    mesh.create(std::move(mesh_data.vertices), std::move(mesh_data.indices));
+    mesh.set_grid_layout(std::move(mesh_data.layout));
+  }
+}
+
+void generate_heightmap(Mesh             &mesh,
+                        const RasterView &data,
+                        float             x,
+                        float             y,
+                        float             z,
+                        float             lx,
+                        float             ly,
+                        float             lz,
+                        bool              add_skirt,
+                        float             add_level,
+                        float             exclude_below,
+                        float            *p_hmin,
+                        bool              compact_vertices,
+                        float            *p_hmax)
+{
+  HeightmapMeshData mesh_data;
+
+  build_heightmap_mesh_data(mesh_data,
+                            data,
+                            x,
+                            y,
+                            z,
+                            lx,
+                            ly,
+                            lz,
+                            add_skirt,
+                            add_level,
+                            exclude_below,
+                            compact_vertices);
+
+  if (p_hmin)
+    *p_hmin = mesh_data.hmin;
+  if (p_hmax)
+    *p_hmax = mesh_data.hmax;
+
+  create_heightmap_mesh(mesh, std::move(mesh_data));
+}
+
 void generate_heightmap(Mesh                     &mesh,
                         const std::vector<float> &data,
                         int                       width,
@@ -21,151 +673,402 @@ void generate_heightmap(Mesh                     &mesh,
                         bool                      add_skirt,
                         float                     add_level,
                         float                     exclude_below,
-                        float                    *p_hmin)
+                        float                    *p_hmin,
+                        bool                      compact_vertices,
+                        float                    *p_hmax)
 {
-  const int           count = width * height;
-  std::vector<Vertex> vertices;
-  std::vector<uint>   indices;
-  std::vector<int>    vertex_map(count, -1);
+  generate_heightmap(mesh,
+                     RasterView(data, width, height),
+                     x,
+                     y,
+                     z,
+                     lx,
+                     ly,
+                     lz,
+                     add_skirt,
+                     add_level,
+                     exclude_below,
+                     p_hmin,
+                     compact_vertices,
+                     p_hmax);
+}
+
+void generate_heightmap_implicit_grid(Mesh &mesh, int width, int height, bool add_skirt)
+{
+  std::vector<uint> indices;
+  indices.resize(6 * (size_t)(width - 1) * (height - 1));
+
+  // same triangles, in the same order, as generate_heightmap (without
+  // holes)
+  parallel_for(0,
+               get_grid_strip_count(width - 1, height - 1),
+               [&](int s0, int s1)
+               {
+                 size_t k = 6 * get_grid_strip_offset(width - 1, height - 1, s0);
+
+                 grid_strip_order(width - 1,
+                                  height - 1,
+                                  s0,
+                                  s1,
+                                  [&](int i, int j)
+                                  {
+                                    uint v0 = j * width + i;
+                                    uint v1 = v0 + 1;
+                                    uint v2 = v0 + width;
+                                    uint v3 = v2 + 1;
+
+                                    // tri 1
+                                    indices[k++] = v0;
+                                    indices[k++] = v2;
+                                    indices[k++] = v1;
+
+                                    // tri 2
+                                    indices[k++] = v1;
+                                    indices[k++] = v2;
+                                    indices[k++] = v3;
+                                  });
+               });
+
+  // ---- skirts ----
+  if (add_skirt)
+  {
+    uint skirt_id = width * height;
+
+    auto add_skirt_edge = [&](auto index_of, int count)
+    {
+      for (int k = 0; k < count - 1; ++k)
+      {
+        uint top_a = index_of(k);
+        uint top_b = index_of(k + 1);
+        uint bot_a = skirt_id + k;
+        uint bot_b = skirt_id + k + 1;
+
+        indices.push_back(top_a);
+        indices.push_back(bot_a);
+        indices.push_back(top_b);
+
+        indices.push_back(top_b);
+        indices.push_back(bot_a);
+        indices.push_back(bot_b);
+      }
+      skirt_id += count;
+    };
+
+    add_skirt_edge([&](int j) { return j * width; }, height);
+    add_skirt_edge([&](int j) { return j * width + (width - 1); }, height);
+    add_skirt_edge([&](int i) { return i; }, width);
+    add_skirt_edge([&](int i) { return (height - 1) * width + i; }, width);
+  }
+
+  mesh.create_attributeless(std::move(indices));
+}
+
+void generate_heightmap_tiles(std::vector<std::unique_ptr<HeightmapTile>> &tiles,
+                              const std::vector<float>                    &data,
+                              int                                          width,
+                              int                                          height,
+                              int                                          tile_size,
+                              float                                        x,
+                              float                                        y,
+                              float                                        z,
+                              float                                        lx,
+                              float                                        ly,
+                              float                                        lz,
+                              bool                                         add_skirt,
+                              float                                       *p_hmin)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+
+  // (tile_size + 1)^2 vertices + skirts must fit in 16 bits
+  tile_size = std::clamp(tile_size, 1, 250);
 
-  vertices.reserve(count);
-  indices.reserve((width - 1) * (height - 1) * 6);
+  const int ntiles_x = (width - 2) / tile_size + 1;
+  const int ntiles_z = (height - 2) / tile_size + 1;
 
   const float hx = lx * 0.5f;
   const float hz = lz * 0.5f;
   const float dx = lx / (width - 1);
   const float dz = lz / (height - 1);
 
-  // ---- find hmin + build vertices in same pass ----
-  float hmin = std::numeric_limits<float>::max();
+  float hmin = *std::min_element(data.begin(), data.end());
 
-  for (int j = 0; j < height; ++j)
+  if (p_hmin)
+    *p_hmin = hmin;
+
+  const float skirt_y = y + hmin * ly;
+
+  // normals from central differences on the whole heightmap, so that
+  // they match across tile borders
+  auto normal_at = [&](int i, int j)
   {
-    const float zpos = z - hz + j * dz;
-    for (int i = 0; i < width; ++i)
-    {
-      int   idx = j * width + i;
-      float hraw = data[idx];
+    int i0 = std::max(i - 1, 0);
+    int i1 = std::min(i + 1, width - 1);
+    int j0 = std::max(j - 1, 0);
+    int j1 = std::min(j + 1, height - 1);
 
-      if (hraw <= exclude_below)
-        continue;
+    float gx = (data[j * width + i1] - data[j * width + i0]) * ly / ((i1 - i0) * dx);
+    float gz = (data[j1 * width + i] - data[j0 * width + i]) * ly / ((j1 - j0) * dz);
 
-      // track minimum
-      if (hraw < hmin)
-        hmin = hraw;
+    return glm::normalize(glm::vec3(-gx, 1.f, -gz));
+  };
 
-      float ypos = y + hraw * ly + add_level;
-      float xpos = x - hx + i * dx;
+  // ---- CPU buffers, one tile per task ----
+  struct TileBuffers
+  {
+    std::vector<Vertex>   vertices;
+    std::vector<uint16_t> indices;
+    BoundingBox           bbox;
+  };
 
-      int new_index = (int)vertices.size();
-      vertex_map[idx] = new_index;
+  std::vector<TileBuffers> buffers(ntiles_x * ntiles_z);
 
-      glm::vec3 pos(xpos, ypos, zpos);
-      glm::vec2 uv((float)i / (width - 1), (float)j / (height - 1));
+  parallel_for(
+      0,
+      (int)buffers.size(),
+      [&](int b0, int b1)
+      {
+        for (int t = b0; t < b1; ++t)
+        {
+          auto &vertices = buffers[t].vertices;
+          auto &indices = buffers[t].indices;
 
-      vertices.emplace_back(pos, glm::vec3(0, 1, 0), uv);
-    }
+          const int ib = (t % ntiles_x) * tile_size;
+          const int jb = (t / ntiles_x) * tile_size;
+          const int ie = std::min(ib + tile_size, width - 1);
+          const int je = std::min(jb + tile_size, height - 1);
+          const int nx = ie - ib + 1;
+          const int nz = je - jb + 1;
+
+          float tile_hmin = std::numeric_limits<float>::max();
+          float tile_hmax = -std::numeric_limits<float>::max();
+
+          vertices.reserve(nx * nz);
+
+          for (int j = jb; j <= je; ++j)
+            for (int i = ib; i <= ie; ++i)
+            {
+              float hraw = data[j * width + i];
+
+              tile_hmin = std::min(tile_hmin, hraw);
+              tile_hmax = std::max(tile_hmax, hraw);
+
+              glm::vec3 pos(x - hx + i * dx, y + hraw * ly, z - hz + j * dz);
+              glm::vec2 uv((float)i / (width - 1), (float)j / (height - 1));
+
+              vertices.emplace_back(pos, normal_at(i, j), uv);
+            }
+
+          // ---- indices, same triangles as generate_heightmap ----
+          indices.reserve(6 * (nx - 1) * (nz - 1));
+
+          grid_strip_order(nx - 1,
+                           nz - 1,
+                           0,
+                           get_grid_strip_count(nx - 1, nz - 1),
+                           [&](int i, int j)
+                           {
+                             uint16_t v0 = j * nx + i;
+                             uint16_t v1 = v0 + 1;
+                             uint16_t v2 = v0 + nx;
+                             uint16_t v3 = v2 + 1;
+
+                             indices.insert(indices.end(), {v0, v2, v1, v1, v2, v3});
+                           });
+
+          // ---- skirts, outer borders only ----
+          if (add_skirt)
+          {
+            auto add_skirt_edge = [&](auto index_of, int count, glm::vec3 normal)
+            {
+              for (int k = 0; k < count - 1; ++k)
+              {
+                uint16_t top_a = index_of(k);
+                uint16_t top_b = index_of(k + 1);
+                uint16_t bot_a = (uint16_t)vertices.size();
+                uint16_t bot_b = bot_a + 1;
+
+                glm::vec3 a = vertices[top_a].position;
+                a.y = skirt_y;
+                glm::vec3 b = vertices[top_b].position;
+                b.y = skirt_y;
+
+                vertices.emplace_back(a, normal, vertices[top_a].uv);
+                vertices.emplace_back(b, normal, vertices[top_b].uv);
+
+                indices.insert(indices.end(), {top_a, bot_a, top_b, top_b, bot_a, bot_b});
+              }
+            };
+
+            if (ib == 0)
+              add_skirt_edge([&](int j) { return j * nx; },
+                             nz,
+                             glm::vec3(-1.f, 0.f, 0.f));
+            if (ie == width - 1)
+              add_skirt_edge([&](int j) { return j * nx + (nx - 1); },
+                             nz,
+                             glm::vec3(1.f, 0.f, 0.f));
+            if (jb == 0)
+              add_skirt_edge([&](int i) { return i; }, nx, glm::vec3(0.f, 0.f, -1.f));
+            if (je == height - 1)
+              add_skirt_edge([&](int i) { return (nz - 1) * nx + i; },
+                             nx,
+                             glm::vec3(0.f, 0.f, 1.f));
+
+            tile_hmin = hmin;
+          }
+
+          buffers[t].bbox.min = glm::vec3(x - hx + ib * dx,
+                                          y + tile_hmin * ly,
+                                          z - hz + jb * dz);
+          buffers[t].bbox.max = glm::vec3(x - hx + ie * dx,
+                                          y + tile_hmax * ly,
+                                          z - hz + je * dz);
+        }
+      });
+
+  // ---- GPU upload ----
+  tiles.clear();
+  tiles.reserve(buffers.size());
+
+  for (auto &b : buffers)
+  {
+    auto sp_tile = std::make_unique<HeightmapTile>();
+    sp_tile->mesh.create(std::move(b.vertices), std::move(b.indices));
+    sp_tile->bbox = b.bbox;
+    tiles.push_back(std::move(sp_tile));
   }
 
+  const auto t1 = std::chrono::steady_clock::now();
+
+  qtr::Logger::log()->trace(
+      "generate_heightmap_tiles: {} x {}, {} tiles, {} ms",
+      width,
+      height,
+      tiles.size(),
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+void generate_heightmap_rtin(Mesh                     &mesh,
+                             const HeightmapRTIN      &rtin,
+                             const std::vector<float> &data,
+                             float                     x,
+                             float                     y,
+                             float                     z,
+                             float                     lx,
+                             float                     ly,
+                             float                     lz,
+                             float                     max_error,
+                             bool                      add_skirt,
+                             float                     add_level,
+                             float                    *p_hmin)
+{
+  if (rtin.is_empty())
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  const int   width = rtin.get_width();
+  const int   height = rtin.get_height();
+  const float hx = lx * 0.5f;
+  const float hz = lz * 0.5f;
+  const float dx = lx / (width - 1);
+  const float dz = lz / (height - 1);
+
+  std::vector<uint> indices;
+  rtin.extract(indices, max_error);
+
+  float hmin = std::numeric_limits<float>::max();
+
+  for (int j = 0; j < height; ++j)
+    for (int i = 0; i < width; ++i)
+      if (rtin.is_valid(i, j))
+        hmin = std::min(hmin, data[j * width + i]);
+
   if (p_hmin)
     *p_hmin = hmin;
 
-  // ---- indices generation ----
-  for (int j = 0; j < height - 1; ++j)
-  {
-    const int row0 = j * width;
-    const int row1 = row0 + width;
+  // ---- vertices, texel indices remapped to the used ones ----
+  std::vector<int>    vertex_map(width * height, -1);
+  std::vector<Vertex> vertices;
 
-    for (int i = 0; i < width - 1; ++i)
+  for (uint &idx : indices)
+  {
+    if (vertex_map[idx] < 0)
     {
-      int i0 = row0 + i;
-      int i1 = i0 + 1;
-      int i2 = row1 + i;
-      int i3 = i2 + 1;
-
-      int v0 = vertex_map[i0];
-      int v1 = vertex_map[i1];
-      int v2 = vertex_map[i2];
-      int v3 = vertex_map[i3];
-
-      if (v0 < 0 || v1 < 0 || v2 < 0 || v3 < 0)
-        continue;
-
-      // tri 1
-      indices.push_back(v0);
-      indices.push_back(v2);
-      indices.push_back(v1);
-
-      // tri 2
-      indices.push_back(v1);
-      indices.push_back(v2);
-      indices.push_back(v3);
+      const int i = idx % width;
+      const int j = idx / width;
+
+      // central differences, as the regular grid
+      int i0 = std::max(i - 1, 0);
+      int i1 = std::min(i + 1, width - 1);
+      int j0 = std::max(j - 1, 0);
+      int j1 = std::min(j + 1, height - 1);
+
+      float gx = (data[j * width + i1] - data[j * width + i0]) * ly / ((i1 - i0) * dx);
+      float gz = (data[j1 * width + i] - data[j0 * width + i]) * ly / ((j1 - j0) * dz);
+
+      glm::vec3 pos(x - hx + i * dx, y + data[idx] * ly + add_level, z - hz + j * dz);
+      glm::vec2 uv((float)i / (width - 1), (float)j / (height - 1));
+
+      vertex_map[idx] = (int)vertices.size();
+      vertices.emplace_back(pos, glm::normalize(glm::vec3(-gx, 1.f, -gz)), uv);
     }
+
+    idx = vertex_map[idx];
   }
 
-  // ---- skirts ----
+  // ---- skirts, below the triangle edges lying on the outer borders ----
   if (add_skirt)
   {
-    float skirt_y = y + hmin * ly;
+    const float  skirt_y = y + hmin * ly;
+    const size_t ntri_indices = indices.size();
 
-    auto add_skirt_edge = [&](auto index_of, int count)
+    auto add_skirt_edge = [&](uint top_a, uint top_b, glm::vec3 normal)
     {
-      for (int k = 0; k < count - 1; ++k)
-      {
-        int top_a = vertex_map[index_of(k)];
-        int top_b = vertex_map[index_of(k + 1)];
-        if (top_a < 0 || top_b < 0)
-          continue;
-
-        int base = (int)vertices.size();
+      uint bot_a = (uint)vertices.size();
+      uint bot_b = bot_a + 1;
 
-        glm::vec3 a = vertices[top_a].position;
-        a.y = skirt_y;
-        glm::vec3 b = vertices[top_b].position;
-        b.y = skirt_y;
+      glm::vec3 a = vertices[top_a].position;
+      a.y = skirt_y;
+      glm::vec3 b = vertices[top_b].position;
+      b.y = skirt_y;
 
-        vertices.emplace_back(a, glm::vec3(0), vertices[top_a].uv);
-        vertices.emplace_back(b, glm::vec3(0), vertices[top_b].uv);
+      vertices.emplace_back(a, normal, vertices[top_a].uv);
+      vertices.emplace_back(b, normal, vertices[top_b].uv);
 
-        int bot_a = base;
-        int bot_b = base + 1;
+      indices.insert(indices.end(), {top_a, bot_a, top_b, top_b, bot_a, bot_b});
+    };
 
-        indices.push_back(top_a);
-        indices.push_back(bot_a);
-        indices.push_back(top_b);
+    for (size_t k = 0; k < ntri_indices; k += 3)
+      for (int e = 0; e < 3; ++e)
+      {
+        const uint      va = indices[k + e];
+        const uint      vb = indices[k + (e + 1) % 3];
+        const glm::vec2 ta = vertices[va].uv; // copies, 'vertices' grows
+        const glm::vec2 tb = vertices[vb].uv;
 
-        indices.push_back(top_b);
-        indices.push_back(bot_a);
-        indices.push_back(bot_b);
+        // same orientation as generate_heightmap skirts, from the
+        // lowest index to the highest one along the border
+        if (ta.x == tb.x && (ta.x == 0.f || ta.x == 1.f))
+          add_skirt_edge(ta.y < tb.y ? va : vb,
+                         ta.y < tb.y ? vb : va,
+                         glm::vec3(ta.x == 0.f ? -1.f : 1.f, 0.f, 0.f));
+        else if (ta.y == tb.y && (ta.y == 0.f || ta.y == 1.f))
+          add_skirt_edge(ta.x < tb.x ? va : vb,
+                         ta.x < tb.x ? vb : va,
+                         glm::vec3(0.f, 0.f, ta.y == 0.f ? -1.f : 1.f));
       }
-    };
-
-    add_skirt_edge([&](int j) { return j * width; }, height);
-    add_skirt_edge([&](int j) { return j * width + (width - 1); }, height);
-    add_skirt_edge([&](int i) { return i; }, width);
-    add_skirt_edge([&](int i) { return (height - 1) * width + i; }, width);
   }
 
-  // ---- normals ----
-  for (size_t k = 0; k < indices.size(); k += 3)
-  {
-    auto &v0 = vertices[indices[k + 0]];
-    auto &v1 = vertices[indices[k + 1]];
-    auto &v2 = vertices[indices[k + 2]];
+  const auto t1 = std::chrono::steady_clock::now();
 
-    glm::vec3 n = glm::normalize(
-        glm::cross(v1.position - v0.position, v2.position - v0.position));
-    v0.normal += n;
-    v1.normal += n;
-    v2.normal += n;
-  }
-  for (auto &v : vertices)
-    v.normal = glm::normalize(v.normal);
+  qtr::Logger::log()->trace(
+      "generate_heightmap_rtin: max error {}, {} triangles, {} ms",
+      max_error,
+      indices.size() / 3,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
 
-  mesh.create(std::move(vertices),
-              std::move(indices),
-              /* store_cpu_copy */ true,
-              std::move(vertex_map));
+  mesh.create(std::move(vertices), std::move(indices));
 }
 
 void update_heightmap_elevation(Mesh                     &mesh,
@@ -173,63 +1076,186 @@ void update_heightmap_elevation(Mesh                     &mesh,
                                 int                       width,
                                 int                       height,
                                 float                     y,
+                                float                     lx,
                                 float                     ly,
+                                float                     lz,
                                 float                    &hmin,
                                 float                     add_level)
 {
-  auto &verts = mesh.get_vertices();
-  auto &inds = mesh.get_indices();
-  auto &vertex_map = mesh.get_vertex_map();
+  GridLayout &layout = mesh.get_grid_layout();
 
-  hmin = std::numeric_limits<float>::max();
+  if (layout.width != width || layout.height != height ||
+      (int)data.size() != width * height)
+  {
+    qtr::Logger::log()->error(
+        "update_heightmap_elevation: not a heightmap mesh or shape mismatch");
+    return;
+  }
 
-  // vertices beyond that index are skirt vertices
-  int max_index = 0;
+  const std::vector<Band> bands = split_bands(0, height, get_nthreads());
+  const int               nbands = static_cast<int>(bands.size());
 
-  // update Y positions
-  for (int j = 0; j < height; ++j)
-    for (int i = 0; i < width; ++i)
-    {
-      int idx = j * width + i;
-      int vindex = vertex_map[idx]; // store this once at creation
+  // elevation min of the valid texels
+  std::vector<float> band_hmin(nbands, std::numeric_limits<float>::max());
 
-      max_index = std::max(max_index, vindex);
+  parallel_run(nbands,
+               [&](int b)
+               {
+                 for (int j = bands[b].begin; j < bands[b].end; ++j)
+                   for (int i = 0; i < width; ++i)
+                     if (layout.is_valid(i, j))
+                       band_hmin[b] = std::min(band_hmin[b], data[j * width + i]);
+               });
 
-      if (vindex < 0)
-        continue;
+  hmin = *std::min_element(band_hmin.begin(), band_hmin.end());
 
-      float hraw = data[idx];
-      hmin = std::min(hmin, hraw);
+  const RasterView raster(data, width, height);
 
-      verts[vindex].position.y = y + hraw * ly + add_level;
-    }
+  // vertices rebuilt row by row straight into the vertex buffer
+  Vertex *p_vertices = static_cast<Vertex *>(mesh.map_vertex_buffer());
+
+  if (!p_vertices)
+    return;
+
+  parallel_run(nbands,
+               [&](int b)
+               {
+                 std::vector<float> scratch;
+
+                 for (int j = bands[b].begin; j < bands[b].end; ++j)
+                   build_heightmap_row(p_vertices + layout.row_offsets[j],
+                                       layout,
+                                       raster,
+                                       j,
+                                       0,
+                                       width,
+                                       y,
+                                       lx,
+                                       ly,
+                                       lz,
+                                       add_level,
+                                       scratch);
+               });
 
-  // fix skirt elevation
-  if (max_index + 1 < verts.size())
+  // the mapping discarded the whole buffer, skirts included
+  layout.skirt_y = y + hmin * ly + add_level;
+
+  if (layout.skirt_vertex_count)
+    build_skirt_vertices(p_vertices + layout.first_skirt_vertex,
+                         layout,
+                         lx,
+                         lz,
+                         layout.skirt_y);
+
+  mesh.unmap_vertex_buffer();
+}
+
+void update_heightmap_elevation_region(Mesh                     &mesh,
+                                       const std::vector<float> &data,
+                                       int                       width,
+                                       int                       height,
+                                       int                       i0,
+                                       int                       j0,
+                                       int                       i1,
+                                       int                       j1,
+                                       float                     y,
+                                       float                     lx,
+                                       float                     ly,
+                                       float                     lz,
+                                       float                     hmin,
+                                       float                     add_level)
+{
+  GridLayout &layout = mesh.get_grid_layout();
+
+  if (layout.width != width || layout.height != height)
+    return;
+
+  // each sub-range update of a ring buffer copies a whole region, the
+  // mesh is rather rewritten once
+  if (mesh.get_stream_regions() > 1)
   {
-    for (size_t k = max_index + 1; k < verts.size(); ++k)
-      verts[k].position.y = y + hmin * ly + add_level;
+    float new_hmin;
+    update_heightmap_elevation(mesh,
+                               data,
+                               width,
+                               height,
+                               y,
+                               lx,
+                               ly,
+                               lz,
+                               new_hmin,
+                               add_level);
+    return;
   }
 
-  // normals
-  for (size_t k = 0; k < inds.size(); k += 3)
+  // normals, central differences reach one texel around the region
+  const int ni0 = std::max(i0 - 1, 0);
+  const int nj0 = std::max(j0 - 1, 0);
+  const int ni1 = std::min(i1 + 1, width);
+  const int nj1 = std::min(j1 + 1, height);
+
+  // one contiguous vertex range per row, rebuilt in a region-sized
+  // buffer
+  std::vector<uint> row_first(nj1 - nj0 + 1);
+  std::vector<uint> row_offsets(nj1 - nj0 + 1, 0);
+
+  for (int j = nj0; j < nj1; ++j)
   {
-    auto &v0 = verts[inds[k]];
-    auto &v1 = verts[inds[k + 1]];
-    auto &v2 = verts[inds[k + 2]];
+    const uint first = layout.get_vertex(ni0, j);
+    const uint last = layout.get_vertex(ni1, j);
 
-    glm::vec3 n = glm::normalize(
-        glm::cross(v1.position - v0.position, v2.position - v0.position));
+    row_first[j - nj0] = first;
+    row_offsets[j - nj0 + 1] = row_offsets[j - nj0] + (last - first);
+  }
 
-    v0.normal += n;
-    v1.normal += n;
-    v2.normal += n;
+  std::vector<Vertex> region_vertices(row_offsets.back());
+  const RasterView    raster(data, width, height);
+
+  parallel_for(nj0,
+               nj1,
+               [&](int jb, int je)
+               {
+                 std::vector<float> scratch;
+
+                 for (int j = jb; j < je; ++j)
+                   build_heightmap_row(region_vertices.data() + row_offsets[j - nj0],
+                                       layout,
+                                       raster,
+                                       j,
+                                       ni0,
+                                       ni1,
+                                       y,
+                                       lx,
+                                       ly,
+                                       lz,
+                                       add_level,
+                                       scratch);
+               });
+
+  for (int j = nj0; j < nj1; ++j)
+  {
+    const uint count = row_offsets[j - nj0 + 1] - row_offsets[j - nj0];
+
+    if (count)
+      mesh.update_vertices(row_first[j - nj0],
+                           count,
+                           region_vertices.data() + row_offsets[j - nj0]);
   }
 
-  for (auto &v : verts)
-    v.normal = glm::normalize(v.normal);
+  // skirts only depend on the grid shape and on their elevation
+  const float skirt_y = y + hmin * ly + add_level;
 
-  mesh.update_vertices();
+  if (layout.skirt_vertex_count && skirt_y != layout.skirt_y)
+  {
+    std::vector<Vertex> skirt_vertices(layout.skirt_vertex_count);
+
+    build_skirt_vertices(skirt_vertices.data(), layout, lx, lz, skirt_y);
+    mesh.update_vertices(layout.first_skirt_vertex,
+                         skirt_vertices.size(),
+                         skirt_vertices.data());
+
+    layout.skirt_y = skirt_y;
+  }
 }
 
 } // namespace qtr
@@ -5,6 +5,7 @@
 #include <glm/gtc/constants.hpp>
 
 #include "qtr/mesh.hpp"
+#include "qtr/mesh_optimizer.hpp"
 
 namespace qtr
 {
@@ -113,6 +114,8 @@ void generate_rock(Mesh &mesh,
   for (auto &v : vertices)
     v.normal = glm::normalize(v.normal);
 
+  optimize_mesh(vertices, indices);
+
   mesh.create(vertices, indices);
 }
 
@@ -5,6 +5,7 @@
 #include <glm/gtc/constants.hpp>
 
 #include "qtr/mesh.hpp"
+#include "qtr/mesh_optimizer.hpp"
 
 namespace qtr
 {
@@ -57,6 +58,8 @@ void generate_sphere(Mesh &mesh, float radius, int slices, int stacks)
       indices.push_back(i3);
     }
 
+  optimize_mesh(vertices, indices);
+
   mesh.create(vertices, indices);
 }
 
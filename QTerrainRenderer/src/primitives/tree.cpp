@@ -3,6 +3,7 @@
 #include <glm/gtc/constants.hpp>
 
 #include "qtr/mesh.hpp"
+#include "qtr/mesh_optimizer.hpp"
 
 namespace qtr
 {
@@ -88,6 +89,8 @@ void generate_tree(Mesh &mesh,
     indices.push_back(i3);
   }
 
+  optimize_mesh(vertices, indices);
+
   mesh.create(vertices, indices);
 }
 
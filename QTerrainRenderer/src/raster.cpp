@@ -0,0 +1,244 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <bit>
+
+#include "qtr/hash.hpp"
+#include "qtr/parallel.hpp"
+#include "qtr/raster.hpp"
+
+namespace qtr
+{
+
+float half_to_float(uint16_t bits)
+{
+  const uint32_t sign = (uint32_t)(bits & 0x8000) << 16;
+  const uint32_t exponent = (bits >> 10) & 0x1f;
+  uint32_t       mantissa = bits & 0x3ff;
+
+  if (exponent == 0x1f) // inf, nan
+    return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+
+  if (exponent == 0)
+  {
+    if (mantissa == 0)
+      return std::bit_cast<float>(sign);
+
+    // subnormal, renormalized
+    int e = -1;
+    do
+    {
+      mantissa <<= 1;
+      e++;
+    } while (!(mantissa & 0x400));
+
+    return std::bit_cast<float>(sign | (uint32_t)(112 - e) << 23 |
+                                (mantissa & 0x3ff) << 13);
+  }
+
+  return std::bit_cast<float>(sign | (exponent + 112) << 23 | mantissa << 13);
+}
+
+uint16_t float_to_half(float value)
+{
+  // F. Giesen, float_to_half_fast3_rtne
+  constexpr uint32_t f32_infinity = 255u << 23;
+  constexpr uint32_t f16_max = (127u + 16u) << 23;
+  constexpr uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t       u = std::bit_cast<uint32_t>(value);
+  const uint32_t sign = u & 0x80000000u;
+  u ^= sign;
+
+  uint32_t out;
+
+  if (u >= f16_max) // inf or nan
+    out = u > f32_infinity ? 0x7e00 : 0x7c00;
+  else if (u < (113u << 23)) // subnormal or zero, rounded by the float addition
+    out = std::bit_cast<uint32_t>(std::bit_cast<float>(u) +
+                                  std::bit_cast<float>(denorm_magic)) -
+          denorm_magic;
+  else
+  {
+    const uint32_t mantissa_odd = (u >> 13) & 1;
+    out = (u + ((15u - 127u) << 23) + 0xfff + mantissa_odd) >> 13;
+  }
+
+  return (uint16_t)(out | sign >> 16);
+}
+
+void convert_to_half(const float *p_src, size_t count, uint16_t *p_dst)
+{
+  for (size_t k = 0; k < count; ++k)
+    p_dst[k] = float_to_half(p_src[k]);
+}
+
+void convert_to_unorm16(const float *p_src,
+                        size_t       count,
+                        float        vmin,
+                        float        vmax,
+                        uint16_t    *p_dst)
+{
+  const float norm = vmax > vmin ? 65535.f / (vmax - vmin) : 0.f;
+
+  for (size_t k = 0; k < count; ++k)
+  {
+    const float v = std::clamp((p_src[k] - vmin) * norm, 0.f, 65535.f);
+    p_dst[k] = (uint16_t)(v + 0.5f);
+  }
+}
+
+template <typename T> static float to_float(T value)
+{
+  if constexpr (std::is_same_v<T, uint8_t>)
+    return value / 255.f;
+  else if constexpr (std::is_same_v<T, uint16_t>)
+    return value / 65535.f;
+  else if constexpr (std::is_same_v<T, half>)
+    return half_to_float(value.bits);
+  else
+    return value;
+}
+
+template <typename T>
+static void convert_row(const T *p_src, int channels, int i0, int i1, float *p_dst)
+{
+  for (int i = i0; i < i1; ++i)
+    p_dst[i] = to_float(p_src[(size_t)i * channels]);
+}
+
+float RasterView::at(int i, int j, int c) const
+{
+  const size_t k = ((size_t)j * this->stride + i) * this->channels + c;
+
+  switch (this->type)
+  {
+  case PixelType::UINT8:
+    return to_float(static_cast<const uint8_t *>(this->p_data)[k]);
+  case PixelType::UINT16:
+    return to_float(static_cast<const uint16_t *>(this->p_data)[k]);
+  case PixelType::HALF:
+    return to_float(static_cast<const half *>(this->p_data)[k]);
+  default:
+    return static_cast<const float *>(this->p_data)[k];
+  }
+}
+
+size_t RasterView::get_component_size() const
+{
+  switch (this->type)
+  {
+  case PixelType::UINT8:
+    return 1;
+  case PixelType::UINT16:
+  case PixelType::HALF:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+uint64_t RasterView::get_hash() const
+{
+  const size_t row_size = (size_t)this->width * this->channels *
+                          this->get_component_size();
+  uint64_t     h;
+
+  if (this->stride == (size_t)this->width)
+    h = hash_bytes(this->p_data, row_size * this->height);
+  else
+  {
+    // padded rows, hashed one by one
+    const uint8_t *p = static_cast<const uint8_t *>(this->p_data);
+    const size_t   row_stride = this->stride * this->channels *
+                              this->get_component_size();
+
+    std::vector<uint64_t> row_hashes(this->height);
+
+    parallel_for(0,
+                 this->height,
+                 [&](int j0, int j1)
+                 {
+                   for (int j = j0; j < j1; ++j)
+                     row_hashes[j] = xxh64(p + (size_t)j * row_stride, row_size);
+                 });
+
+    h = xxh64(row_hashes.data(), row_hashes.size() * sizeof(uint64_t));
+  }
+
+  return hash_values(h, this->type, this->width, this->height, this->channels);
+}
+
+bool RasterView::is_valid() const
+{
+  if (!this->p_data || this->width <= 0 || this->height <= 0 || this->channels < 1 ||
+      this->channels > 4 || this->stride < (size_t)this->width)
+    return false;
+
+  // last row may be packed
+  return this->size >=
+         ((size_t)(this->height - 1) * this->stride + this->width) * this->channels;
+}
+
+const float *RasterView::read_row(int j, int i0, int i1, float *p_buffer) const
+{
+  const size_t k = (size_t)j * this->stride * this->channels;
+
+  switch (this->type)
+  {
+  case PixelType::UINT8:
+    convert_row(static_cast<const uint8_t *>(this->p_data) + k,
+                this->channels,
+                i0,
+                i1,
+                p_buffer);
+    return p_buffer;
+  case PixelType::UINT16:
+    convert_row(static_cast<const uint16_t *>(this->p_data) + k,
+                this->channels,
+                i0,
+                i1,
+                p_buffer);
+    return p_buffer;
+  case PixelType::HALF:
+    convert_row(static_cast<const half *>(this->p_data) + k,
+                this->channels,
+                i0,
+                i1,
+                p_buffer);
+    return p_buffer;
+  default:
+    if (this->channels == 1)
+      return static_cast<const float *>(this->p_data) + k;
+
+    convert_row(static_cast<const float *>(this->p_data) + k,
+                this->channels,
+                i0,
+                i1,
+                p_buffer);
+    return p_buffer;
+  }
+}
+
+std::vector<float> RasterView::to_float_vector() const
+{
+  std::vector<float> data((size_t)this->width * this->height);
+
+  parallel_for(0,
+               this->height,
+               [&](int j0, int j1)
+               {
+                 for (int j = j0; j < j1; ++j)
+                 {
+                   float       *p_dst = data.data() + (size_t)j * this->width;
+                   const float *p_row = this->read_row(j, 0, this->width, p_dst);
+
+                   if (p_row != p_dst)
+                     std::copy(p_row, p_row + this->width, p_dst);
+                 }
+               });
+
+  return data;
+}
+
+} // namespace qtr
@@ -2,6 +2,8 @@
    License. The full license is in the file LICENSE, distributed with this software. */
 #include "qtr/windows_patch.hpp"
 
+#include <algorithm>
+
 #include "qtr/render_widget.hpp"
 
 namespace qtr
@@ -22,9 +24,26 @@ void RenderWidget::render_depth_map(const glm::mat4 &model,
     GLint previous_fbo;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
 
-    glViewport(0, 0, p_tex->get_width(), p_tex->get_height());
     glBindFramebuffer(GL_FRAMEBUFFER, this->fbo_depth);
 
+    // screen resolution reduced as the scattering buffer (same texels,
+    // see render_scattering)
+    const int ds = std::max(1, this->scattering_downsample);
+    const int w = std::max(1, this->width() / ds);
+    const int h = std::max(1, this->height() / ds);
+
+    if (p_tex->get_width() != w || p_tex->get_height() != h)
+    {
+      p_tex->generate_depth_texture(w, h, false);
+      glFramebufferTexture2D(GL_FRAMEBUFFER,
+                             GL_DEPTH_ATTACHMENT,
+                             GL_TEXTURE_2D,
+                             p_tex->get_id(),
+                             0);
+    }
+
+    glViewport(0, 0, p_tex->get_width(), p_tex->get_height());
+
     glClear(GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
 
@@ -37,7 +56,18 @@ void RenderWidget::render_depth_map(const glm::mat4 &model,
       this->plane.draw();
 
     if (this->render_hmap)
-      this->hmap.draw();
+    {
+      // implicit grid elevations are read from the heightmap texture
+      Texture *p_hmap = this->sp_texture_manager->get(QTR_TEX_HMAP);
+      p_hmap->bind_and_set(*p_shader, "texture_" QTR_TEX_HMAP, 0);
+
+      this->stats.terrain_tiles_depth_pass = this->draw_terrain(*p_shader,
+                                                                model,
+                                                                projection * view,
+                                                                this->camera.position);
+
+      p_hmap->unbind();
+    }
 
     if (this->render_water)
       this->water_mesh.draw();
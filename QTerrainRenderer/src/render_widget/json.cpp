@@ -1,5 +1,7 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+
 #include "qtr/logger.hpp"
 #include "qtr/render_widget.hpp"
 #include "qtr/utils.hpp"
@@ -37,6 +39,7 @@ void RenderWidget::json_from(nlohmann::json const &json)
 
   // GUI state
   json_safe_get(json, "wireframe_mode", wireframe_mode);
+  json_safe_get(json, "show_stats", show_stats);
   json_safe_get(json, "auto_rotate_light", auto_rotate_light);
   json_safe_get(json, "auto_rotate_camera", auto_rotate_camera);
 
@@ -56,6 +59,22 @@ void RenderWidget::json_from(nlohmann::json const &json)
   json_safe_get(json, "hmap_w", hmap_w);
   json_safe_get(json, "hmap_h", hmap_h);
 
+  json_safe_get(json, "terrain_tile_size", terrain_tile_size);
+  terrain_tile_size = std::clamp(terrain_tile_size, 16, 250); // as the UI
+  json_safe_get(json, "terrain_compact_vertices", terrain_compact_vertices);
+  json_safe_get(json, "cdlod_quad_pixels", cdlod_quad_pixels);
+  cdlod_quad_pixels = std::clamp(cdlod_quad_pixels, 1.f, 16.f); // as the UI
+  json_safe_get(json, "cdlod_show_levels", cdlod_show_levels);
+  json_safe_get(json, "rtin_max_error", rtin_max_error);
+
+  TerrainRenderMode mode = this->terrain_render_mode;
+  json_safe_get(json, "terrain_render_mode", mode);
+  this->set_terrain_render_mode(mode);
+
+  TexturePrecision precision = this->hmap_texture_precision;
+  json_safe_get(json, "hmap_texture_precision", precision);
+  this->set_heightmap_texture_precision(precision);
+
   // Scene visibility
   json_safe_get(json, "render_plane", render_plane);
   json_safe_get(json, "render_points", render_points);
@@ -76,11 +95,30 @@ void RenderWidget::json_from(nlohmann::json const &json)
   // Shadows
   json_safe_get(json, "bypass_shadow_map", bypass_shadow_map);
   json_safe_get(json, "shadow_strength", shadow_strength);
+  json_safe_get(json, "shadow_cascade_count", shadow_cascade_count);
+  json_safe_get(json, "shadow_map_resolution", shadow_map_resolution);
+
+  // same ranges as the UI
+  shadow_cascade_count = std::clamp(shadow_cascade_count, 1, QTR_MAX_SHADOW_CASCADES);
+  shadow_map_resolution = std::clamp(shadow_map_resolution, 512, 4096);
+
+  json_safe_get(json, "shadow_filter", shadow_filter);
+  json_safe_get(json, "shadow_blur_radius", shadow_blur_radius);
+  json_safe_get(json, "shadow_time_slicing", shadow_time_slicing);
+  json_safe_get(json, "shadow_cascade_budget", shadow_cascade_budget);
+  json_safe_get(json, "terrain_horizon_shadows", terrain_horizon_shadows);
 
   // Ambient occlusion
   json_safe_get(json, "add_ambiant_occlusion", add_ambiant_occlusion);
   json_safe_get(json, "ambiant_occlusion_strength", ambiant_occlusion_strength);
-  json_safe_get(json, "ambiant_occlusion_radius", ambiant_occlusion_radius);
+
+  float ao_radius = this->ambiant_occlusion_radius;
+  json_safe_get(json, "ambiant_occlusion_radius", ao_radius);
+  if (ao_radius != this->ambiant_occlusion_radius)
+  {
+    this->ambiant_occlusion_radius = ao_radius;
+    this->need_ao_update = true; // rebaked at the next paintGL
+  }
 
   // Textures
   json_safe_get(json, "bypass_texture_albedo", bypass_texture_albedo);
@@ -117,6 +155,7 @@ void RenderWidget::json_from(nlohmann::json const &json)
   json_safe_get(json, "mie_color", mie_color);
   json_safe_get(json, "fog_strength", fog_strength);
   json_safe_get(json, "fog_scattering_ratio", fog_scattering_ratio);
+  json_safe_get(json, "scattering_downsample", scattering_downsample);
 
   // Viewer 2D
   json_safe_get(json, "viewer2d_settings.zoom", viewer2d_settings.zoom);
@@ -140,6 +179,7 @@ nlohmann::json RenderWidget::json_to() const
 
       // GUI state
       {"wireframe_mode", wireframe_mode},
+      {"show_stats", show_stats},
       {"auto_rotate_light", auto_rotate_light},
       {"auto_rotate_camera", auto_rotate_camera},
 
@@ -158,6 +198,13 @@ nlohmann::json RenderWidget::json_to() const
       {"hmap_h0", hmap_h0},
       {"hmap_w", hmap_w},
       {"hmap_h", hmap_h},
+      {"terrain_render_mode", terrain_render_mode},
+      {"terrain_tile_size", terrain_tile_size},
+      {"terrain_compact_vertices", terrain_compact_vertices},
+      {"cdlod_quad_pixels", cdlod_quad_pixels},
+      {"cdlod_show_levels", cdlod_show_levels},
+      {"rtin_max_error", rtin_max_error},
+      {"hmap_texture_precision", hmap_texture_precision},
 
       // Scene visibility
       {"render_plane", render_plane},
@@ -179,6 +226,13 @@ nlohmann::json RenderWidget::json_to() const
       // Shadows
       {"bypass_shadow_map", bypass_shadow_map},
       {"shadow_strength", shadow_strength},
+      {"shadow_cascade_count", shadow_cascade_count},
+      {"shadow_map_resolution", shadow_map_resolution},
+      {"shadow_filter", shadow_filter},
+      {"shadow_blur_radius", shadow_blur_radius},
+      {"shadow_time_slicing", shadow_time_slicing},
+      {"shadow_cascade_budget", shadow_cascade_budget},
+      {"terrain_horizon_shadows", terrain_horizon_shadows},
 
       // Ambient occlusion
       {"add_ambiant_occlusion", add_ambiant_occlusion},
@@ -220,6 +274,7 @@ nlohmann::json RenderWidget::json_to() const
       {"mie_color", mie_color},
       {"fog_strength", fog_strength},
       {"fog_scattering_ratio", fog_scattering_ratio},
+      {"scattering_downsample", scattering_downsample},
 
       // other classes
       {"camera", this->camera.json_to()},
@@ -28,6 +28,23 @@ void RenderWidget::paintGL()
   if (QOpenGLContext::currentContext() != this->context())
     this->makeCurrent();
 
+  this->upload_heightmap_build();
+
+  if (this->need_terrain_update)
+    this->update_terrain_geometry();
+
+  if (this->need_hmap_texture_update)
+    this->upload_heightmap_texture();
+
+  if (this->need_ao_update && this->add_ambiant_occlusion)
+    this->update_heightmap_ao();
+
+  if (this->need_horizon_update && this->terrain_horizon_shadows)
+    this->update_horizon_map();
+
+  if (this->add_water_waves && this->render_water)
+    this->update_water_textures();
+
   this->update_time();
   this->update_light();
   this->update_camera();
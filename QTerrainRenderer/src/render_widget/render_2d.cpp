@@ -43,11 +43,7 @@ void RenderWidget::render_scene_render_2d()
   {
     p_shader->bind();
 
-    this->set_common_uniforms(*p_shader,
-                              model,
-                              glm::mat4(0.f),
-                              glm::mat4(0.f),
-                              glm::mat4(0.f));
+    this->set_common_uniforms(*p_shader, model, glm::mat4(0.f), glm::mat4(0.f));
 
     p_shader->setUniformValue("use_texture_albedo", true);
     p_shader->setUniformValue("normal_visualization", false);
@@ -74,7 +70,23 @@ void RenderWidget::render_scene_render_2d()
       p_shader->setUniformValue("normal_map_scaling", 0.f);
       p_shader->setUniformValue("use_texture_albedo", false);
 
-      this->hmap.draw();
+      // top view transform of viewer2d_cmap.vert, as a matrix (used
+      // for tile culling only)
+      glm::mat4 top_view(0.f);
+      top_view[0][0] = this->viewer2d_settings.zoom / aspect_ratio;
+      top_view[2][1] = this->viewer2d_settings.zoom;
+      top_view[3][3] = 1.f;
+
+      // LOD eye above the view center, closer when zooming in
+      float     zoom = std::max(this->viewer2d_settings.zoom, 1e-3f);
+      glm::vec3 eye(0.f, this->hmap_w / zoom, 0.f);
+
+      this->stats.terrain_tiles_lit_pass = this->draw_terrain(
+          *p_shader,
+          model,
+          top_view,
+          eye,
+          &this->stats.terrain_triangles_lit_pass);
     }
 
     this->unbind_textures();
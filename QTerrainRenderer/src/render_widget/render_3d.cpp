@@ -2,6 +2,7 @@
    License. The full license is in the file LICENSE, distributed with this software. */
 #include "qtr/windows_patch.hpp"
 
+#include <cmath>
 #include <stdexcept>
 
 #include <QOpenGLFunctions>
@@ -20,40 +21,8 @@
 namespace qtr
 {
 
-void RenderWidget::render_scene_render_3d()
+void RenderWidget::render_lit_pass(const glm::mat4 &model, const glm::mat4 &projection)
 {
-  if (QOpenGLContext::currentContext() != this->context())
-    this->makeCurrent();
-
-  // model
-  bool flip_x = qtr::Config::get_config()->viewer3d.flip_x;
-  bool flip_y = qtr::Config::get_config()->viewer3d.flip_y;
-
-  float cx = flip_x ? -1.f : 1.f;
-  float cy = flip_y ? -1.f : 1.f;
-
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::scale(model, glm::vec3(cx, this->scale_h, cy));
-
-  // shadow map
-  glm::mat4 light_space_matrix;
-  this->render_shadow_map(model, light_space_matrix);
-
-  // projection - guard against zero height
-  int h = this->height();
-  int w = this->width();
-  if (h <= 0 || w <= 0)
-    return;
-
-  float aspect_ratio = static_cast<float>(w) / static_cast<float>(h);
-
-  glm::mat4 projection = this->camera.get_projection_matrix_perspective(aspect_ratio);
-
-  // depth map
-  this->render_depth_map(model, this->camera.get_view_matrix(), projection);
-
-  // --- main lit pass
-
   this->setup_gl_state();
 
   QOpenGLShaderProgram *p_shader = this->sp_shader_manager->get("shadow_map_lit_pass")
@@ -66,8 +35,7 @@ void RenderWidget::render_scene_render_3d()
     this->set_common_uniforms(*p_shader,
                               model,
                               projection,
-                              this->camera.get_view_matrix(),
-                              light_space_matrix);
+                              this->camera.get_view_matrix());
 
     // base plane
     if (this->render_plane)
@@ -104,8 +72,17 @@ void RenderWidget::render_scene_render_3d()
       if (this->sp_texture_manager->get(QTR_TEX_NORMAL)->is_active())
         p_shader->setUniformValue("normal_map_scaling", this->normal_map_scaling);
 
-      p_shader->setUniformValue("add_ambiant_occlusion", this->add_ambiant_occlusion);
-      this->hmap.draw();
+      // not baked yet, the unbound sampler would read 0
+      const bool add_ao = this->add_ambiant_occlusion &&
+                          this->sp_texture_manager->get(QTR_TEX_AO)->is_active();
+
+      p_shader->setUniformValue("add_ambiant_occlusion", add_ao);
+      this->stats.terrain_tiles_lit_pass = this->draw_terrain(
+          *p_shader,
+          model,
+          projection * this->camera.get_view_matrix(),
+          this->camera.position,
+          &this->stats.terrain_triangles_lit_pass);
 
       p_shader->setUniformValue("normal_map_scaling", 0.f);
       p_shader->setUniformValue("use_texture_albedo", false);
@@ -139,11 +116,11 @@ void RenderWidget::render_scene_render_3d()
       p_shader->setUniformValue("foam_depth", this->foam_depth);
 
       p_shader->setUniformValue("add_water_waves", this->add_water_waves);
-      p_shader->setUniformValue("angle_spread_ratio", this->angle_spread_ratio);
       p_shader->setUniformValue("waves_alpha", this->waves_alpha);
       p_shader->setUniformValue("waves_kw", this->waves_kw);
       p_shader->setUniformValue("waves_amplitude", this->waves_amplitude);
       p_shader->setUniformValue("waves_normal_amplitude", this->waves_normal_amplitude);
+      p_shader->setUniformValue("waves_tile_cells", float(this->waves_tile_cells));
 
       if (this->animate_waves)
         p_shader->setUniformValue("waves_speed", this->waves_speed);
@@ -154,6 +131,8 @@ void RenderWidget::render_scene_render_3d()
       // fallback
       if (this->water_mesh.is_active())
         this->water_mesh.draw();
+
+      this->stats.water_streaming = this->water_mesh.get_streaming_stats();
     }
 
     this->unbind_textures();
@@ -162,6 +141,68 @@ void RenderWidget::render_scene_render_3d()
   }
 }
 
+void RenderWidget::render_scene_render_3d()
+{
+  if (QOpenGLContext::currentContext() != this->context())
+    this->makeCurrent();
+
+  // model
+  bool flip_x = qtr::Config::get_config()->viewer3d.flip_x;
+  bool flip_y = qtr::Config::get_config()->viewer3d.flip_y;
+
+  float cx = flip_x ? -1.f : 1.f;
+  float cy = flip_y ? -1.f : 1.f;
+
+  glm::mat4 model = glm::mat4(1.0f);
+  model = glm::scale(model, glm::vec3(cx, this->scale_h, cy));
+
+  // projection - guard against zero height
+  int h = this->height();
+  int w = this->width();
+  if (h <= 0 || w <= 0)
+    return;
+
+  float aspect_ratio = static_cast<float>(w) / static_cast<float>(h);
+
+  glm::mat4 projection = this->camera.get_projection_matrix_perspective(aspect_ratio);
+  glm::mat4 view = this->camera.get_view_matrix();
+
+  // passes, the lit pass only reads the maps of the enabled effects
+  std::vector<std::string> lit_reads;
+
+  if (!this->bypass_shadow_map)
+    lit_reads.push_back(QTR_TEX_SHADOW_MAP);
+  if (this->add_fog || this->add_atmospheric_scattering)
+    lit_reads.push_back(QTR_TEX_DEPTH); // also for the scattering upsampling
+  if (this->add_atmospheric_scattering)
+    lit_reads.push_back(QTR_TEX_SCATTERING);
+
+  this->frame_graph.clear();
+
+  this->frame_graph.add_pass("shadow",
+                             {},
+                             {QTR_TEX_SHADOW_MAP},
+                             [&]() { this->render_shadow_map(model, aspect_ratio); });
+
+  this->frame_graph.add_pass("depth",
+                             {},
+                             {QTR_TEX_DEPTH},
+                             [&]() { this->render_depth_map(model, view, projection); });
+
+  this->frame_graph.add_pass("scattering",
+                             {QTR_TEX_DEPTH, QTR_TEX_SHADOW_MAP},
+                             {QTR_TEX_SCATTERING},
+                             [&]() { this->render_scattering(model, projection); });
+
+  this->frame_graph.add_pass("lit",
+                             lit_reads,
+                             {"frame"},
+                             [&]() { this->render_lit_pass(model, projection); });
+
+  this->frame_graph.execute({"frame"});
+  this->stats.frame_passes = this->frame_graph.get_passes();
+}
+
 void RenderWidget::render_ui_render_3d()
 {
   {
@@ -190,6 +231,8 @@ void RenderWidget::render_ui_render_3d()
   changed |= ImGui::SliderFloat("Height scale", &this->scale_h, 0.f, 2.f);
   changed |= ImGui::SliderAngle("FOV", &this->camera.fov, 10.f, 180.f);
   changed |= ImGui::Checkbox("Auto rotate cam.", &this->auto_rotate_camera);
+  ImGui::SameLine();
+  changed |= ImGui::Checkbox("Stats", &this->show_stats);
 
   if (ImGui::Button("Reset Camera"))
   {
@@ -228,6 +271,60 @@ void RenderWidget::render_ui_render_3d()
     ImGui::EndTable();
   }
 
+  {
+    std::vector<std::string> mode_labels = {"Mesh",
+                                            "Implicit grid",
+                                            "Tiled mesh",
+                                            "CDLOD",
+                                            "RTIN mesh"};
+
+    int mode_int = static_cast<int>(this->terrain_render_mode);
+    if (imgui_enum_selector("Terrain mode", mode_int, mode_labels))
+      this->set_terrain_render_mode(static_cast<TerrainRenderMode>(mode_int));
+
+    if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_MESH)
+      if (ImGui::Checkbox("Compact vertices", &this->terrain_compact_vertices))
+      {
+        this->need_terrain_update = true;
+        this->need_update = true;
+      }
+
+    if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_TILED_MESH)
+      if (ImGui::SliderInt("Tile size", &this->terrain_tile_size, 16, 250))
+      {
+        this->need_terrain_update = true;
+        this->need_update = true;
+      }
+
+    if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_CDLOD)
+    {
+      changed |= ImGui::SliderFloat("Quad size (px)",
+                                    &this->cdlod_quad_pixels,
+                                    1.f,
+                                    16.f);
+      changed |= ImGui::Checkbox("LOD colors", &this->cdlod_show_levels);
+    }
+
+    if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_RTIN)
+      if (ImGui::SliderFloat("Max error",
+                             &this->rtin_max_error,
+                             0.f,
+                             0.05f,
+                             "%.4f",
+                             ImGuiSliderFlags_Logarithmic))
+      {
+        this->need_terrain_update = true;
+        this->need_update = true;
+      }
+
+    std::vector<std::string> precision_labels = {"Unorm 16", "Half", "Float"};
+
+    int precision_int = static_cast<int>(this->hmap_texture_precision);
+    if (imgui_enum_selector("Heightmap texture", precision_int, precision_labels))
+      this->set_heightmap_texture_precision(
+          static_cast<TexturePrecision>(precision_int));
+  }
+
   // --- Materials ---
   if (ImGui::CollapsingHeader("Materials", ImGuiTreeNodeFlags_DefaultOpen))
   {
@@ -250,6 +347,45 @@ void RenderWidget::render_ui_render_3d()
     ImGui::Text("Shadow Map");
     changed |= ImGui::Checkbox("Bypass", &this->bypass_shadow_map);
     changed |= ImGui::SliderFloat("Strength", &this->shadow_strength, 0.f, 1.f);
+    changed |= ImGui::SliderInt("Cascades",
+                                &this->shadow_cascade_count,
+                                1,
+                                QTR_MAX_SHADOW_CASCADES);
+
+    // per cascade, the array is reallocated by the shadow pass
+    std::vector<std::string> resolution_labels = {"512", "1024", "2048", "4096"};
+
+    int resolution_int = std::clamp(
+        (int)std::round(std::log2(this->shadow_map_resolution / 512.f)),
+        0,
+        3);
+    if (imgui_enum_selector("Resolution", resolution_int, resolution_labels))
+    {
+      this->shadow_map_resolution = 512 << resolution_int;
+      changed = true;
+    }
+
+    std::vector<std::string> filter_labels = {"PCF", "Variance"};
+
+    int filter_int = static_cast<int>(this->shadow_filter);
+    if (imgui_enum_selector("Filtering", filter_int, filter_labels))
+    {
+      this->shadow_filter = static_cast<ShadowFilter>(filter_int);
+      changed = true;
+    }
+
+    if (this->shadow_filter == ShadowFilter::SHADOW_FILTER_VSM)
+      changed |= ImGui::SliderInt("Blur radius", &this->shadow_blur_radius, 0, 8);
+
+    changed |= ImGui::Checkbox("Time slicing", &this->shadow_time_slicing);
+
+    if (this->shadow_time_slicing)
+      changed |= ImGui::SliderInt("Cascades per frame",
+                                  &this->shadow_cascade_budget,
+                                  0,
+                                  QTR_MAX_SHADOW_CASCADES - 1);
+
+    changed |= ImGui::Checkbox("Terrain horizon map", &this->terrain_horizon_shadows);
 
     if (ImGui::TreeNode("Ambient Occlusion"))
     {
@@ -258,7 +394,11 @@ void RenderWidget::render_ui_render_3d()
                                     &this->ambiant_occlusion_strength,
                                     0.f,
                                     1.f);
-      changed |= ImGui::SliderFloat("Radius", &this->ambiant_occlusion_radius, 0.f, 0.5f);
+      if (ImGui::SliderFloat("Radius", &this->ambiant_occlusion_radius, 0.f, 0.5f))
+      {
+        this->need_ao_update = true; // rebaked at the next paintGL
+        changed = true;
+      }
       ImGui::TreePop();
     }
   }
@@ -311,6 +451,15 @@ void RenderWidget::render_ui_render_3d()
                                   1.f);
     changed |= ImGui::ColorEdit3("Rayleigh color", glm::value_ptr(this->rayleigh_color));
     changed |= ImGui::ColorEdit3("Mie color", glm::value_ptr(this->mie_color));
+
+    std::vector<std::string> downsample_labels = {"Half", "Quarter"};
+
+    int downsample_int = this->scattering_downsample >= 4 ? 1 : 0;
+    if (imgui_enum_selector("Resolution##scat", downsample_int, downsample_labels))
+    {
+      this->scattering_downsample = 2 << downsample_int;
+      changed = true;
+    }
   }
 
   // --- Mouse controls overlay ---
@@ -352,6 +501,10 @@ void RenderWidget::render_ui_render_3d()
     ImGui::PopStyleVar(2);
   }
 
+  // --- Statistics overlay ---
+  if (this->show_stats)
+    imgui_show_render_stats(this->stats);
+
   // --- End main window ---
   this->need_update |= changed;
   ImGui::End();
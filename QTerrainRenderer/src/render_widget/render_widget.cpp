@@ -2,6 +2,9 @@
    License. The full license is in the file LICENSE, distributed with this software. */
 #include "qtr/windows_patch.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <stdexcept>
 
 #include <QOpenGLFunctions>
@@ -11,16 +14,26 @@
 #include <imgui.h>
 
 #include "qtr/config.hpp"
+#include "qtr/hash.hpp"
+#include "qtr/heightmap_ao.hpp"
+#include "qtr/horizon_map.hpp"
 #include "qtr/imgui_widgets.hpp"
 #include "qtr/logger.hpp"
 #include "qtr/mesh.hpp"
 #include "qtr/primitives.hpp"
 #include "qtr/render_widget.hpp"
 #include "qtr/utils.hpp"
+#include "qtr/water_textures.hpp"
 
 namespace qtr
 {
 
+// see RenderWidget::is_upload_skipped
+static uint64_t get_texture_key(const RasterView &data)
+{
+  return data.is_valid() ? data.get_hash() : 0;
+}
+
 RenderWidget::RenderWidget(const std::string &_title, QWidget *parent)
     : QOpenGLWidget(parent), title(_title)
 {
@@ -36,6 +49,12 @@ RenderWidget::RenderWidget(const std::string &_title, QWidget *parent)
                 &QTimer::timeout,
                 [this]()
                 {
+                  // background terrain build ready for upload
+                  {
+                    std::lock_guard<std::mutex> lock(this->hmap_build_mutex);
+                    this->need_update |= (bool)this->hmap_build;
+                  }
+
                   if (this->need_update)
                   {
                     this->update();
@@ -54,9 +73,14 @@ RenderWidget::RenderWidget(const std::string &_title, QWidget *parent)
 
   // add placeholder for each texture
   const std::vector<std::string> tex_names = {QTR_TEX_ALBEDO,
+                                              QTR_TEX_AO,
+                                              QTR_TEX_FLOW,
                                               QTR_TEX_HMAP,
+                                              QTR_TEX_HMAP_MINMAX,
+                                              QTR_TEX_HORIZON,
                                               QTR_TEX_NORMAL,
                                               QTR_TEX_SHADOW_MAP,
+                                              QTR_TEX_WAVES,
                                               QTR_TEX_DEPTH};
   for (auto &s : tex_names)
     this->sp_texture_manager->add(s);
@@ -95,6 +119,156 @@ void RenderWidget::clear()
   this->doneCurrent();
 }
 
+int RenderWidget::draw_terrain(QOpenGLShaderProgram &shader,
+                               const glm::mat4      &model,
+                               const glm::mat4      &view_projection,
+                               const glm::vec3      &eye,
+                               int                  *p_ntriangles)
+{
+  // with an implicit grid, CDLOD or compact vertices, the texture_hmap
+  // sampler must be bound by the caller
+  bool implicit_grid = this->terrain_render_mode ==
+                       TerrainRenderMode::TERRAIN_IMPLICIT_GRID;
+  bool cdlod = this->terrain_render_mode == TerrainRenderMode::TERRAIN_CDLOD;
+  bool compact_vertex = this->terrain_render_mode == TerrainRenderMode::TERRAIN_MESH &&
+                        this->terrain_compact_vertices;
+
+  shader.setUniformValue("implicit_grid", implicit_grid);
+  shader.setUniformValue("cdlod", cdlod);
+  shader.setUniformValue("compact_vertex", compact_vertex);
+
+  if (implicit_grid || cdlod || compact_vertex)
+  {
+    shader.setUniformValue("hmap_h0", this->hmap_h0);
+    shader.setUniformValue("hmap_h", this->hmap_h);
+    shader.setUniformValue("hmap_w", this->hmap_w);
+    shader.setUniformValue("hmap_hmin", this->hmap_hmin);
+    shader.setUniformValue("hmap_hmax", this->hmap_hmax);
+    shader.setUniformValue("hmap_tex_decode", toQVec(this->get_heightmap_decode()));
+  }
+
+  // bounding boxes are in model space, so is the frustum
+  const Frustum frustum(view_projection * model);
+
+  int    ndrawn = 0;
+  size_t nindices = 0;
+
+  if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_TILED_MESH)
+  {
+    for (auto &sp_tile : this->hmap_tiles)
+      if (frustum.intersects(sp_tile->bbox))
+      {
+        sp_tile->mesh.draw();
+        nindices += sp_tile->mesh.get_index_count();
+        ndrawn++;
+      }
+  }
+  else if (cdlod)
+  {
+    if (this->hmap_cdlod.is_active())
+    {
+      // level 0 range: distance at which the level 0 grid quads project
+      // to cdlod_quad_pixels on screen, the ranges then doubling with
+      // the quad size, so that the triangle count follows the screen
+      // resolution rather than the heightmap one
+      const int   patch_size = this->hmap_cdlod.get_patch_size();
+      const float quad_size = this->hmap_w / (float)(this->current_width - 1);
+      const float viewport_height = (float)this->height() * this->devicePixelRatioF();
+
+      const uint64_t ranges_key = hash_values(0,
+                                              this->camera.fov,
+                                              viewport_height,
+                                              quad_size,
+                                              this->cdlod_quad_pixels,
+                                              this->hmap_cdlod.get_level_count());
+
+      if (ranges_key != this->cdlod_ranges_key)
+      {
+        // in pixels per world unit at a unit distance
+        const float focal = 0.5f * viewport_height / std::tan(0.5f * this->camera.fov);
+
+        this->hmap_cdlod.set_lod_ranges(quad_size * focal /
+                                        std::max(this->cdlod_quad_pixels, 0.5f));
+        this->cdlod_ranges_key = ranges_key;
+      }
+
+      this->hmap_cdlod.select(this->hmap_cdlod_nodes,
+                              model,
+                              frustum,
+                              eye,
+                              this->hmap_h0,
+                              this->hmap_w,
+                              this->hmap_h);
+
+      shader.setUniformValue("cdlod_patch_size", patch_size);
+      shader.setUniformValue("cdlod_eye", toQVec(eye));
+
+      // debug colors, the caller base color restored afterwards
+      const GLint base_color_loc = shader.uniformLocation("base_color");
+      GLfloat     base_color[3] = {1.f, 1.f, 1.f};
+
+      if (this->cdlod_show_levels)
+      {
+        shader.setUniformValue("use_texture_albedo", false);
+
+        if (base_color_loc >= 0)
+          glGetUniformfv(shader.programId(), base_color_loc, base_color);
+      }
+
+      const size_t patch_quadrant_indices = 6 * (patch_size / 2) * (patch_size / 2);
+
+      for (const CDLODNode &node : this->hmap_cdlod_nodes)
+      {
+        shader.setUniformValue("cdlod_node_offset",
+                               QVector2D((float)node.i0, (float)node.j0));
+        shader.setUniformValue("cdlod_node_scale", (float)node.size / patch_size);
+        shader.setUniformValue("cdlod_morph",
+                               QVector2D(this->hmap_cdlod.get_morph_start(node.level),
+                                         this->hmap_cdlod.get_morph_end(node.level)));
+
+        if (this->cdlod_show_levels)
+        {
+          static const std::array<QVector3D, 6> colors = {QVector3D(1.f, 0.2f, 0.2f),
+                                                          QVector3D(1.f, 0.6f, 0.2f),
+                                                          QVector3D(1.f, 1.f, 0.2f),
+                                                          QVector3D(0.2f, 1.f, 0.2f),
+                                                          QVector3D(0.2f, 0.6f, 1.f),
+                                                          QVector3D(0.6f, 0.2f, 1.f)};
+
+          shader.setUniformValue("base_color", colors[node.level % colors.size()]);
+        }
+
+        this->hmap_cdlod.draw_patch(node.quadrants);
+
+        for (int q = 0; q < 4; ++q)
+          if (node.quadrants & (1 << q))
+            nindices += patch_quadrant_indices;
+      }
+
+      if (this->cdlod_show_levels && base_color_loc >= 0)
+        shader.setUniformValue(base_color_loc,
+                               QVector3D(base_color[0], base_color[1], base_color[2]));
+
+      ndrawn = (int)this->hmap_cdlod_nodes.size();
+    }
+  }
+  else if (this->hmap.is_active())
+  {
+    this->hmap.draw();
+    nindices = this->hmap.get_index_count();
+    ndrawn = 1;
+  }
+
+  shader.setUniformValue("implicit_grid", false);
+  shader.setUniformValue("cdlod", false);
+  shader.setUniformValue("compact_vertex", false);
+
+  if (p_ntriangles)
+    *p_ntriangles = (int)(nindices / 3);
+
+  return ndrawn;
+}
+
 ImGuiIO &RenderWidget::get_imgui_io()
 {
   ImGui::SetCurrentContext(this->imgui_context);
@@ -122,7 +296,71 @@ bool RenderWidget::get_render_water() const { return this->render_water; }
 
 bool RenderWidget::get_render_leaves() const { return this->render_leaves; }
 
-Mesh &RenderWidget::get_water_mesh() { return this->water_mesh; }
+TexturePrecision RenderWidget::get_heightmap_texture_precision() const
+{
+  return this->hmap_texture_precision;
+}
+
+TerrainRenderMode RenderWidget::get_terrain_render_mode() const
+{
+  return this->terrain_render_mode;
+}
+
+glm::vec2 RenderWidget::get_heightmap_decode()
+{
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP);
+  return p_tex ? p_tex->get_decode() : glm::vec2(1.f, 0.f);
+}
+
+uint64_t RenderWidget::get_heightmap_key(const RasterView &data, bool add_skirt) const
+{
+  if (!data.is_valid())
+    return 0;
+
+  return hash_values(data.get_hash(),
+                     add_skirt,
+                     this->hmap_h0,
+                     this->hmap_w,
+                     this->hmap_h);
+}
+
+const HeightPyramid &RenderWidget::get_heightmap_pyramid() const
+{
+  return this->hmap_pyramid;
+}
+
+uint64_t RenderWidget::get_shadow_map_key(const glm::mat4 &model)
+{
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_SHADOW_MAP);
+  const bool terrain = this->is_terrain_in_shadow_map();
+
+  uint64_t key = hash_values(0,
+                             this->light.position,
+                             model,
+                             p_tex ? p_tex->get_id() : 0u,
+                             this->render_plane,
+                             this->render_rocks,
+                             this->render_leaves,
+                             this->render_trees,
+                             terrain,
+                             this->terrain_render_mode,
+                             this->shadow_filter,
+                             this->shadow_blur_radius);
+
+  // CDLOD levels are selected from the camera position
+  if (terrain && this->terrain_render_mode == TerrainRenderMode::TERRAIN_CDLOD)
+    key = hash_values(key, this->camera.position, this->cdlod_ranges_key);
+
+  return key;
+}
+
+Mesh &RenderWidget::get_water_mesh()
+{
+  // may be modified outside, the keys do not hold anymore
+  this->water_key = 0;
+  this->water_topology_key = 0;
+  return this->water_mesh;
+}
 
 void RenderWidget::initializeGL()
 {
@@ -148,21 +386,38 @@ void RenderWidget::initializeGL()
                                                 diffuse_basic_vertex,
                                                 diffuse_blinn_phong_frag);
 
-  this->sp_shader_manager->add_shader_from_code("depth_map",
-                                                depth_map_vertex,
-                                                depth_map_frag);
+  this->sp_shader_manager->add_shader_from_code(
+      "depth_map",
+      add_terrain_vertex_code(depth_map_vertex),
+      depth_map_frag);
 
-  this->sp_shader_manager->add_shader_from_code("shadow_map_depth_pass",
-                                                shadow_map_depth_pass_vertex,
-                                                shadow_map_depth_pass_frag);
+  this->sp_shader_manager->add_shader_from_code(
+      "shadow_map_depth_pass",
+      add_terrain_vertex_code(shadow_map_depth_pass_vertex),
+      shadow_map_depth_pass_frag);
 
-  this->sp_shader_manager->add_shader_from_code("shadow_map_lit_pass",
-                                                shadow_map_lit_pass_vertex,
-                                                shadow_map_lit_pass_frag);
+  this->sp_shader_manager->add_shader_from_code(
+      "shadow_map_moments_pass",
+      add_terrain_vertex_code(shadow_map_depth_pass_vertex),
+      shadow_map_moments_pass_frag);
 
-  this->sp_shader_manager->add_shader_from_code("viewer2d_cmap",
-                                                viewer2d_cmap_vertex,
-                                                viewer2d_cmap_frag);
+  this->sp_shader_manager->add_shader_from_code("shadow_map_blur",
+                                                fullscreen_triangle_vertex,
+                                                shadow_map_blur_frag);
+
+  this->sp_shader_manager->add_shader_from_code("scattering",
+                                                fullscreen_triangle_vertex,
+                                                scattering_frag);
+
+  this->sp_shader_manager->add_shader_from_code(
+      "shadow_map_lit_pass",
+      add_terrain_vertex_code(shadow_map_lit_pass_vertex),
+      shadow_map_lit_pass_frag);
+
+  this->sp_shader_manager->add_shader_from_code(
+      "viewer2d_cmap",
+      add_terrain_vertex_code(viewer2d_cmap_vertex),
+      viewer2d_cmap_frag);
 
   // --- Meshes
 
@@ -173,6 +428,13 @@ void RenderWidget::initializeGL()
                  2000.f * this->hmap_w,
                  2000.f * this->hmap_w);
 
+  // vertices 0, 1, 2, see fullscreen_triangle.vert
+  this->fullscreen_triangle.create_attributeless({0, 1, 2});
+
+  // water elevations may be set every frame (e.g. animated), vertices
+  // then rewritten through a ring of buffers, see set_water_geometry
+  this->water_mesh.set_streaming(3);
+
   // --- Textures
 
   // depth buffer
@@ -200,24 +462,36 @@ void RenderWidget::initializeGL()
 
   // shadow map texture and buffer
   {
-    int shadow_map_res = 1024; // 2048;
+    // one layer per cascade, see render_shadow_map
+    const int count = std::clamp(this->shadow_cascade_count, 1, QTR_MAX_SHADOW_CASCADES);
 
-    this->sp_texture_manager->add_depth_texture(QTR_TEX_SHADOW_MAP,
-                                                shadow_map_res,
-                                                shadow_map_res,
-                                                true);
+    this->sp_texture_manager->add(QTR_TEX_SHADOW_MAP);
+    this->sp_texture_manager->get(QTR_TEX_SHADOW_MAP)
+        ->generate_depth_texture_array(this->shadow_map_resolution,
+                                       this->shadow_map_resolution,
+                                       count,
+                                       true,
+                                       true);
 
-    // create framebuffer for shadow depth
+    // scattering buffer, sized with the depth map, see render_scattering
+    this->sp_texture_manager->add(QTR_TEX_SCATTERING);
+
+    // allocated with SHADOW_FILTER_VSM only
+    this->sp_texture_manager->add(QTR_TEX_SHADOW_MOMENTS);
+    this->sp_texture_manager->add(QTR_TEX_SHADOW_MOMENTS_BLUR);
+
+    // create framebuffer for shadow depth, layers attached per cascade
     glGenFramebuffers(1, &this->fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER,
-                           GL_DEPTH_ATTACHMENT,
-                           GL_TEXTURE_2D,
-                           this->sp_texture_manager->get(QTR_TEX_SHADOW_MAP)->get_id(),
-                           0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
+    // moments blur, color layer attached per pass
+    glGenFramebuffers(1, &this->fbo_shadow_blur);
+
+    // scattering, texture attached when (re)allocated
+    glGenFramebuffers(1, &this->fbo_scattering);
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
   }
 
@@ -255,12 +529,63 @@ void RenderWidget::reset_camera_position()
   this->need_update = true;
 }
 
+bool RenderWidget::is_heightmap_uploaded()
+{
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP);
+  return !this->hmap_data.empty() && (!p_tex || p_tex->is_active());
+}
+
+bool RenderWidget::is_horizon_map_used()
+{
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HORIZON);
+  return this->terrain_horizon_shadows && p_tex && p_tex->is_active();
+}
+
+bool RenderWidget::is_terrain_in_shadow_map()
+{
+  // with the horizon map, the terrain is only needed by the
+  // atmospheric scattering
+  return this->render_hmap &&
+         (!this->is_horizon_map_used() || this->add_atmospheric_scattering);
+}
+
+bool RenderWidget::is_upload_skipped(uint64_t key, uint64_t current_key, bool is_active)
+{
+  if (key == 0 || key != current_key || !is_active)
+    return false;
+
+  qtr::Logger::log()->trace("RenderWidget::is_upload_skipped: unchanged data");
+  this->stats.skipped_uploads++;
+  return true;
+}
+
 void RenderWidget::reset_heightmap_geometry()
 {
+  this->cancel_heightmap_build();
+  this->hmap_key = 0;
+
   this->makeCurrent();
   this->hmap.destroy();
+  this->hmap_tiles.clear();
+  this->hmap_cdlod.clear();
+  this->hmap_rtin.clear();
+  this->hmap_pyramid.clear();
+  this->hmap_ao.clear();
+  this->need_ao_update = false;
+  this->need_horizon_update = false;
+  this->need_flow_update = false;
+  this->hmap_data.clear();
   if (this->sp_texture_manager->get(QTR_TEX_HMAP))
     this->sp_texture_manager->get(QTR_TEX_HMAP)->destroy();
+  if (this->sp_texture_manager->get(QTR_TEX_HMAP_MINMAX))
+    this->sp_texture_manager->get(QTR_TEX_HMAP_MINMAX)->destroy();
+  if (this->sp_texture_manager->get(QTR_TEX_AO))
+    this->sp_texture_manager->get(QTR_TEX_AO)->destroy();
+  if (this->sp_texture_manager->get(QTR_TEX_HORIZON))
+    this->sp_texture_manager->get(QTR_TEX_HORIZON)->destroy();
+  if (this->sp_texture_manager->get(QTR_TEX_FLOW))
+    this->sp_texture_manager->get(QTR_TEX_FLOW)->destroy();
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -269,6 +594,7 @@ void RenderWidget::reset_leaves()
 {
   this->makeCurrent();
   this->leaves_instanced_mesh.destroy();
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -296,6 +622,8 @@ void RenderWidget::reset_texture(const std::string &name)
   this->makeCurrent();
   if (this->sp_texture_manager->get(name))
     this->sp_texture_manager->get(name)->destroy();
+  this->texture_keys.erase(name);
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -308,18 +636,29 @@ void RenderWidget::reset_textures()
 
   // /!\ do not reset the depth maps
   const std::vector<std::string> tex_names = {QTR_TEX_ALBEDO,
+                                              QTR_TEX_AO,
+                                              QTR_TEX_FLOW,
                                               QTR_TEX_HMAP,
+                                              QTR_TEX_HMAP_MINMAX,
+                                              QTR_TEX_HORIZON,
                                               QTR_TEX_NORMAL};
   for (auto &s : tex_names)
+  {
     if (this->sp_texture_manager->get(s))
       this->sp_texture_manager->get(s)->destroy();
+    this->texture_keys.erase(s);
+  }
 
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
 
 void RenderWidget::reset_water_geometry()
 {
+  this->water_key = 0;
+  this->water_topology_key = 0;
+
   this->makeCurrent();
   this->water_mesh.destroy();
   this->need_update = true;
@@ -330,6 +669,7 @@ void RenderWidget::reset_rocks()
 {
   this->makeCurrent();
   this->rocks_instanced_mesh.destroy();
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -338,6 +678,7 @@ void RenderWidget::reset_trees()
 {
   this->makeCurrent();
   this->trees_instanced_mesh.destroy();
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -375,8 +716,7 @@ void RenderWidget::set_bypass_texture_albedo(bool new_state)
 void RenderWidget::set_common_uniforms(QOpenGLShaderProgram &shader,
                                        const glm::mat4      &model,
                                        const glm::mat4      &projection,
-                                       const glm::mat4      &view,
-                                       const glm::mat4      &light_space)
+                                       const glm::mat4      &view)
 {
   // Textures
   this->sp_texture_manager->bind_and_set(shader);
@@ -386,7 +726,6 @@ void RenderWidget::set_common_uniforms(QOpenGLShaderProgram &shader,
   shader.setUniformValue("model", toQMat(model));
   shader.setUniformValue("view", toQMat(view));
   shader.setUniformValue("projection", toQMat(projection));
-  shader.setUniformValue("light_space_matrix", toQMat(light_space));
 
   // Camera & light
   shader.setUniformValue("camera_pos", toQVec(camera.position));
@@ -401,15 +740,53 @@ void RenderWidget::set_common_uniforms(QOpenGLShaderProgram &shader,
   // Shadow & AO
   shader.setUniformValue("bypass_shadow_map", bypass_shadow_map);
   shader.setUniformValue("shadow_strength", shadow_strength);
-  shader.setUniformValue("add_ambiant_occlusion", add_ambiant_occlusion);
+  shader.setUniformValue("use_horizon_map", this->is_horizon_map_used());
+  shader.setUniformValue("use_shadow_moments",
+                         this->sp_texture_manager->get(QTR_TEX_SHADOW_MOMENTS)
+                             ->is_active());
+
+  // shadow cascades, see compute_shadow_cascades
+  {
+    std::vector<QMatrix4x4> matrices;
+    std::vector<float>      splits;
+    std::vector<float>      texel_sizes;
+
+    for (auto &cascade : this->shadow_cascades)
+    {
+      matrices.push_back(toQMat(cascade.light_space_matrix));
+      splits.push_back(cascade.split_far);
+      texel_sizes.push_back(cascade.texel_size);
+    }
+
+    shader.setUniformValue("shadow_cascade_count", (int)this->shadow_cascades.size());
+    shader.setUniformValueArray("shadow_cascade_matrices",
+                                matrices.data(),
+                                (int)matrices.size());
+    shader.setUniformValueArray("shadow_cascade_splits",
+                                splits.data(),
+                                (int)splits.size(),
+                                1);
+    shader.setUniformValueArray("shadow_cascade_texel_sizes",
+                                texel_sizes.data(),
+                                (int)texel_sizes.size(),
+                                1);
+  }
+  shader.setUniformValue("add_ambiant_occlusion",
+                         add_ambiant_occlusion &&
+                             this->sp_texture_manager->get(QTR_TEX_AO)->is_active());
   shader.setUniformValue("ambiant_occlusion_strength", ambiant_occlusion_strength);
   shader.setUniformValue("ambiant_occlusion_radius", ambiant_occlusion_radius);
 
   // Rendering settings
   shader.setUniformValue("has_instances", false);
+  shader.setUniformValue("implicit_grid", false);
+  shader.setUniformValue("cdlod", false);
+  shader.setUniformValue("compact_vertex", false);
   shader.setUniformValue("scale_h", scale_h);
   shader.setUniformValue("hmap_h0", this->hmap_h0);
   shader.setUniformValue("hmap_h", this->hmap_h);
+  shader.setUniformValue("hmap_w", this->hmap_w);
+  shader.setUniformValue("hmap_tex_decode", toQVec(this->get_heightmap_decode()));
   shader.setUniformValue("normal_visualization", normal_visualization);
   shader.setUniformValue("normal_map_scaling", 0.f); // reset by default
   shader.setUniformValue("gamma_correction", gamma_correction);
@@ -435,6 +812,102 @@ void RenderWidget::set_common_uniforms(QOpenGLShaderProgram &shader,
   shader.setUniformValue("spec_strength", 0.f);
 }
 
+void RenderWidget::apply_heightmap_geometry(std::vector<float> data,
+                                            int                width,
+                                            int                height,
+                                            bool               add_skirt,
+                                            const RasterView  *p_texture_data)
+{
+  bool same_shape = this->hmap.is_active() && width == this->current_width &&
+                    height == this->current_height &&
+                    add_skirt == this->current_add_skirt_state;
+
+  // same layout, only update what changed if it is worth it
+  if (!this->hmap_data.empty() && width == this->current_width &&
+      height == this->current_height && add_skirt == this->current_add_skirt_state &&
+      (int)data.size() == width * height)
+  {
+    std::vector<glm::ivec4> rects = find_changed_regions(this->hmap_data,
+                                                         data,
+                                                         width,
+                                                         height);
+    size_t                  area = 0;
+
+    for (auto &r : rects)
+      area += (size_t)(r.z - r.x) * (r.w - r.y);
+
+    if (2 * area < (size_t)width * height)
+    {
+      qtr::Logger::log()->trace(
+          "RenderWidget::apply_heightmap_geometry: {} changed region(s), {} texels",
+          rects.size(),
+          area);
+
+      float old_regions_min = FLT_MAX;
+
+      for (auto &r : rects)
+        for (int j = r.y; j < r.w; ++j)
+        {
+          size_t k0 = (size_t)j * width + r.x;
+          size_t k1 = (size_t)j * width + r.z;
+
+          old_regions_min = std::min(
+              old_regions_min,
+              *std::min_element(this->hmap_data.begin() + k0,
+                                this->hmap_data.begin() + k1));
+        }
+
+      // identical outside of the regions
+      this->hmap_data = std::move(data);
+
+      if (!rects.empty())
+        this->update_terrain_regions(rects, old_regions_min);
+
+      return;
+    }
+  }
+
+  this->hmap_data = std::move(data);
+  this->hmap_rtin.clear(); // new data, new error hierarchy
+  this->current_width = width;
+  this->current_height = height;
+  this->current_add_skirt_state = add_skirt;
+
+  this->update_terrain_geometry(!same_shape);
+
+  qtr::Logger::log()->trace("RenderWidget::apply_heightmap_geometry: w x h = {} x {}",
+                            width,
+                            height);
+
+  // also generate the heightmap texture
+  if (p_texture_data)
+  {
+    if (Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP))
+      p_tex->from_raster(*p_texture_data);
+  }
+  else
+    this->upload_heightmap_texture();
+
+  this->hmap_pyramid.build(this->hmap_data, width, height);
+  this->upload_heightmap_pyramid();
+  this->need_ao_update = true;
+  this->need_horizon_update = true;
+  this->need_flow_update = true;
+  this->need_shadow_map_update = true;
+
+  this->need_update = true;
+}
+
+void RenderWidget::cancel_heightmap_build()
+{
+  // generation bumped first, a build finishing in between can then not
+  // store its result after the reset
+  this->hmap_build_worker.cancel();
+
+  std::lock_guard<std::mutex> lock(this->hmap_build_mutex);
+  this->hmap_build.reset();
+}
+
 void RenderWidget::set_heightmap_geometry(const std::vector<float> &data,
                                           int                       width,
                                           int                       height,
@@ -442,44 +915,158 @@ void RenderWidget::set_heightmap_geometry(const std::vector<float> &data,
 {
   qtr::Logger::log()->trace("RenderWidget::set_heightmap_geometry");
 
+  // latest wins, also over asynchronous builds
+  this->cancel_heightmap_build();
+
+  const uint64_t key = this->get_heightmap_key(RasterView(data, width, height),
+                                               add_skirt);
+
+  if (this->is_upload_skipped(key, this->hmap_key, this->is_heightmap_uploaded()))
+    return;
+
   this->makeCurrent();
+  this->apply_heightmap_geometry(data, width, height, add_skirt);
+  this->hmap_key = key;
+  this->doneCurrent();
+}
 
-  generate_heightmap(this->hmap,
-                     data,
-                     width,
-                     height,
-                     0.f,
-                     this->hmap_h0,
-                     0.f,
-                     this->hmap_w,
-                     this->hmap_h,
-                     this->hmap_w,
-                     add_skirt,
-                     /* add_level */ 0.f,
-                     /* exclude_below */ -FLT_MAX,
-                     &this->hmap_hmin);
+void RenderWidget::set_heightmap_geometry(const RasterView &data, bool add_skirt)
+{
+  qtr::Logger::log()->trace("RenderWidget::set_heightmap_geometry");
 
-  // regenerate plane
-  generate_plane(this->plane,
-                 0.f,
-                 this->hmap_hmin * this->hmap_h - 1e-3f,
-                 0.f,
-                 2000.f * this->hmap_w,
-                 2000.f * this->hmap_w);
+  if (!data.is_valid() || data.get_channels() != 1)
+  {
+    qtr::Logger::log()->error(
+        "RenderWidget::set_heightmap_geometry: inconsistent or multi-channel raster");
+    return;
+  }
 
-  qtr::Logger::log()->trace("RenderWidget::set_heightmap_geometry: w x h = {} x {}",
-                            width,
-                            height);
+  this->cancel_heightmap_build();
 
-  // also generate the heightmap texture /!\ texture of float, scaled
-  // as the input, not scaled as what the OpenGL sees (there is an
-  // additional this->hmap_h scaling for OpenGL)
-  if (this->sp_texture_manager->get(QTR_TEX_HMAP))
-    this->sp_texture_manager->get(QTR_TEX_HMAP)->from_float_vector(data, width);
-  this->need_update = true;
+  const uint64_t key = this->get_heightmap_key(data, add_skirt);
+
+  if (this->is_upload_skipped(key, this->hmap_key, this->is_heightmap_uploaded()))
+    return;
+
+  this->makeCurrent();
+  this->apply_heightmap_geometry(data.to_float_vector(),
+                                 data.get_width(),
+                                 data.get_height(),
+                                 add_skirt,
+                                 &data);
+  this->hmap_key = key;
   this->doneCurrent();
 }
 
+void RenderWidget::set_heightmap_geometry_async(std::vector<float> data,
+                                                int                width,
+                                                int                height,
+                                                bool               add_skirt)
+{
+  qtr::Logger::log()->trace("RenderWidget::set_heightmap_geometry_async");
+
+  const uint64_t key = this->get_heightmap_key(RasterView(data, width, height),
+                                               add_skirt);
+
+  if (this->is_upload_skipped(key, this->hmap_key, this->is_heightmap_uploaded()))
+  {
+    // a pending build would replace the current terrain
+    this->cancel_heightmap_build();
+    return;
+  }
+
+  auto sp_build = std::make_unique<HeightmapBuild>();
+
+  sp_build->data = std::move(data);
+  sp_build->width = width;
+  sp_build->height = height;
+  sp_build->add_skirt = add_skirt;
+  sp_build->mode = this->terrain_render_mode;
+  sp_build->compact_vertices = this->terrain_compact_vertices;
+  sp_build->key = key;
+
+  // geometry parameters read here, on the GUI thread
+  const float y = this->hmap_h0;
+  const float lx = this->hmap_w;
+  const float ly = this->hmap_h;
+
+  // std::function needs a copyable callable
+  std::shared_ptr<HeightmapBuild> sp_task_build = std::move(sp_build);
+
+  this->hmap_build_worker.submit(
+      [this, sp_task_build, y, lx, ly](uint64_t generation)
+      {
+        const auto t0 = std::chrono::steady_clock::now();
+
+        auto is_cancelled = [this, generation]()
+        { return this->hmap_build_worker.is_cancelled(generation); };
+
+        HeightmapBuild &build = *sp_task_build;
+
+        // only the modes with a significant CPU side, the other ones
+        // are built at upload
+        if (build.mode == TerrainRenderMode::TERRAIN_MESH)
+        {
+          if (!build_heightmap_mesh_data(build.mesh_data,
+                                         build.data,
+                                         build.width,
+                                         build.height,
+                                         0.f,
+                                         y,
+                                         0.f,
+                                         lx,
+                                         ly,
+                                         lx,
+                                         build.add_skirt,
+                                         /* add_level */ 0.f,
+                                         /* exclude_below */ -FLT_MAX,
+                                         build.compact_vertices,
+                                         is_cancelled))
+            return;
+        }
+        else if (build.mode == TerrainRenderMode::TERRAIN_RTIN)
+        {
+          build.rtin.build(build.data, build.width, build.height);
+        }
+
+        if (build.mode == TerrainRenderMode::TERRAIN_MESH ||
+            build.mode == TerrainRenderMode::TERRAIN_RTIN)
+          build.pyramid.build(build.data, build.width, build.height);
+
+        std::lock_guard<std::mutex> lock(this->hmap_build_mutex);
+
+        if (is_cancelled())
+        {
+          qtr::Logger::log()->trace("RenderWidget::set_heightmap_geometry_async: "
+                                    "build {} cancelled",
+                                    generation);
+          return;
+        }
+
+        this->hmap_build = std::make_unique<HeightmapBuild>(std::move(build));
+
+        const auto t1 = std::chrono::steady_clock::now();
+
+        qtr::Logger::log()->trace(
+            "RenderWidget::set_heightmap_geometry_async: build {} ready, {} ms",
+            generation,
+            std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+      });
+}
+
+void RenderWidget::set_heightmap_texture_precision(TexturePrecision new_precision)
+{
+  if (new_precision == this->hmap_texture_precision)
+    return;
+
+  this->hmap_texture_precision = new_precision;
+
+  // texture uploaded again at the next paintGL, with the GL context
+  // current
+  this->need_hmap_texture_update = true;
+  this->need_update = true;
+}
+
 void RenderWidget::set_leaves(const std::vector<float> &x,
                               const std::vector<float> &y,
                               const std::vector<float> &h,
@@ -513,6 +1100,7 @@ void RenderWidget::set_leaves(const std::vector<float> &x,
   generate_grass_leaf_2sided(*mesh, glm::vec3(0.f, 0.f, 0.f), r, 0.1f * r);
 
   this->leaves_instanced_mesh.create(mesh, instances);
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -666,21 +1254,63 @@ void RenderWidget::set_rocks(const std::vector<float> &x,
   generate_rock(*mesh, 1.f, 0.3f, 0);
 
   this->rocks_instanced_mesh.create(mesh, instances);
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
 
+void RenderWidget::set_terrain_render_mode(const TerrainRenderMode &new_mode)
+{
+  if (new_mode == this->terrain_render_mode)
+    return;
+
+  this->terrain_render_mode = new_mode;
+
+  // terrain geometry rebuilt at the next paintGL, with the GL context
+  // current
+  this->need_terrain_update = true;
+  this->need_update = true;
+}
+
 void RenderWidget::set_texture(const std::string          &name,
                                const std::vector<uint8_t> &data,
                                int                         width)
 {
   qtr::Logger::log()->trace("RenderWidget::set_texture: {}", name);
 
+  Texture       *p_tex = this->sp_texture_manager->get(name);
+  const int      height = width > 0 ? (int)data.size() / 4 / width : 0;
+  const uint64_t key = get_texture_key(RasterView(data, width, height, 4));
+
+  if (this->is_upload_skipped(key, this->texture_keys[name], p_tex && p_tex->is_active()))
+    return;
+
   this->makeCurrent();
 
-  if (this->sp_texture_manager->get(name))
-    this->sp_texture_manager->get(name)->from_image_8bit_rgba(data, width);
+  if (p_tex)
+  {
+    p_tex->from_image_8bit_rgba(data, width);
+    this->texture_keys[name] = key;
+  }
+  this->need_update = true;
+}
+
+void RenderWidget::set_texture(const std::string &name, const RasterView &data)
+{
+  qtr::Logger::log()->trace("RenderWidget::set_texture: {}", name);
+
+  Texture       *p_tex = this->sp_texture_manager->get(name);
+  const uint64_t key = get_texture_key(data);
+
+  if (this->is_upload_skipped(key, this->texture_keys[name], p_tex && p_tex->is_active()))
+    return;
+
+  this->makeCurrent();
+
+  if (p_tex && p_tex->from_raster(data))
+    this->texture_keys[name] = key;
   this->need_update = true;
+  this->doneCurrent();
 }
 
 void RenderWidget::set_trees(const std::vector<float> &x,
@@ -716,6 +1346,7 @@ void RenderWidget::set_trees(const std::vector<float> &x,
   generate_tree(*mesh, r, 0.1f * r, 5.f * r, r, 5);
 
   this->trees_instanced_mesh.create(mesh, instances);
+  this->need_shadow_map_update = true;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -724,28 +1355,62 @@ void RenderWidget::set_water_geometry(const std::vector<float> &data,
                                       int                       width,
                                       int                       height,
                                       float                     exclude_below)
+{
+  this->set_water_geometry(RasterView(data, width, height), exclude_below);
+}
+
+void RenderWidget::set_water_geometry(const RasterView &data, float exclude_below)
 {
   qtr::Logger::log()->trace("RenderWidget::set_water_geometry");
 
+  if (!data.is_valid() || data.get_channels() != 1)
+  {
+    qtr::Logger::log()->error(
+        "RenderWidget::set_water_geometry: inconsistent or multi-channel raster");
+    return;
+  }
+
+  const uint64_t key = hash_values(data.get_hash(),
+                                   exclude_below,
+                                   this->hmap_h0,
+                                   this->hmap_w,
+                                   this->hmap_h);
+
+  if (this->is_upload_skipped(key, this->water_key, this->water_mesh.is_active()))
+    return;
+
   this->makeCurrent();
 
   bool  add_skirt = false;
   float add_level = 0.f;
 
-  generate_heightmap(this->water_mesh,
-                     data,
-                     width,
-                     height,
-                     0.f,
-                     this->hmap_h0,
-                     0.f,
-                     this->hmap_w,
-                     this->hmap_h,
-                     this->hmap_w,
-                     add_skirt,
-                     add_level,
-                     exclude_below);
-
+  HeightmapMeshData mesh_data;
+
+  build_heightmap_mesh_data(mesh_data,
+                            data,
+                            0.f,
+                            this->hmap_h0,
+                            0.f,
+                            this->hmap_w,
+                            this->hmap_h,
+                            this->hmap_w,
+                            add_skirt,
+                            add_level,
+                            exclude_below);
+
+  // same triangles (e.g. only the elevations changed), vertices
+  // rewritten in place through the streaming ring
+  const uint64_t topology_key = hash_bytes(mesh_data.indices.data(),
+                                           mesh_data.indices.size() * sizeof(uint),
+                                           mesh_data.vertices.size());
+
+  if (this->water_mesh.is_active() && topology_key == this->water_topology_key)
+    this->water_mesh.update_vertices(mesh_data.vertices);
+  else
+    create_heightmap_mesh(this->water_mesh, std::move(mesh_data));
+
+  this->water_key = key;
+  this->water_topology_key = topology_key;
   this->need_update = true;
   this->doneCurrent();
 }
@@ -803,10 +1468,503 @@ void RenderWidget::update_light()
   }
 }
 
+void RenderWidget::update_heightmap_ao()
+{
+  this->need_ao_update = false;
+
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_AO);
+
+  if (!p_tex || this->hmap_data.empty())
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  compute_heightmap_ao(this->hmap_ao,
+                       this->hmap_data,
+                       this->current_width,
+                       this->current_height,
+                       this->ambiant_occlusion_radius);
+
+  p_tex->from_float_vector(this->hmap_ao, this->current_width, PRECISION_HALF);
+
+  const auto t1 = std::chrono::steady_clock::now();
+
+  qtr::Logger::log()->trace(
+      "RenderWidget::update_heightmap_ao: {} ms",
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+void RenderWidget::update_heightmap_region(int                       x,
+                                           int                       y,
+                                           int                       w,
+                                           int                       h,
+                                           const std::vector<float> &patch)
+{
+  qtr::Logger::log()->trace("RenderWidget::update_heightmap_region");
+
+  if (this->hmap_data.empty() || x < 0 || y < 0 || w <= 0 || h <= 0 ||
+      x + w > this->current_width || y + h > this->current_height ||
+      (int)patch.size() != w * h)
+  {
+    qtr::Logger::log()->error(
+        "RenderWidget::update_heightmap_region: invalid region or no heightmap");
+    return;
+  }
+
+  this->hmap_key = 0;
+  this->makeCurrent();
+
+  float old_regions_min = FLT_MAX;
+
+  for (int j = 0; j < h; ++j)
+  {
+    auto it_row = this->hmap_data.begin() + (size_t)(y + j) * this->current_width + x;
+
+    old_regions_min = std::min(old_regions_min, *std::min_element(it_row, it_row + w));
+    std::copy(patch.begin() + (size_t)j * w, patch.begin() + (size_t)(j + 1) * w, it_row);
+  }
+
+  this->update_terrain_regions({glm::ivec4(x, y, x + w, y + h)}, old_regions_min);
+
+  this->doneCurrent();
+}
+
+void RenderWidget::update_horizon_map()
+{
+  this->need_horizon_update = false;
+
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HORIZON);
+
+  if (!p_tex || this->hmap_data.empty())
+    return;
+
+  const int nsectors = 16;
+
+  std::vector<uint8_t> horizons;
+  compute_horizon_map(horizons,
+                      this->hmap_data,
+                      this->current_width,
+                      this->current_height,
+                      nsectors);
+
+  p_tex->from_layers_rgba8(horizons,
+                           this->current_width,
+                           this->current_height,
+                           nsectors / 4);
+}
+
+void RenderWidget::update_plane_geometry()
+{
+  generate_plane(this->plane,
+                 0.f,
+                 this->hmap_hmin * this->hmap_h - 1e-3f,
+                 0.f,
+                 2000.f * this->hmap_w,
+                 2000.f * this->hmap_w);
+
+  this->need_shadow_map_update = true;
+}
+
+void RenderWidget::upload_heightmap_build()
+{
+  std::unique_ptr<HeightmapBuild> sp_build;
+
+  {
+    std::lock_guard<std::mutex> lock(this->hmap_build_mutex);
+    sp_build = std::move(this->hmap_build);
+  }
+
+  if (!sp_build)
+    return;
+
+  qtr::Logger::log()->trace("RenderWidget::upload_heightmap_build");
+
+  // render mode or vertex layout changed since the submission, the CPU
+  // side is redone here
+  bool prebuilt = sp_build->mode == this->terrain_render_mode &&
+                  sp_build->compact_vertices == this->terrain_compact_vertices &&
+                  (sp_build->mode == TerrainRenderMode::TERRAIN_MESH ||
+                   sp_build->mode == TerrainRenderMode::TERRAIN_RTIN);
+
+  this->hmap_key = sp_build->key;
+
+  if (!prebuilt)
+  {
+    this->apply_heightmap_geometry(std::move(sp_build->data),
+                                   sp_build->width,
+                                   sp_build->height,
+                                   sp_build->add_skirt);
+    return;
+  }
+
+  this->hmap_data = std::move(sp_build->data);
+  this->current_width = sp_build->width;
+  this->current_height = sp_build->height;
+  this->current_add_skirt_state = sp_build->add_skirt;
+
+  if (sp_build->mode == TerrainRenderMode::TERRAIN_RTIN)
+  {
+    // only the extraction is left
+    this->hmap_rtin = std::move(sp_build->rtin);
+    this->update_terrain_geometry(false);
+  }
+  else
+  {
+    this->need_terrain_update = false;
+    this->hmap_rtin.clear();
+    this->hmap_hmin = sp_build->mesh_data.hmin;
+    this->hmap_hmax = sp_build->mesh_data.hmax;
+
+    create_heightmap_mesh(this->hmap, std::move(sp_build->mesh_data));
+
+    this->update_terrain_stats();
+    this->update_plane_geometry();
+  }
+
+  this->hmap_pyramid = std::move(sp_build->pyramid);
+
+  this->upload_heightmap_texture();
+  this->upload_heightmap_pyramid();
+  this->need_ao_update = true;
+  this->need_horizon_update = true;
+  this->need_flow_update = true;
+  this->need_shadow_map_update = true;
+  this->need_update = true;
+}
+
+void RenderWidget::upload_heightmap_pyramid()
+{
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP_MINMAX);
+
+  if (!p_tex)
+    return;
+
+  if (this->hmap_pyramid.is_empty())
+  {
+    p_tex->destroy();
+    return;
+  }
+
+  const glm::ivec2 shape = this->hmap_pyramid.get_level_shape(0);
+  p_tex->from_vec2_levels(this->hmap_pyramid.get_levels(), shape.x, shape.y);
+}
+
+void RenderWidget::upload_heightmap_texture()
+{
+  this->need_hmap_texture_update = false;
+
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP);
+
+  if (!p_tex || this->hmap_data.empty())
+    return;
+
+  // /!\ texture of the elevations scaled as the input, not as what the
+  // OpenGL sees (there is an additional this->hmap_h scaling for OpenGL)
+  p_tex->from_float_vector(this->hmap_data,
+                           this->current_width,
+                           this->hmap_texture_precision);
+
+  this->need_shadow_map_update = true;
+}
+
+void RenderWidget::update_terrain_geometry(bool rebuild_grid)
+{
+  this->need_terrain_update = false;
+  this->need_shadow_map_update = true;
+
+  if (this->hmap_data.empty())
+    return;
+
+  if (this->terrain_render_mode != TerrainRenderMode::TERRAIN_TILED_MESH)
+    this->hmap_tiles.clear();
+  if (this->terrain_render_mode != TerrainRenderMode::TERRAIN_CDLOD)
+    this->hmap_cdlod.clear();
+  if (this->terrain_render_mode != TerrainRenderMode::TERRAIN_RTIN)
+    this->hmap_rtin.clear();
+  if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_TILED_MESH ||
+      this->terrain_render_mode == TerrainRenderMode::TERRAIN_CDLOD)
+    this->hmap.destroy();
+
+  // elevation bounds (skirts, plane, shadow cascades), also output by
+  // the mesh generators
+  const auto [it_min, it_max] = std::minmax_element(this->hmap_data.begin(),
+                                                    this->hmap_data.end());
+  this->hmap_hmin = *it_min;
+  this->hmap_hmax = *it_max;
+
+  if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_IMPLICIT_GRID)
+  {
+    // the grid indices only depend on the heightmap shape
+    if (rebuild_grid)
+      generate_heightmap_implicit_grid(this->hmap,
+                                       this->current_width,
+                                       this->current_height,
+                                       this->current_add_skirt_state);
+  }
+  else if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_TILED_MESH)
+  {
+    generate_heightmap_tiles(this->hmap_tiles,
+                             this->hmap_data,
+                             this->current_width,
+                             this->current_height,
+                             this->terrain_tile_size,
+                             0.f,
+                             this->hmap_h0,
+                             0.f,
+                             this->hmap_w,
+                             this->hmap_h,
+                             this->hmap_w,
+                             this->current_add_skirt_state,
+                             &this->hmap_hmin);
+  }
+  else if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_CDLOD)
+  {
+    // no skirt, morphing keeps the LOD levels watertight
+    this->hmap_cdlod.build(this->hmap_data, this->current_width, this->current_height);
+  }
+  else if (this->terrain_render_mode == TerrainRenderMode::TERRAIN_RTIN)
+  {
+    // the error hierarchy only depends on the data, a new error
+    // tolerance only needs a new extraction
+    if (this->hmap_rtin.is_empty())
+      this->hmap_rtin.build(this->hmap_data, this->current_width, this->current_height);
+
+    generate_heightmap_rtin(this->hmap,
+                            this->hmap_rtin,
+                            this->hmap_data,
+                            0.f,
+                            this->hmap_h0,
+                            0.f,
+                            this->hmap_w,
+                            this->hmap_h,
+                            this->hmap_w,
+                            this->rtin_max_error,
+                            this->current_add_skirt_state,
+                            /* add_level */ 0.f,
+                            &this->hmap_hmin);
+  }
+  else
+  {
+    generate_heightmap(this->hmap,
+                       this->hmap_data,
+                       this->current_width,
+                       this->current_height,
+                       0.f,
+                       this->hmap_h0,
+                       0.f,
+                       this->hmap_w,
+                       this->hmap_h,
+                       this->hmap_w,
+                       this->current_add_skirt_state,
+                       /* add_level */ 0.f,
+                       /* exclude_below */ -FLT_MAX,
+                       &this->hmap_hmin,
+                       this->terrain_compact_vertices,
+                       &this->hmap_hmax);
+  }
+
+  this->update_terrain_stats();
+  this->update_plane_geometry();
+}
+
+void RenderWidget::update_terrain_stats()
+{
+  this->stats.terrain_tiles = (int)this->hmap_tiles.size();
+  this->stats.terrain_lod_levels = this->hmap_cdlod.get_level_count();
+  this->stats.terrain_vertex_bytes = this->hmap.get_vertex_buffer_size();
+
+  for (auto &sp_tile : this->hmap_tiles)
+    this->stats.terrain_vertex_bytes += sp_tile->mesh.get_vertex_buffer_size();
+}
+
+void RenderWidget::update_terrain_regions(const std::vector<glm::ivec4> &rects,
+                                          float old_regions_min)
+{
+  const int w = this->current_width;
+  const int h = this->current_height;
+
+  // new min: lower within the regions, or to be searched again if the
+  // previous one may have been overwritten
+  float hmin = this->hmap_hmin;
+  float regions_min = FLT_MAX;
+
+  for (auto &r : rects)
+    for (int j = r.y; j < r.w; ++j)
+      regions_min = std::min(
+          regions_min,
+          *std::min_element(this->hmap_data.begin() + (size_t)j * w + r.x,
+                            this->hmap_data.begin() + (size_t)j * w + r.z));
+
+  if (regions_min <= hmin)
+    hmin = regions_min;
+  else if (old_regions_min <= hmin)
+    hmin = *std::min_element(this->hmap_data.begin(), this->hmap_data.end());
+
+  const bool hmin_changed = hmin != this->hmap_hmin;
+  this->hmap_hmin = hmin;
+
+  switch (this->terrain_render_mode)
+  {
+  case TerrainRenderMode::TERRAIN_MESH:
+    if (this->hmap.get_grid_layout().width == 0) // compact vertices
+    {
+      this->update_terrain_geometry(false);
+      break;
+    }
+
+    for (auto &r : rects)
+      update_heightmap_elevation_region(this->hmap,
+                                        this->hmap_data,
+                                        w,
+                                        h,
+                                        r.x,
+                                        r.y,
+                                        r.z,
+                                        r.w,
+                                        this->hmap_h0,
+                                        this->hmap_w,
+                                        this->hmap_h,
+                                        this->hmap_w,
+                                        this->hmap_hmin);
+    break;
+
+  case TerrainRenderMode::TERRAIN_IMPLICIT_GRID:
+    break; // everything is read from the texture
+
+  case TerrainRenderMode::TERRAIN_CDLOD:
+    for (auto &r : rects)
+      this->hmap_cdlod.update_region(this->hmap_data, r.x, r.y, r.z, r.w);
+    break;
+
+  default:
+    // tiles and RTIN meshes are rebuilt
+    this->hmap_rtin.clear();
+    this->update_terrain_geometry(false);
+  }
+
+  if (Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP))
+    for (auto &r : rects)
+      if (!p_tex->update_region(this->hmap_data, r.x, r.y, r.z - r.x, r.w - r.y))
+      {
+        // e.g. out of the range of a 16-bit normalized texture
+        this->upload_heightmap_texture();
+        break;
+      }
+
+  // min/max pyramid, only the cells over the regions, its top level
+  // giving the new max (the min being needed before, for the skirts)
+  {
+    Texture                *p_tex = this->sp_texture_manager->get(QTR_TEX_HMAP_MINMAX);
+    std::vector<glm::ivec4> level_rects;
+
+    for (auto &r : rects)
+    {
+      this->hmap_pyramid.update_region(this->hmap_data, r.x, r.y, r.z, r.w, &level_rects);
+
+      if (p_tex)
+        for (size_t l = 0; l < level_rects.size(); ++l)
+        {
+          const glm::ivec4 &c = level_rects[l];
+
+          p_tex->update_level_region((int)l,
+                                     this->hmap_pyramid.get_level((int)l),
+                                     c.x,
+                                     c.y,
+                                     c.z - c.x,
+                                     c.w - c.y);
+        }
+    }
+
+    if (!this->hmap_pyramid.is_empty())
+      this->hmap_hmax = this->hmap_pyramid.query(0, 0, w - 1, h - 1).y;
+  }
+
+  // baked ambient occlusion, around the regions only. When disabled, it
+  // is rebaked as a whole once enabled again
+  if (!this->add_ambiant_occlusion || this->hmap_ao.empty())
+    this->need_ao_update = true;
+  else if (!this->need_ao_update)
+  {
+    Texture  *p_tex = this->sp_texture_manager->get(QTR_TEX_AO);
+    const int margin = get_heightmap_ao_margin(w, h, this->ambiant_occlusion_radius);
+
+    for (auto &r : rects)
+    {
+      const int i0 = std::max(r.x - margin, 0);
+      const int j0 = std::max(r.y - margin, 0);
+      const int i1 = std::min(r.z + margin, w);
+      const int j1 = std::min(r.w + margin, h);
+
+      compute_heightmap_ao(this->hmap_ao,
+                           this->hmap_data,
+                           w,
+                           h,
+                           this->ambiant_occlusion_radius,
+                           i0,
+                           j0,
+                           i1,
+                           j1);
+
+      if (p_tex)
+        p_tex->update_region(this->hmap_ao, i0, j0, i1 - i0, j1 - j0);
+    }
+  }
+
+  // horizons depend on the whole lines through the regions, rebaked
+  // as a whole
+  this->need_horizon_update = true;
+  this->need_flow_update = true;
+  this->need_shadow_map_update = true;
+
+  if (hmin_changed)
+    this->update_plane_geometry();
+
+  this->need_update = true;
+}
+
 void RenderWidget::update_time()
 {
   this->dt = static_cast<float>(this->timer.restart()) / 1000.0f;
   this->time += this->dt;
 }
 
+void RenderWidget::update_water_textures()
+{
+  // shore flow, from the heightmap
+  if (this->need_flow_update && !this->hmap_data.empty())
+  {
+    this->need_flow_update = false;
+
+    std::vector<uint8_t> flow;
+    compute_flow_texture(flow,
+                         this->hmap_data,
+                         this->current_width,
+                         this->current_height);
+
+    if (Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_FLOW))
+      p_tex->from_image_8bit_rgba(flow, this->current_width);
+  }
+
+  // waves, baked for all the directions, only the spread changes them
+  uint64_t key = hash_values(0, this->angle_spread_ratio, this->waves_tile_cells);
+
+  if (key != this->waves_key)
+  {
+    const int resolution = 256;
+    const int ndirs = 8;
+
+    std::vector<uint8_t> waves;
+    compute_wave_texture(waves,
+                         resolution,
+                         this->waves_tile_cells,
+                         this->angle_spread_ratio,
+                         ndirs);
+
+    if (Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_WAVES))
+      p_tex->from_layers_rgba8(waves, resolution, resolution, ndirs / 4, true);
+
+    this->waves_key = key;
+  }
+}
+
 } // namespace qtr
@@ -0,0 +1,64 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtr/windows_patch.hpp"
+
+#include "qtr/render_widget.hpp"
+
+namespace qtr
+{
+
+void RenderWidget::render_scattering(const glm::mat4 &model, const glm::mat4 &projection)
+{
+  QOpenGLShaderProgram *p_shader = this->sp_shader_manager->get("scattering")->get();
+
+  if (p_shader)
+  {
+    Texture *p_depth = this->sp_texture_manager->get(QTR_TEX_DEPTH);
+    Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_SCATTERING);
+
+    // backup FBO state to avoid messing up with others FBO (ImGUI
+    // for instance...)
+    GLint previous_fbo;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo_scattering);
+
+    // one texel per depth map texel, see render_depth_map
+    if (p_tex->get_width() != p_depth->get_width() ||
+        p_tex->get_height() != p_depth->get_height() || !p_tex->is_active())
+    {
+      p_tex->generate_color_texture(p_depth->get_width(), p_depth->get_height());
+      glFramebufferTexture2D(GL_FRAMEBUFFER,
+                             GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D,
+                             p_tex->get_id(),
+                             0);
+    }
+
+    glViewport(0, 0, p_tex->get_width(), p_tex->get_height());
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    // once per pixel, whatever the overdraw of the lit pass
+    glm::mat4 view = this->camera.get_view_matrix();
+
+    p_shader->bind();
+
+    this->set_common_uniforms(*p_shader, model, projection, view);
+    p_shader->setUniformValue("inv_view_projection",
+                              toQMat(glm::inverse(projection * view)));
+
+    this->fullscreen_triangle.draw();
+
+    this->unbind_textures();
+    p_shader->release();
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // set previous FBO back
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+  }
+}
+
+} // namespace qtr
@@ -2,32 +2,140 @@
    License. The full license is in the file LICENSE, distributed with this software. */
 #include "qtr/windows_patch.hpp"
 
+#include <algorithm>
+
 #include "qtr/render_widget.hpp"
 
 namespace qtr
 {
 
-void RenderWidget::render_shadow_map(const glm::mat4 &model,
-                                     glm::mat4       &light_space_matrix)
+void RenderWidget::render_shadow_map(const glm::mat4 &model, float aspect_ratio)
 {
-  // shadow depth pass, camera at the light position
-  this->camera_shadow_pass.position = this->light.position;
-  this->camera_shadow_pass.near_plane = 0.f;
-  this->camera_shadow_pass.far_plane = 100.f;
+  Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_SHADOW_MAP);
 
-  float     ortho_size = 1.5f; // TODO hardcoded
-  glm::mat4 light_projection = this->camera_shadow_pass.get_projection_matrix_ortho(
-      ortho_size);
-  glm::mat4 light_view = this->camera_shadow_pass.get_view_matrix();
-  light_space_matrix = light_projection * light_view;
+  // one layer per cascade, reallocated when the settings change
+  const int res = this->shadow_map_resolution;
+  const int count = std::clamp(this->shadow_cascade_count, 1, QTR_MAX_SHADOW_CASCADES);
 
-  QOpenGLShaderProgram *p_shader = this->sp_shader_manager->get("shadow_map_depth_pass")
-                                       ->get();
+  if (p_tex->get_width() != res || p_tex->get_layer_count() != count ||
+      !p_tex->is_active())
+  {
+    p_tex->generate_depth_texture_array(res, res, count, true, true);
+    this->need_shadow_map_update = true;
+  }
 
-  if (p_shader)
+  // moments of the variance shadow map, same layers, the depth array
+  // still being the depth buffer
+  Texture   *p_moments = this->sp_texture_manager->get(QTR_TEX_SHADOW_MOMENTS);
+  Texture   *p_blur = this->sp_texture_manager->get(QTR_TEX_SHADOW_MOMENTS_BLUR);
+  const bool use_moments = this->shadow_filter == ShadowFilter::SHADOW_FILTER_VSM;
+
+  if (use_moments && (p_moments->get_width() != res ||
+                      p_moments->get_layer_count() != count || !p_moments->is_active()))
+  {
+    p_moments->generate_moments_texture_array(res, res, count);
+    p_blur->generate_moments_texture_array(res, res, 1); // one layer at a time
+    this->need_shadow_map_update = true;
+  }
+  else if (!use_moments && p_moments->is_active())
+  {
+    p_moments->destroy();
+    p_blur->destroy();
+    this->need_shadow_map_update = true;
+  }
+
+  // terrain bounds, world space
+  const float     half_w = 0.5f * this->hmap_w;
+  const float     y0 = (this->hmap_h0 + this->hmap_hmin * this->hmap_h) * this->scale_h;
+  const float     y1 = (this->hmap_h0 + this->hmap_hmax * this->hmap_h) * this->scale_h;
+  const glm::vec3 forward = glm::normalize(this->camera.target - this->camera.position);
+
+  float max_distance = 0.f;
+
+  for (float x : {-half_w, half_w})
+    for (float y : {y0, y1})
+      for (float z : {-half_w, half_w})
+        max_distance = std::max(max_distance,
+                                glm::dot(glm::vec3(x, y, z) - this->camera.position,
+                                         forward));
+
+  const float scene_radius = glm::length(glm::vec3(half_w,
+                                                   std::max(std::abs(y0), std::abs(y1)),
+                                                   half_w)) +
+                             0.1f * this->hmap_w;
+
+  // directional light, toward the origin
+  std::vector<ShadowCascade> cascades = compute_shadow_cascades(this->camera,
+                                                                aspect_ratio,
+                                                                max_distance,
+                                                                -this->light.position,
+                                                                scene_radius,
+                                                                count,
+                                                                res);
+
+  if ((int)this->shadow_cascade_keys.size() != count)
+  {
+    this->shadow_cascade_keys.assign(count, 0);
+    this->shadow_cascade_ages.assign(count, 0);
+    this->shadow_cascades = cascades;
+    this->need_shadow_map_update = true;
+  }
+
+  // cached while nothing moved but the camera, as long as the drawn
+  // bounds still hold the slices
+  const uint64_t   key = this->get_shadow_map_key(model);
+  std::vector<int> layers; // cascades to draw
+  std::vector<int> stale;
+
+  for (int c = 0; c < count; ++c)
+  {
+    this->shadow_cascade_ages[c]++;
+
+    if (this->need_shadow_map_update || key != this->shadow_cascade_keys[c] ||
+        !shadow_cascade_contains(this->shadow_cascades[c], cascades[c]))
+      stale.push_back(c);
+  }
+
+  if (this->shadow_time_slicing && !this->need_shadow_map_update)
+  {
+    // the nearest cascade, then the oldest ones
+    std::stable_sort(stale.begin(),
+                     stale.end(),
+                     [this](int a, int b)
+                     {
+                       if ((a == 0) != (b == 0))
+                         return a == 0;
+                       return this->shadow_cascade_ages[a] > this->shadow_cascade_ages[b];
+                     });
+
+    int budget = std::max(0, this->shadow_cascade_budget);
+
+    for (int c : stale)
+      if (c == 0 || budget-- > 0)
+        layers.push_back(c);
+  }
+  else
+    layers = stale;
+
+  // splits from the current camera for all the cascades, the others
+  // keep the light space of their last drawing
+  for (int c = 0; c < count; ++c)
+    this->shadow_cascades[c].split_far = cascades[c].split_far;
+
+  this->stats.shadow_cascades_drawn = (int)layers.size();
+
+  if (layers.empty())
   {
-    Texture *p_tex = this->sp_texture_manager->get(QTR_TEX_SHADOW_MAP);
+    this->stats.skipped_shadow_passes++;
+    return;
+  }
+
+  const std::string     shader_id = use_moments ? "shadow_map_moments_pass"
+                                                  : "shadow_map_depth_pass";
+  QOpenGLShaderProgram *p_shader = this->sp_shader_manager->get(shader_id)->get();
 
+  if (p_shader)
+  {
     // backup FBO state to avoid messing up with others FBO (ImGUI
     // for instance...)
     GLint previous_fbo;
@@ -36,39 +144,137 @@ void RenderWidget::render_shadow_map(const glm::mat4 &model,
     glViewport(0, 0, p_tex->get_width(), p_tex->get_height());
     glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
 
-    glClear(GL_DEPTH_BUFFER_BIT);
+    glDrawBuffer(use_moments ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+    glClearColor(1.f, 1.f, 0.f, 0.f); // far depth, see generate_moments_texture_array
+
+    glDisable(GL_BLEND); // moments written as is, see setup_gl_state
     glEnable(GL_DEPTH_TEST);
     glCullFace(GL_FRONT);
 
     p_shader->bind();
-    p_shader->setUniformValue("light_space_matrix", toQMat(light_space_matrix));
     p_shader->setUniformValue("model", toQMat(model));
 
-    if (this->render_plane)
-      this->plane.draw();
+    this->stats.terrain_tiles_shadow_pass = 0;
+
+    for (int c : layers)
+    {
+      this->shadow_cascades[c] = cascades[c];
+      this->shadow_cascade_keys[c] = key;
+      this->shadow_cascade_ages[c] = 0;
+
+      const glm::mat4 &light_space_matrix = cascades[c].light_space_matrix;
+
+      glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                                GL_DEPTH_ATTACHMENT,
+                                p_tex->get_id(),
+                                0,
+                                c);
+      glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                                GL_COLOR_ATTACHMENT0,
+                                use_moments ? p_moments->get_id() : 0,
+                                0,
+                                c);
+      glClear(use_moments ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT
+                          : GL_DEPTH_BUFFER_BIT);
 
-    if (this->render_hmap)
-      this->hmap.draw();
+      p_shader->setUniformValue("light_space_matrix", toQMat(light_space_matrix));
 
-    // no water
+      if (this->render_plane)
+        this->plane.draw();
 
-    if (this->render_rocks)
-      this->rocks_instanced_mesh.draw(p_shader);
+      if (this->is_terrain_in_shadow_map())
+      {
+        // implicit grid elevations are read from the heightmap texture
+        Texture *p_hmap = this->sp_texture_manager->get(QTR_TEX_HMAP);
+        p_hmap->bind_and_set(*p_shader, "texture_" QTR_TEX_HMAP, 0);
 
-    if (this->render_leaves)
-      this->leaves_instanced_mesh.draw(p_shader);
+        // culled against the cascade bounds, LOD still from the camera
+        int ntiles = this->draw_terrain(*p_shader,
+                                        model,
+                                        light_space_matrix,
+                                        this->camera.position);
 
-    if (this->render_trees)
-      this->trees_instanced_mesh.draw(p_shader);
+        this->stats.terrain_tiles_shadow_pass += ntiles;
+
+        p_hmap->unbind();
+      }
+
+      // no water
+
+      if (this->render_rocks)
+        this->rocks_instanced_mesh.draw(p_shader);
+
+      if (this->render_leaves)
+        this->leaves_instanced_mesh.draw(p_shader);
+
+      if (this->render_trees)
+        this->trees_instanced_mesh.draw(p_shader);
+    }
 
     p_shader->release();
 
     glCullFace(GL_BACK);
+
+    if (use_moments)
+      this->render_shadow_map_blur(layers);
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // set previous FBO back
     glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+
+    this->need_shadow_map_update = false;
   }
 }
 
+void RenderWidget::render_shadow_map_blur(const std::vector<int> &layers)
+{
+  Texture *p_moments = this->sp_texture_manager->get(QTR_TEX_SHADOW_MOMENTS);
+  Texture *p_blur = this->sp_texture_manager->get(QTR_TEX_SHADOW_MOMENTS_BLUR);
+
+  QOpenGLShaderProgram *p_shader = this->sp_shader_manager->get("shadow_map_blur")->get();
+
+  if (!p_shader || this->shadow_blur_radius <= 0)
+    return;
+
+  // separable, layer by layer: horizontal pass to the single layer of
+  // p_blur, vertical pass back to the moments layer
+  const float texel = 1.f / (float)p_moments->get_width();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, this->fbo_shadow_blur);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glDisable(GL_DEPTH_TEST);
+
+  p_shader->bind();
+  p_shader->setUniformValue("radius", this->shadow_blur_radius);
+
+  for (int c : layers)
+  {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                              GL_COLOR_ATTACHMENT0,
+                              p_blur->get_id(),
+                              0,
+                              0);
+    p_moments->bind_and_set(*p_shader, "texture_source", 0);
+    p_shader->setUniformValue("source_layer", (float)c);
+    p_shader->setUniformValue("direction", QVector2D(texel, 0.f));
+    this->fullscreen_triangle.draw();
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                              GL_COLOR_ATTACHMENT0,
+                              p_moments->get_id(),
+                              0,
+                              c);
+    p_blur->bind_and_set(*p_shader, "texture_source", 0);
+    p_shader->setUniformValue("source_layer", 0.f);
+    p_shader->setUniformValue("direction", QVector2D(0.f, texel));
+    this->fullscreen_triangle.draw();
+  }
+
+  p_blur->unbind();
+  p_shader->release();
+
+  glEnable(GL_DEPTH_TEST);
+}
+
 } // namespace qtr
@@ -0,0 +1,258 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+#include "qtr/rtin.hpp"
+
+namespace qtr
+{
+
+void HeightmapRTIN::build(const std::vector<float> &data,
+                          int                       width,
+                          int                       height,
+                          float                     exclude_below)
+{
+  this->clear();
+
+  if (width < 2 || height < 2 || (int)data.size() < width * height)
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  this->width = width;
+  this->height = height;
+  this->size = 2;
+  while (this->size < std::max(width - 1, height - 1))
+    this->size *= 2;
+
+  const int n = this->size;
+  const int gs = n + 1;
+
+  // excluded texels
+  bool has_holes = false;
+
+  if (exclude_below > -FLT_MAX)
+  {
+    this->excluded.resize(width * height);
+
+    for (int k = 0; k < width * height; ++k)
+    {
+      this->excluded[k] = data[k] <= exclude_below ? 1 : 0;
+      has_holes |= this->excluded[k];
+    }
+
+    if (!has_holes)
+      this->excluded.clear();
+  }
+
+  // summed area table of the grid points that cannot be part of the
+  // mesh (padding or excluded texels)
+  const bool            has_invalid = has_holes || width != gs || height != gs;
+  std::vector<uint32_t> sat;
+
+  if (has_invalid)
+  {
+    sat.assign((size_t)(gs + 1) * (gs + 1), 0);
+
+    for (int j = 0; j < gs; ++j)
+    {
+      uint32_t row_sum = 0;
+
+      for (int i = 0; i < gs; ++i)
+      {
+        row_sum += this->is_valid(i, j) ? 0 : 1;
+        sat[(j + 1) * (gs + 1) + i + 1] = sat[j * (gs + 1) + i + 1] + row_sum;
+      }
+    }
+  }
+
+  auto elevation = [&](int i, int j)
+  { return (i < width && j < height) ? data[j * width + i] : 0.f; };
+
+  // error of the split point (mx, my) of hypotenuse (a, b), the two
+  // triangles sharing it span [mx - r, mx + r] x [my - r, my + r]
+  auto split_error = [&](int mx, int my, int ax, int ay, int bx, int by, int r)
+  {
+    if (has_invalid)
+    {
+      int x0 = std::max(mx - r, 0);
+      int x1 = std::min(mx + r, n) + 1;
+      int y0 = std::max(my - r, 0);
+      int y1 = std::min(my + r, n) + 1;
+
+      uint32_t count = sat[y1 * (gs + 1) + x1] - sat[y0 * (gs + 1) + x1] -
+                       sat[y1 * (gs + 1) + x0] + sat[y0 * (gs + 1) + x0];
+      uint32_t area = (uint32_t)((x1 - x0) * (y1 - y0));
+
+      if (count == area)
+        return 0.f; // nothing to draw there
+      else if (count > 0)
+        return FLT_MAX; // always refined, down to the holes / borders
+    }
+
+    return std::abs(0.5f * (elevation(ax, ay) + elevation(bx, by)) - elevation(mx, my));
+  };
+
+  this->errors.assign((size_t)gs * gs, 0.f);
+
+  float *err = this->errors.data();
+
+  // bottom-up, each level only reads the finer one so that points of
+  // a given level are processed in parallel. For each block size s:
+  // first the split points on the block edges (axis aligned
+  // hypotenuses, children at the centers of the s / 2 blocks), then the
+  // block centers (diagonal hypotenuses, children on the block edges)
+  for (int s = 2; s <= n; s *= 2)
+  {
+    const int hs = s / 2;
+    const int qs = s / 4;
+
+    parallel_for(0,
+                 n / hs + 1,
+                 [&](int r0, int r1)
+                 {
+                   for (int r = r0; r < r1; ++r)
+                   {
+                     const int  y = r * hs;
+                     const bool odd_row = r % 2 == 1;
+
+                     for (int x = odd_row ? 0 : hs; x <= n; x += s)
+                     {
+                       float e = odd_row ? split_error(x, y, x, y - hs, x, y + hs, hs)
+                                         : split_error(x, y, x - hs, y, x + hs, y, hs);
+
+                       if (qs > 0)
+                         for (int c = 0; c < 4; ++c)
+                         {
+                           int cx = x + (c & 1 ? qs : -qs);
+                           int cy = y + (c & 2 ? qs : -qs);
+
+                           if (cx >= 0 && cx <= n && cy >= 0 && cy <= n)
+                             e = std::max(e, err[cy * gs + cx]);
+                         }
+
+                       err[y * gs + x] = e;
+                     }
+                   }
+                 });
+
+    // block centers, the diagonal alternates in a checkerboard pattern
+    parallel_for(0,
+                 n / s,
+                 [&](int b0, int b1)
+                 {
+                   for (int b = b0; b < b1; ++b)
+                     for (int a = 0; a < n / s; ++a)
+                     {
+                       const int x = a * s + hs;
+                       const int y = b * s + hs;
+
+                       const int dy = (a + b) % 2 == 0 ? hs : -hs;
+
+                       float e = split_error(x, y, x - hs, y - dy, x + hs, y + dy, hs);
+
+                       e = std::max(e, err[y * gs + x - hs]);
+                       e = std::max(e, err[y * gs + x + hs]);
+                       e = std::max(e, err[(y - hs) * gs + x]);
+                       e = std::max(e, err[(y + hs) * gs + x]);
+
+                       err[y * gs + x] = e;
+                     }
+                 });
+  }
+
+  const auto t1 = std::chrono::steady_clock::now();
+
+  qtr::Logger::log()->trace(
+      "HeightmapRTIN::build: {} x {} (grid {}), {} ms",
+      width,
+      height,
+      n,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+void HeightmapRTIN::clear()
+{
+  this->width = 0;
+  this->height = 0;
+  this->size = 0;
+  this->errors.clear();
+  this->errors.shrink_to_fit();
+  this->excluded.clear();
+  this->excluded.shrink_to_fit();
+}
+
+void HeightmapRTIN::extract(std::vector<uint> &triangles, float max_error) const
+{
+  triangles.clear();
+
+  if (this->is_empty())
+    return;
+
+  const int n = this->size;
+  const int gs = n + 1;
+
+  // (a, b) hypotenuse, c right angle vertex
+  auto process = [&](auto &&self, int ax, int ay, int bx, int by, int cx, int cy) -> void
+  {
+    const int mx = (ax + bx) / 2;
+    const int my = (ay + by) / 2;
+
+    const bool is_leaf = std::abs(ax - cx) + std::abs(ay - cy) == 1;
+
+    if (!is_leaf && this->errors[my * gs + mx] > max_error)
+    {
+      self(self, cx, cy, ax, ay, mx, my);
+      self(self, bx, by, cx, cy, mx, my);
+      return;
+    }
+
+    if (!this->is_valid(ax, ay) || !this->is_valid(bx, by) || !this->is_valid(cx, cy))
+      return;
+
+    // next to holes, drop the whole cell as generate_heightmap does
+    if (!this->excluded.empty() && is_leaf)
+    {
+      const int i = std::min({ax, bx, cx});
+      const int j = std::min({ay, by, cy});
+
+      if (!this->is_valid(i, j) || !this->is_valid(i + 1, j) ||
+          !this->is_valid(i, j + 1) || !this->is_valid(i + 1, j + 1))
+        return;
+    }
+
+    // same orientation as the regular grid triangles
+    if ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax) > 0)
+    {
+      std::swap(bx, cx);
+      std::swap(by, cy);
+    }
+
+    triangles.push_back(ay * this->width + ax);
+    triangles.push_back(by * this->width + bx);
+    triangles.push_back(cy * this->width + cx);
+  };
+
+  process(process, 0, 0, n, n, n, 0);
+  process(process, n, n, 0, 0, 0, n);
+}
+
+int HeightmapRTIN::get_height() const { return this->height; }
+
+int HeightmapRTIN::get_width() const { return this->width; }
+
+bool HeightmapRTIN::is_empty() const { return this->errors.empty(); }
+
+bool HeightmapRTIN::is_valid(int i, int j) const
+{
+  if (i >= this->width || j >= this->height)
+    return false;
+
+  return this->excluded.empty() || !this->excluded[j * this->width + i];
+}
+
+} // namespace qtr
@@ -90,6 +90,25 @@ bool Shader::from_file(const std::string &vertex_path, const std::string &fragme
   return this->from_code(vertex_code, fragment_code);
 }
 
+std::string add_terrain_vertex_code(const std::string &vertex_code)
+{
+  size_t pos = vertex_code.find("#version");
+
+  if (pos == std::string::npos)
+  {
+    qtr::Logger::log()->error("add_terrain_vertex_code: no #version directive");
+    return vertex_code;
+  }
+
+  pos = vertex_code.find('\n', pos);
+  if (pos == std::string::npos)
+    pos = vertex_code.size();
+
+  std::string code = vertex_code;
+  code.insert(pos, "\n" + terrain_vertex_code);
+  return code;
+}
+
 void Shader::destroy() { this->sp_program.reset(); }
 
 QOpenGLShaderProgram *Shader::get() { return this->sp_program.get(); }
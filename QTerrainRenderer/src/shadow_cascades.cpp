@@ -0,0 +1,113 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "qtr/shadow_cascades.hpp"
+
+namespace qtr
+{
+
+std::vector<ShadowCascade> compute_shadow_cascades(const Camera    &camera,
+                                                   float            aspect_ratio,
+                                                   float            max_distance,
+                                                   const glm::vec3 &light_dir,
+                                                   float            scene_radius,
+                                                   int              count,
+                                                   int              resolution,
+                                                   float            split_lambda,
+                                                   float            margin)
+{
+  std::vector<ShadowCascade> cascades;
+
+  count = std::clamp(count, 1, QTR_MAX_SHADOW_CASCADES);
+
+  const float d_near = camera.near_plane;
+  const float d_far = std::clamp(max_distance, d_near + 1e-3f, camera.far_plane);
+
+  // light view, orientation only, eye at a unit distance from the
+  // origin
+  const glm::vec3 dir = glm::normalize(light_dir);
+  const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f)
+                                               : glm::vec3(0.f, 1.f, 0.f);
+  const glm::mat4 light_view = glm::lookAt(-dir, glm::vec3(0.f), up);
+
+  const glm::mat4 inv_view = glm::inverse(camera.get_view_matrix());
+  const float     tan_y = std::tan(0.5f * camera.fov);
+  const float     tan_x = tan_y * aspect_ratio;
+
+  float d0 = d_near;
+
+  for (int i = 0; i < count; ++i)
+  {
+    const float t = (float)(i + 1) / count;
+    const float d_log = d_near * std::pow(d_far / d_near, t);
+    const float d_uniform = d_near + (d_far - d_near) * t;
+    const float d1 = split_lambda * d_log + (1.f - split_lambda) * d_uniform;
+
+    // slice corners, the camera looking toward -z in view space
+    std::array<glm::vec3, 8> corners;
+    glm::vec3                center(0.f);
+    int                      k = 0;
+
+    for (float d : {d0, d1})
+      for (float sx : {-1.f, 1.f})
+        for (float sy : {-1.f, 1.f})
+        {
+          glm::vec4 p = inv_view * glm::vec4(sx * tan_x * d, sy * tan_y * d, -d, 1.f);
+          corners[k] = glm::vec3(p);
+          center += corners[k++] / 8.f;
+        }
+
+    // the radius does not depend on the camera orientation, rounded to
+    // keep the texel size constant
+    float slice_radius = 0.f;
+    for (auto &c : corners)
+      slice_radius = std::max(slice_radius, glm::length(c - center));
+
+    const float radius = std::ceil(margin * slice_radius * 16.f) / 16.f;
+
+    // snapped center, in light view space
+    const float texel_size = 2.f * radius / resolution;
+    glm::vec3   lc = glm::vec3(light_view * glm::vec4(center, 1.f));
+
+    lc.x = std::floor(lc.x / texel_size) * texel_size;
+    lc.y = std::floor(lc.y / texel_size) * texel_size;
+
+    const float z_near = std::min(-lc.z - radius, 1.f - scene_radius);
+    const float z_far = -lc.z + radius;
+
+    const glm::mat4 projection = glm::ortho(lc.x - radius,
+                                            lc.x + radius,
+                                            lc.y - radius,
+                                            lc.y + radius,
+                                            z_near,
+                                            z_far);
+
+    cascades.push_back({projection * light_view,
+                        d1,
+                        texel_size,
+                        lc,
+                        radius,
+                        slice_radius});
+    d0 = d1;
+  }
+
+  return cascades;
+}
+
+bool shadow_cascade_contains(const ShadowCascade &drawn, const ShadowCascade &fitted)
+{
+  // too coarse, e.g. once the camera got closer to the terrain
+  if (drawn.radius > 1.5f * fitted.radius)
+    return false;
+
+  const glm::vec3 d = glm::abs(fitted.center - drawn.center) + fitted.slice_radius;
+
+  return d.x <= drawn.radius && d.y <= drawn.radius && d.z <= drawn.radius;
+}
+
+} // namespace qtr
@@ -2,12 +2,28 @@
  License. The full license is in the file LICENSE, distributed with this software. */
 #include "qtr/windows_patch.hpp"
 
+#include <algorithm>
+
 #include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
 #include "qtr/texture.hpp"
 
 namespace qtr
 {
 
+// float data to 16-bit texels (PRECISION_UNORM16 or PRECISION_HALF)
+static void convert_to_16bit(const float     *p_src,
+                             size_t           count,
+                             TexturePrecision precision,
+                             const glm::vec2 &decode,
+                             uint16_t        *p_dst)
+{
+  if (precision == PRECISION_UNORM16)
+    convert_to_unorm16(p_src, count, decode.y, decode.y + decode.x, p_dst);
+  else
+    convert_to_half(p_src, count, p_dst);
+}
+
 Texture::Texture() : id(0), width(0), height(0) {}
 
 Texture::~Texture() { this->destroy(); }
@@ -17,7 +33,7 @@ void Texture::bind(int unit)
   if (this->is_active())
   {
     glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, this->id);
+    glBindTexture(this->target, this->id);
   }
 }
 
@@ -25,11 +41,10 @@ void Texture::bind_and_set(QOpenGLShaderProgram &shader,
                            const std::string    &tex_id,
                            int                   unit)
 {
-  if (this->is_active())
-  {
-    this->bind(unit);
-    shader.setUniformValue(tex_id.c_str(), unit);
-  }
+  // the unit is set even without texture, an unset sampler would use
+  // the unit 0, possibly bound to a texture of another type
+  this->bind(unit);
+  shader.setUniformValue(tex_id.c_str(), unit);
 }
 
 void Texture::destroy()
@@ -39,9 +54,16 @@ void Texture::destroy()
     glDeleteTextures(1, &this->id);
     this->id = 0;
   }
+
+  this->target = GL_TEXTURE_2D;
+  this->nlayers = 1;
+  this->precision = PRECISION_FLOAT;
+  this->decode = glm::vec2(1.f, 0.f);
 }
 
-bool Texture::from_float_vector(const std::vector<float> &data, int new_width)
+bool Texture::from_float_vector(const std::vector<float> &data,
+                                int                       new_width,
+                                TexturePrecision          new_precision)
 {
   this->initializeOpenGLFunctions();
   // QOpenGLFunctions_3_3_Core::initializeOpenGLFunctions();
@@ -49,19 +71,62 @@ bool Texture::from_float_vector(const std::vector<float> &data, int new_width)
 
   this->width = new_width;
   this->height = data.size() / this->width;
+  this->precision = new_precision;
 
   glGenTextures(1, &this->id);
   glBindTexture(GL_TEXTURE_2D, this->id);
 
-  glTexImage2D(GL_TEXTURE_2D,
-               0,
-               GL_R32F, // internal format (1 float channel)
-               this->width,
-               this->height,
-               0,
-               GL_RED,
-               GL_FLOAT,
-               data.data());
+  if (this->precision == PRECISION_FLOAT)
+  {
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_R32F, // internal format (1 float channel)
+                 this->width,
+                 this->height,
+                 0,
+                 GL_RED,
+                 GL_FLOAT,
+                 data.data());
+  }
+  else
+  {
+    if (this->precision == PRECISION_UNORM16)
+    {
+      auto [it_min, it_max] = std::minmax_element(data.begin(), data.end());
+      this->decode = glm::vec2(*it_max - *it_min, *it_min);
+    }
+
+    // half the memory of GL_R32F, converted by bands of rows
+    std::vector<uint16_t> texels(data.size());
+
+    parallel_for(0,
+                 this->height,
+                 [&](int j0, int j1)
+                 {
+                   const size_t k0 = (size_t)j0 * this->width;
+
+                   convert_to_16bit(data.data() + k0,
+                                    (size_t)(j1 - j0) * this->width,
+                                    this->precision,
+                                    this->decode,
+                                    texels.data() + k0);
+                 });
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 this->precision == PRECISION_UNORM16 ? GL_R16 : GL_R16F,
+                 this->width,
+                 this->height,
+                 0,
+                 GL_RED,
+                 this->precision == PRECISION_UNORM16 ? GL_UNSIGNED_SHORT
+                                                      : GL_HALF_FLOAT,
+                 texels.data());
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -211,6 +276,195 @@ bool Texture::from_image_16bit_grayscale(const std::vector<uint16_t> &img, int n
   return true;
 }
 
+bool Texture::from_layers_rgba8(const std::vector<uint8_t> &data,
+                                int                         new_width,
+                                int                         new_height,
+                                int                         new_nlayers,
+                                bool                        tileable)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  if (new_nlayers <= 0 ||
+      data.size() != (size_t)new_width * new_height * new_nlayers * 4)
+    return false;
+
+  this->width = new_width;
+  this->height = new_height;
+  this->nlayers = new_nlayers;
+  this->target = GL_TEXTURE_2D_ARRAY;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+
+  glTexImage3D(GL_TEXTURE_2D_ARRAY,
+               0,
+               GL_RGBA8,
+               this->width,
+               this->height,
+               this->nlayers,
+               0,
+               GL_RGBA,
+               GL_UNSIGNED_BYTE,
+               data.data());
+
+  const GLint wrap = tileable ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  if (tileable)
+  {
+    // tiled many times over the screen, filtered at a distance
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,
+                    GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+  }
+  else
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  return true;
+}
+
+bool Texture::from_raster(const RasterView &data)
+{
+  if (!data.is_valid())
+  {
+    qtr::Logger::log()->error("Texture::from_raster: inconsistent raster shape");
+    return false;
+  }
+
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->width = data.get_width();
+  this->height = data.get_height();
+
+  static const GLenum formats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  static const GLenum internal_formats[4][4] = {
+      {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8},         // UINT8
+      {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16},     // UINT16
+      {GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F}, // HALF
+      {GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F}, // FLOAT
+  };
+  static const GLenum types[4] = {GL_UNSIGNED_BYTE,
+                                  GL_UNSIGNED_SHORT,
+                                  GL_HALF_FLOAT,
+                                  GL_FLOAT};
+
+  const int t = static_cast<int>(data.get_type());
+  const int c = data.get_channels() - 1;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D, this->id);
+
+  qtr::Logger::log()->trace(
+      "Texture::from_raster: id = {}, w x h = {} x {}, channels = {}",
+      this->id,
+      this->width,
+      this->height,
+      c + 1);
+
+  // rows read in place, 'stride' pixels apart
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)data.get_stride());
+
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               internal_formats[t][c],
+               this->width,
+               this->height,
+               0,
+               formats[c],
+               types[t],
+               data.get_data());
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return true;
+}
+
+bool Texture::from_vec2_levels(const std::vector<std::vector<glm::vec2>> &levels,
+                               int                                        new_width,
+                               int                                        new_height)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  if (levels.empty())
+    return false;
+
+  this->width = new_width;
+  this->height = new_height;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D, this->id);
+
+  for (size_t l = 0; l < levels.size(); ++l)
+    glTexImage2D(GL_TEXTURE_2D,
+                 (GLint)l,
+                 GL_RG32F,
+                 std::max(1, this->width >> l),
+                 std::max(1, this->height >> l),
+                 0,
+                 GL_RG,
+                 GL_FLOAT,
+                 levels[l].data());
+
+  // texels are bounds, never interpolated
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return true;
+}
+
+void Texture::generate_color_texture(int new_width, int new_height)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->width = new_width;
+  this->height = new_height;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D, this->id);
+
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               GL_RGBA16F,
+               this->width,
+               this->height,
+               0,
+               GL_RGBA,
+               GL_FLOAT,
+               nullptr);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void Texture::generate_depth_texture(int  new_width,
                                      int  new_height,
                                      bool force_border_color)
@@ -249,18 +503,218 @@ void Texture::generate_depth_texture(int  new_width,
   glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Texture::generate_depth_texture_array(int  new_width,
+                                           int  new_height,
+                                           int  new_nlayers,
+                                           bool force_border_color,
+                                           bool compare_mode)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->width = new_width;
+  this->height = new_height;
+  this->nlayers = new_nlayers;
+  this->target = GL_TEXTURE_2D_ARRAY;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+
+  glTexImage3D(GL_TEXTURE_2D_ARRAY,
+               0,
+               GL_DEPTH_COMPONENT32F,
+               this->width,
+               this->height,
+               this->nlayers,
+               0,
+               GL_DEPTH_COMPONENT,
+               GL_FLOAT,
+               nullptr);
+
+  // comparisons are filtered by the hardware (2x2 PCF per fetch)
+  GLint filter = compare_mode ? GL_LINEAR : GL_NEAREST;
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+  if (compare_mode)
+  {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,
+                    GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  }
+
+  if (force_border_color)
+  {
+    float border_color[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+  }
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void Texture::generate_moments_texture_array(int new_width,
+                                             int new_height,
+                                             int new_nlayers)
+{
+  this->initializeOpenGLFunctions();
+  this->destroy();
+
+  this->width = new_width;
+  this->height = new_height;
+  this->nlayers = new_nlayers;
+  this->target = GL_TEXTURE_2D_ARRAY;
+
+  glGenTextures(1, &this->id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+
+  glTexImage3D(GL_TEXTURE_2D_ARRAY,
+               0,
+               GL_RG32F,
+               this->width,
+               this->height,
+               this->nlayers,
+               0,
+               GL_RG,
+               GL_FLOAT,
+               nullptr);
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+  // far depth, no variance
+  float border_color[] = {1.0f, 1.0f, 0.0f, 0.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+glm::vec2 Texture::get_decode() const { return this->decode; }
+
 GLuint Texture::get_id() const { return this->id; }
 
 int Texture::get_width() const { return this->width; }
 
 int Texture::get_height() const { return this->height; }
 
+int Texture::get_layer_count() const { return this->nlayers; }
+
+TexturePrecision Texture::get_precision() const { return this->precision; }
+
 bool Texture::is_active() const { return (this->id != 0); }
 
 void Texture::unbind()
 {
   if (this->is_active())
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(this->target, 0);
+}
+
+void Texture::update_level_region(int                           level,
+                                  const std::vector<glm::vec2> &data,
+                                  int                           x,
+                                  int                           y,
+                                  int                           w,
+                                  int                           h)
+{
+  const int level_width = std::max(1, this->width >> level);
+
+  if (!this->is_active() || w <= 0 || h <= 0)
+    return;
+
+  glBindTexture(GL_TEXTURE_2D, this->id);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, level_width);
+
+  glTexSubImage2D(GL_TEXTURE_2D,
+                  level,
+                  x,
+                  y,
+                  w,
+                  h,
+                  GL_RG,
+                  GL_FLOAT,
+                  data.data() + (size_t)y * level_width + x);
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool Texture::update_region(const std::vector<float> &data, int x, int y, int w, int h)
+{
+  if (!this->is_active() || (int)data.size() != this->width * this->height)
+    return false;
+
+  std::vector<uint16_t> texels;
+
+  if (this->precision != PRECISION_FLOAT)
+  {
+    texels.resize((size_t)w * h);
+
+    for (int j = 0; j < h; ++j)
+    {
+      const float *p_row = data.data() + (size_t)(y + j) * this->width + x;
+
+      // normalized range fixed at the upload
+      if (this->precision == PRECISION_UNORM16)
+      {
+        auto [it_min, it_max] = std::minmax_element(p_row, p_row + w);
+
+        if (*it_min < this->decode.y || *it_max > this->decode.y + this->decode.x)
+          return false;
+      }
+
+      convert_to_16bit(p_row,
+                       w,
+                       this->precision,
+                       this->decode,
+                       texels.data() + (size_t)j * w);
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, this->id);
+
+  if (this->precision == PRECISION_FLOAT)
+  {
+    // rows of the region are read in place from the whole image
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, this->width);
+
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    x,
+                    y,
+                    w,
+                    h,
+                    GL_RED,
+                    GL_FLOAT,
+                    data.data() + (size_t)y * this->width + x);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  }
+  else
+  {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    x,
+                    y,
+                    w,
+                    h,
+                    GL_RED,
+                    this->precision == PRECISION_UNORM16 ? GL_UNSIGNED_SHORT
+                                                         : GL_HALF_FLOAT,
+                    texels.data());
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return true;
 }
 
 } // namespace qtr
@@ -1,6 +1,7 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -12,6 +13,7 @@
 #include "nlohmann/json.hpp"
 
 #include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
 
 namespace qtr
 {
@@ -157,4 +159,97 @@ std::vector<float> load_png_as_grayscale(const std::string &path, int &width, in
   return data;
 }
 
+std::vector<glm::ivec4> find_changed_regions(const std::vector<float> &a,
+                                             const std::vector<float> &b,
+                                             int                       width,
+                                             int                       height,
+                                             int                       block_size)
+{
+  const int nbx = (width + block_size - 1) / block_size;
+  const int nby = (height + block_size - 1) / block_size;
+
+  // 0: unchanged, 1: changed, 2: changed and already in a region
+  std::vector<uint8_t> blocks(nbx * nby, 0);
+
+  // row segments of each block compared with memcmp (vectorized by the
+  // C library), bit-wise so that NaNs compare as equal
+  parallel_for(0,
+               nby,
+               [&](int by0, int by1)
+               {
+                 for (int by = by0; by < by1; ++by)
+                   for (int j = by * block_size;
+                        j < std::min((by + 1) * block_size, height);
+                        ++j)
+                   {
+                     const size_t row = (size_t)j * width;
+
+                     for (int bx = 0; bx < nbx; ++bx)
+                     {
+                       uint8_t &flag = blocks[by * nbx + bx];
+
+                       if (flag)
+                         continue;
+
+                       const int i0 = bx * block_size;
+                       const int n = std::min(block_size, width - i0);
+
+                       if (std::memcmp(a.data() + row + i0,
+                                       b.data() + row + i0,
+                                       n * sizeof(float)))
+                         flag = 1;
+                     }
+                   }
+               });
+
+  // one rectangle per 4-connected group of changed blocks
+  std::vector<glm::ivec4> rects;
+  std::vector<int>        stack;
+
+  for (int k = 0; k < nbx * nby; ++k)
+  {
+    if (blocks[k] != 1)
+      continue;
+
+    glm::ivec4 r(k % nbx, k / nbx, k % nbx, k / nbx);
+
+    blocks[k] = 2;
+    stack.push_back(k);
+
+    while (!stack.empty())
+    {
+      const int q = stack.back();
+      const int qx = q % nbx;
+      const int qy = q / nbx;
+      stack.pop_back();
+
+      r = glm::ivec4(std::min(r.x, qx),
+                     std::min(r.y, qy),
+                     std::max(r.z, qx),
+                     std::max(r.w, qy));
+
+      auto visit = [&](int nx, int ny)
+      {
+        if (nx >= 0 && nx < nbx && ny >= 0 && ny < nby && blocks[ny * nbx + nx] == 1)
+        {
+          blocks[ny * nbx + nx] = 2;
+          stack.push_back(ny * nbx + nx);
+        }
+      };
+
+      visit(qx - 1, qy);
+      visit(qx + 1, qy);
+      visit(qx, qy - 1);
+      visit(qx, qy + 1);
+    }
+
+    rects.push_back(glm::ivec4(r.x * block_size,
+                               r.y * block_size,
+                               std::min((r.z + 1) * block_size, width),
+                               std::min((r.w + 1) * block_size, height)));
+  }
+
+  return rects;
+}
+
 } // namespace qtr
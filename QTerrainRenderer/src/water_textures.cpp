@@ -0,0 +1,202 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "qtr/logger.hpp"
+#include "qtr/parallel.hpp"
+#include "qtr/water_textures.hpp"
+
+namespace qtr
+{
+
+static float fract(float x) { return x - std::floor(x); }
+
+static uint8_t to_unorm8(float v)
+{
+  return (uint8_t)std::lround(255.f * std::clamp(v, 0.f, 1.f));
+}
+
+// 2D -> 2D hash, as hash22f of the former shader version, in [0, 1)
+static void hash22f(float px, float py, float seed, float &hx, float &hy)
+{
+  px += seed;
+  py += seed;
+
+  float qx = fract(px * 0.1031f);
+  float qy = fract(py * 0.11369f);
+  float qz = fract(px * 0.13787f);
+  float d = qx * (qy + 19.19f) + qy * (qz + 19.19f) + qz * (qx + 19.19f);
+
+  qx += d;
+  qy += d;
+  qz += d;
+
+  hx = fract(qx * qy);
+  hy = fract(qz * qx);
+}
+
+// wave value at 'p' (in cells, within [0, tile_cells)) toward (dx, dy)
+static float gabor_wave(float px,
+                        float py,
+                        float dx,
+                        float dy,
+                        float angle_spread_ratio,
+                        int   tile_cells)
+{
+  const float fr = 6.28318530718f; // 2*pi
+  const float fa = 4.f;            // gaussian falloff factor
+
+  const float ix = std::floor(px);
+  const float iy = std::floor(py);
+  const float fx = px - ix;
+  const float fy = py - iy;
+
+  float av = 0.f;
+  float at = 0.f;
+
+  for (int j = -2; j <= 2; ++j)
+    for (int i = -2; i <= 2; ++i)
+    {
+      // wrapped cell, for a tileable result
+      const int cx = ((int)ix + i + tile_cells) % tile_cells;
+      const int cy = ((int)iy + j + tile_cells) % tile_cells;
+
+      // jitter the feature point inside the cell
+      float hx, hy;
+      hash22f((float)cx, (float)cy, 0.f, hx, hy);
+
+      const float rx = fx - (i + hx);
+      const float ry = fy - (j + hy);
+
+      // vary direction per-cell around 'dir'
+      float kx = dx + angle_spread_ratio * (2.f * hx - 1.f);
+      float ky = dy + angle_spread_ratio * (2.f * hy - 1.f);
+      float kn = std::hypot(kx, ky);
+
+      if (kn > 0.f)
+      {
+        kx /= kn;
+        ky /= kn;
+      }
+
+      const float w = std::exp(-fa * (rx * rx + ry * ry)); // gaussian window
+
+      av += w * std::cos(fr * (rx * kx + ry * ky));
+      at += w;
+    }
+
+  return av / std::max(at, 1e-6f);
+}
+
+void compute_flow_texture(std::vector<uint8_t>     &flow,
+                          const std::vector<float> &data,
+                          int                       width,
+                          int                       height)
+{
+  flow.assign((size_t)width * height * 4, 0);
+
+  if (width < 2 || height < 2 || data.size() != (size_t)width * height)
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  parallel_for(
+      0,
+      height,
+      [&](int j0, int j1)
+      {
+        for (int j = j0; j < j1; ++j)
+          for (int i = 0; i < width; ++i)
+          {
+            // central differences, one-sided at the borders
+            const int ia = std::max(i - 1, 0);
+            const int ib = std::min(i + 1, width - 1);
+            const int ja = std::max(j - 1, 0);
+            const int jb = std::min(j + 1, height - 1);
+
+            const float dhdu = (data[j * width + ib] - data[j * width + ia]) /
+                               ((float)(ib - ia) / (width - 1));
+            const float dhdv = (data[jb * width + i] - data[ja * width + i]) /
+                               ((float)(jb - ja) / (height - 1));
+            const float norm = std::hypot(dhdu, dhdv);
+
+            uint8_t *p = &flow[4 * ((size_t)j * width + i)];
+
+            if (norm > 1e-6f)
+            {
+              p[0] = to_unorm8(0.5f * dhdu / norm + 0.5f);
+              p[1] = to_unorm8(0.5f * dhdv / norm + 0.5f);
+              p[2] = 255;
+            }
+            else
+            {
+              p[0] = 128;
+              p[1] = 128;
+            }
+            p[3] = 255;
+          }
+      });
+
+  const auto t1 = std::chrono::steady_clock::now();
+  qtr::Logger::log()->trace(
+      "compute_flow_texture: {} x {}, {} ms",
+      width,
+      height,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+void compute_wave_texture(std::vector<uint8_t> &waves,
+                          int                   resolution,
+                          int                   tile_cells,
+                          float                 angle_spread_ratio,
+                          int                   ndirs)
+{
+  ndirs = std::max(4, ndirs / 4 * 4);
+  tile_cells = std::max(1, tile_cells);
+
+  const size_t layer_size = (size_t)resolution * resolution * 4;
+
+  waves.assign(layer_size * (ndirs / 4), 0);
+
+  if (resolution <= 0)
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  for (int s = 0; s < ndirs; ++s)
+  {
+    const float a = 6.28318530718f * s / ndirs;
+    const float dx = std::cos(a);
+    const float dy = std::sin(a);
+    uint8_t    *p_layer = waves.data() + layer_size * (s / 4) + s % 4;
+
+    parallel_for(
+        0,
+        resolution,
+        [&](int j0, int j1)
+        {
+          for (int j = j0; j < j1; ++j)
+            for (int i = 0; i < resolution; ++i)
+            {
+              // texel centers, in cells
+              const float px = (i + 0.5f) / resolution * tile_cells;
+              const float py = (j + 0.5f) / resolution * tile_cells;
+              const float v = gabor_wave(px, py, dx, dy, angle_spread_ratio, tile_cells);
+
+              p_layer[4 * ((size_t)j * resolution + i)] = to_unorm8(0.5f * v + 0.5f);
+            }
+        });
+  }
+
+  const auto t1 = std::chrono::steady_clock::now();
+  qtr::Logger::log()->trace(
+      "compute_wave_texture: {} x {}, {} directions, {} ms",
+      resolution,
+      resolution,
+      ndirs,
+      std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+}
+
+} // namespace qtr
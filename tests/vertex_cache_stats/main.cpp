@@ -0,0 +1,143 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include "qterrain_renderer.hpp"
+
+// post-transform cache statistics of the generated meshes, with and
+// without the index reordering (Config::geometry.optimize_vertex_cache)
+
+// index buffer read back from the GPU
+static std::vector<uint> read_indices(QOpenGLFunctions_3_3_Core &gl, qtr::Mesh &mesh)
+{
+  GLint size = 0;
+
+  // the element buffer binding is part of the VAO state
+  gl.glBindVertexArray(mesh.get_vao());
+  gl.glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+
+  std::vector<uint> indices;
+
+  if (mesh.get_index_type() == GL_UNSIGNED_SHORT)
+  {
+    std::vector<uint16_t> indices16(size / sizeof(uint16_t));
+    gl.glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, indices16.data());
+    indices.assign(indices16.begin(), indices16.end());
+  }
+  else
+  {
+    indices.resize(size / sizeof(uint));
+    gl.glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, indices.data());
+  }
+
+  gl.glBindVertexArray(0);
+
+  return indices;
+}
+
+int main(int argc, char *argv[])
+{
+  QGuiApplication app(argc, argv);
+
+  QSurfaceFormat format;
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+
+  QOpenGLContext context;
+  context.setFormat(format);
+
+  QOffscreenSurface surface;
+  surface.setFormat(format);
+  surface.create();
+
+  if (!context.create() || !context.makeCurrent(&surface))
+  {
+    qtr::Logger::log()->error("vertex_cache_stats: could not create an OpenGL context");
+    return 1;
+  }
+
+  QOpenGLFunctions_3_3_Core gl;
+  gl.initializeOpenGLFunctions();
+
+  const int          hmap_size = 1024;
+  std::vector<float> hmap(hmap_size * hmap_size);
+
+  for (int j = 0; j < hmap_size; ++j)
+    for (int i = 0; i < hmap_size; ++i)
+      hmap[j * hmap_size + i] = 0.5f + 0.25f * std::sin(0.02f * i) * std::cos(0.03f * j);
+
+  struct Case
+  {
+    std::string                      name;
+    std::function<void(qtr::Mesh &)> generate;
+  };
+
+  std::vector<Case> cases = {
+      {"heightmap",
+       [&](qtr::Mesh &mesh)
+       {
+         qtr::generate_heightmap(mesh,
+                                 hmap,
+                                 hmap_size,
+                                 hmap_size,
+                                 0.f,
+                                 0.f,
+                                 0.f,
+                                 2.f,
+                                 0.4f,
+                                 2.f,
+                                 true);
+       }},
+      {"implicit grid",
+       [&](qtr::Mesh &mesh)
+       { qtr::generate_heightmap_implicit_grid(mesh, hmap_size, hmap_size, true); }},
+      {"sphere", [](qtr::Mesh &mesh) { qtr::generate_sphere(mesh, 1.f); }},
+      {"rock", [](qtr::Mesh &mesh) { qtr::generate_rock(mesh, 1.f, 0.3f, 0, 3); }},
+      {"tree", [](qtr::Mesh &mesh) { qtr::generate_tree(mesh, 1.f, 0.1f, 5.f, 1.f); }},
+  };
+
+  std::printf("%-16s %10s %16s %16s\n", "mesh", "triangles", "ACMR", "ATVR");
+
+  for (auto &c : cases)
+  {
+    qtr::VertexCacheStats stats[2];
+    size_t                ntriangles = 0;
+
+    for (int optimize = 0; optimize < 2; ++optimize)
+    {
+      QTR_CONFIG->geometry.optimize_vertex_cache = optimize;
+
+      qtr::Mesh mesh;
+      c.generate(mesh);
+
+      std::vector<uint> indices = read_indices(gl, mesh);
+      size_t            vertex_count = 0;
+
+      for (uint v : indices)
+        vertex_count = std::max(vertex_count, (size_t)v + 1);
+
+      stats[optimize] = qtr::analyze_vertex_cache(indices, vertex_count);
+      ntriangles = indices.size() / 3;
+    }
+
+    std::printf("%-16s %10zu %7.3f -> %5.3f %7.3f -> %5.3f\n",
+                c.name.c_str(),
+                ntriangles,
+                stats[0].acmr,
+                stats[1].acmr,
+                stats[0].atvr,
+                stats[1].atvr);
+  }
+
+  context.doneCurrent();
+
+  return 0;
+}